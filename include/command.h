@@ -4,6 +4,9 @@
 #include <stdint.h>
 
 #define MAX_INPUT 1024
+#define WATCH_REFRESH_RATE 10 /* Default refresh rate of the watch view in Hz */
+#define WATCH_HEADER_LINES 2  /* Lines above the first row of the watch view */
+#define SIZE_EVENT_BUFFER 1024
 
 typedef struct
 {
@@ -25,6 +28,13 @@ int handle_command(const char *command, char *args);
 void cmd_loc(char *args);
 void cmd_mag(char *args);
 void cmd_restore(char *args);
+void cmd_consist(char *args);
+void cmd_snapshot(char *args);
+void cmd_record(char *args);
+void cmd_route(char *args);
+void cmd_stop(char *args);
+void cmd_stats(char *args);
+void cmd_watch(char *args);
 void cmd_help(char *args);
 
 #endif
\ No newline at end of file
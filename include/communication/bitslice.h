@@ -0,0 +1,220 @@
+#ifndef BITSLICE_H
+#define BITSLICE_H
+
+#include <rtai.h>
+#include <rtai_sched.h>
+#include <rtai_sem.h>
+
+#include "communication/waveform.h"
+
+#define SHARD_MAX 4              /* One shard per parallel port, each on its own CPU */
+#define DISTRICT_MAX 8           /* One booster district per data line of the parallel port */
+#define BITSLICE_MERGE_TIME 2000 /* Edges of different districts closer than 2 us share one port write */
+#define BITSLICE_EDGE_SLACK 1500 /* A later edge lengthens one half bit and shortens the next by more than 3 us in total */
+
+/**
+ * @struct ShardConfig
+ * @brief Describes an output channel with its own parallel port and scheduler.
+ *
+ * This structure contains the following fields:
+ * - port: The base address of the parallel port driven by the shard.
+ * - cpu: The CPU running the track task and the locomotive tasks of the shard.
+ */
+typedef struct
+{
+    unsigned short port; // Base address of the parallel port driven by the shard.
+    unsigned int cpu;    // CPU running the track task and the locomotive tasks of the shard.
+} ShardConfig;
+
+/**
+ * @struct DistrictConfig
+ * @brief Describes which booster district drives which decoders.
+ *
+ * This structure contains the following fields:
+ * - shard: The shard whose parallel port drives the district.
+ * - lines: The data lines of the parallel port connected to the booster of the district.
+ * - uart: The booster is driven by a UART backend instead of data lines (see UartData).
+ * - locomotive_first, locomotive_last: Range of locomotive addresses in the district.
+ * - magnetic_first, magnetic_last: Range of accessory addresses in the district.
+ */
+typedef struct
+{
+    int shard;            // Shard whose parallel port drives the district.
+    unsigned char lines;  // Data lines of the parallel port driving the booster of the district.
+    int uart;             // The booster is driven by a UART backend instead of data lines.
+    int locomotive_first; // First locomotive address in the district.
+    int locomotive_last;  // Last locomotive address in the district.
+    int magnetic_first;   // First accessory address in the district.
+    int magnetic_last;    // Last accessory address in the district.
+} DistrictConfig;
+
+/**
+ * @struct District
+ * @brief The packet stream of one booster district.
+ *
+ * Tasks hand a waveform to a district while holding its rails semaphore. The track task
+ * of its shard picks it up at the next packet boundary of the district and fills every
+ * gap with idle packets. Only the emergency task hands an emergency waveform, which is
+ * taken at the next packet boundary even between the repetitions of a handed waveform.
+ * The interrupted waveform continues with its remaining repetitions afterwards. Each district is aligned to its own cache lines, so districts of
+ * different shards never share one.
+ *
+ * The packets of a UART district are published for its UART backend instead, which times
+ * the bits in hardware and fills the gaps itself. The track task only keeps the time of each
+ * packet on the serial line, so it wakes once per packet instead of once per half bit.
+ */
+typedef struct
+{
+    SEM rails;                        // Held by the task whose waveform is handed to the district.
+    SEM done;                         // Signaled by the track task when the handed waveform is sent.
+    const Waveform *volatile pending; // Waveform handed to the district, NULL if there is none.
+    volatile int pending_repeat;      // Number of times the handed waveform is sent back to back.
+    volatile RTIME started;           // Time the handed waveform started in nanoseconds.
+    volatile RTIME finished;          // Time the handed waveform finished in nanoseconds.
+
+    // Emergency handed by the emergency task, bypassing the rails
+    SEM emergency_done;                 // Signaled by the track task when the emergency waveform is sent.
+    const Waveform *volatile emergency; // Emergency waveform handed to the district, NULL if there is none.
+    volatile int emergency_repeat;      // Number of times the emergency waveform is sent back to back.
+    volatile RTIME emergency_started;   // Time the emergency waveform started in nanoseconds.
+
+    // Configuration
+    int shard;            // Shard driving the district.
+    unsigned char lines;  // Data lines driven by the district.
+    int uart;             // The district is driven by a UART backend.
+    int locomotive_first; // First locomotive address in the district.
+    int locomotive_last;  // Last locomotive address in the district.
+    int magnetic_first;   // First accessory address in the district.
+    int magnetic_last;    // Last accessory address in the district.
+
+    // State of the track task
+    const Waveform *current; // Waveform on the rails.
+    int repeat;              // Remaining repetitions of the current waveform.
+    int idle;                // The current waveform is an idle packet.
+    int in_emergency;        // The current waveform is the emergency waveform.
+    const Waveform *resume;  // Waveform interrupted by the emergency, NULL if there is none.
+    int resume_repeat;       // Remaining repetitions of the interrupted waveform.
+    int half_bit;            // Half bit of the current waveform on the rails.
+    int high;                // Level of the current half bit.
+    RTIME waveform_start;    // Start of the current waveform in counts.
+    RTIME next_edge;         // End of the current half bit in counts.
+} ____cacheline_aligned District;
+
+/**
+ * @struct Shard
+ * @brief An output channel with its own parallel port, track task and CPU.
+ *
+ * The districts of a shard are stored contiguously in the districts array. All state
+ * written by the track task of the shard, including its statistics, lives in the shard
+ * itself, so shards on different CPUs never write to a shared cache line.
+ */
+typedef struct
+{
+    RT_TASK track_task;  // Task driving the parallel port of the shard.
+    unsigned short port; // Base address of the parallel port.
+    unsigned char lines; // Data lines of all districts, 0 if the port is not used.
+    unsigned int cpu;    // CPU of the track task and the locomotive tasks.
+    int first_district;  // Index of the first district of the shard.
+    int district_count;  // Number of districts of the shard.
+
+    // Statistics of the track task
+    unsigned long long busy_time;    // Time the districts carried packets in nanoseconds.
+    unsigned long long idle_time;    // Time the districts carried idle packets in nanoseconds.
+    unsigned long long packets;      // Number of packets sent.
+    unsigned long long idle_packets; // Number of idle packets sent.
+    RTIME edge_lateness_max;         // Worst time the port was switched after the edge was due in counts.
+    unsigned long long edges_late;   // Number of edges switched later than BITSLICE_EDGE_SLACK.
+} ____cacheline_aligned Shard;
+
+extern District districts[DISTRICT_MAX * SHARD_MAX];
+extern int district_count;
+extern Shard shards[SHARD_MAX];
+extern int shard_count;
+
+/**
+ * @brief Sets up the shards and districts from the configuration and pre-encodes the idle waveform.
+ *
+ * Must be called after the timer is started and before the track tasks run.
+ */
+void init_track(void);
+
+/**
+ * @brief Releases the semaphores of the districts.
+ */
+void cleanup_track(void);
+
+/**
+ * @brief Looks up the district driving a locomotive.
+ *
+ * @param address The address of the locomotive.
+ * @return int The index of the district.
+ */
+int district_of_locomotive(int address);
+
+/**
+ * @brief Looks up the district driving an accessory.
+ *
+ * @param address The address of the accessory.
+ * @return int The index of the district.
+ */
+int district_of_magnetic(int address);
+
+/**
+ * @brief Looks up the CPU of the shard driving a locomotive.
+ *
+ * @param address The address of the locomotive.
+ * @return unsigned int The CPU its task should run on.
+ */
+unsigned int cpu_of_locomotive(int address);
+
+/**
+ * @brief Sums the statistics of all shards into the module statistics.
+ */
+void collect_track_statistics(void);
+
+/**
+ * @brief Lets the worst edge lateness of all shards start over.
+ */
+void reset_track_statistics(void);
+
+/**
+ * @brief Waits for the rails of a district and puts a waveform on them.
+ *
+ * Returns after the waveform was sent completely.
+ *
+ * @param district The index of the district.
+ * @param waveform The waveform to send.
+ * @param repeat The number of times the waveform is sent back to back.
+ * @param first Receives the start of the first bit in nanoseconds, may be NULL.
+ * @param last Receives the end of the last bit in nanoseconds, may be NULL.
+ */
+void send_bit_task(int district, const Waveform *waveform, int repeat, RTIME *first, RTIME *last);
+
+/**
+ * @brief Puts an emergency waveform on a district at its next packet boundary.
+ *
+ * Only called by the emergency task, one waveform per district until wait_emergency_waveform()
+ * returned for it.
+ *
+ * @param district The index of the district.
+ * @param waveform The waveform to send.
+ * @param repeat The number of times the waveform is sent back to back.
+ */
+void hand_emergency_waveform(int district, const Waveform *waveform, int repeat);
+
+/**
+ * @brief Waits until the emergency waveform handed to a district is sent.
+ *
+ * @param district The index of the district.
+ * @return RTIME The start of the first bit in nanoseconds.
+ */
+RTIME wait_emergency_waveform(int district);
+
+/**
+ * @brief Drives all districts of a shard with one port write per edge time.
+ *
+ * @param shard The index of the shard.
+ */
+void send_track_task(long shard);
+
+#endif
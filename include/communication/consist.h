@@ -0,0 +1,77 @@
+#ifndef CONSIST_H
+#define CONSIST_H
+
+#include <rtai.h>
+#include <rtai_sem.h>
+
+#include "telegram/locomotive.h"
+#include "communication/waveform.h"
+#include "telegram/system.h"
+
+#define CONSIST_MAX 8 /* Consists which may be defined at the same time */
+
+/**
+ * @struct Consist
+ * @brief Locomotives which are driven together under one address.
+ *
+ * The task of the first member refreshes all members back to back in one pass, the tasks
+ * of the other members stay silent while they belong to the consist. The entries are guarded
+ * by consist_sem, the tasks only read them through consist_members().
+ */
+typedef struct
+{
+    int used;                                // The entry holds a consist.
+    int address;                             // Address the consist is driven with.
+    int member_count;                        // Number of members.
+    int members[CONSIST_MAX_MEMBERS];        // Slot of each member.
+    int inverted[CONSIST_MAX_MEMBERS];       // The member drives backwards when the consist drives forwards.
+} ____cacheline_aligned Consist;
+
+extern Consist consists[CONSIST_MAX];
+extern SEM consist_sem;
+
+/**
+ * @brief Defines the consist of an address, replacing an existing one.
+ *
+ * Called with command_sem held only.
+ *
+ * @param address The address of the consist, above the addresses of the locomotive slots (LOC_MSQ_SIZE).
+ * @param members The member words, the locomotive address in bits 0 - 6 and the inversion in bit 7.
+ * @param count The number of members, 0 dissolves the consist.
+ * @return int Returns 0 on success, -1 if the definition is invalid.
+ */
+int define_consist(int address, const unsigned short *members, int count);
+
+/**
+ * @brief Looks up the consist driven with an address.
+ *
+ * @param address The address.
+ * @return Consist* The consist or NULL if the address drives no consist.
+ */
+Consist *find_consist(int address);
+
+/**
+ * @brief Copies the members of a consist while consist_sem is held.
+ *
+ * @param consist The consist.
+ * @param members Receives the slot of each member.
+ * @param inverted Receives the inversion of each member.
+ * @return int The number of members, 0 if the entry holds no consist.
+ */
+int consist_members(const Consist *consist, int members[], int inverted[]);
+
+/**
+ * @brief Applies a locomotive command addressed to a consist to all members at once.
+ *
+ * The semaphores of all members are held while they are updated, so the refresh of the consist
+ * never sends a mix of old and new states. The direction is inverted for inverted members.
+ *
+ * @param consist The consist.
+ * @param loco The command, its address is the address of the consist.
+ * @param ramp 1 to ramp the members towards the command, 0 to apply it at once.
+ * @param accel_time Time per speed step accelerating in nanoseconds, if ramping.
+ * @param decel_time Time per speed step decelerating in nanoseconds, if ramping.
+ */
+void drive_consist(Consist *consist, LocomotiveData loco, int ramp, RTIME accel_time, RTIME decel_time);
+
+#endif
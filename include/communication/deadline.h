@@ -0,0 +1,82 @@
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include <rtai.h>
+#include <rtai_sched.h>
+
+#define DEADLINE_DEGRADE_AFTER 3  /* Overrun activations in a row until a task stretches its period */
+#define DEADLINE_RECOVER_AFTER 50 /* Activations in time in a row until a stretched period is halved again */
+#define DEADLINE_STRETCH_MAX 4    /* Longest stretched period as a multiple of the period of the task */
+
+/**
+ * @struct Deadline
+ * @brief Lateness, run time and overruns of the activations of a periodic task.
+ *
+ * An activation overruns when it ends after the release of the next one. The bandwidth plan may let
+ * a task work in every planned-th activation only, the longer of both intervals applies. While degrading is
+ * enabled, a task overrunning DEADLINE_DEGRADE_AFTER times in a row only works in every second,
+ * then every fourth activation, and returns to every activation step by step once it keeps up.
+ * Only the task itself writes its Deadline, the statistics read it without a lock.
+ *
+ * This structure contains the following fields:
+ * - period: Period of the task in nanoseconds.
+ * - degradable: The task may skip activations to keep up.
+ * - release: Release of the current activation in nanoseconds.
+ * - begin: Start of the current activation in nanoseconds.
+ * - stretch: The task works in every stretch-th activation.
+ * - planned: The bandwidth plan lets the task work in every planned-th activation.
+ * - phase: Activations skipped since the last one the task worked in.
+ * - overrun_streak, on_time_streak: Activations overrun or in time in a row.
+ * - activations, overruns, skipped: Counters of the activations.
+ * - lateness_max, runtime_max: Worst start after the release and worst run time in nanoseconds.
+ */
+typedef struct
+{
+    RTIME period;              // Period of the task in nanoseconds.
+    int degradable;            // The task may skip activations to keep up.
+    RTIME release;             // Release of the current activation in nanoseconds.
+    RTIME begin;               // Start of the current activation in nanoseconds.
+    int stretch;               // The task works in every stretch-th activation.
+    int planned;               // The bandwidth plan lets the task work in every planned-th activation.
+    int phase;                 // Activations skipped since the last one the task worked in.
+    int overrun_streak;        // Activations overrun in a row.
+    int on_time_streak;        // Activations in time in a row.
+    unsigned long activations; // Activations the task worked in.
+    unsigned long overruns;    // Activations which ended after the release of the next one.
+    unsigned long skipped;     // Activations skipped while the period was stretched.
+    RTIME lateness_max;        // Worst start of an activation after its release in nanoseconds.
+    RTIME runtime_max;         // Worst run time of an activation in nanoseconds.
+} Deadline;
+
+/**
+ * @brief Enables stretching the period of overrunning tasks, set with SYSTEM_DEGRADE.
+ */
+extern volatile int deadline_degrade;
+
+/**
+ * @brief Makes a task periodic and starts the accounting of its activations.
+ *
+ * @param deadline The accounting of the task.
+ * @param task The task.
+ * @param start The release of the first activation in counts.
+ * @param period The period in nanoseconds.
+ * @param degradable The task may skip activations to keep up while degrading is enabled.
+ */
+void deadline_make_periodic(Deadline *deadline, RT_TASK *task, RTIME start, RTIME period, int degradable);
+
+/**
+ * @brief Starts an activation, called by the task after it was released.
+ *
+ * @param deadline The accounting of the task.
+ * @return int 1 if the task works in this activation, 0 if it is skipped to keep up.
+ */
+int deadline_begin(Deadline *deadline);
+
+/**
+ * @brief Ends an activation the task worked in, called before it waits for its next period.
+ *
+ * @param deadline The accounting of the task.
+ */
+void deadline_end(Deadline *deadline);
+
+#endif
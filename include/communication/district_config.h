@@ -0,0 +1,24 @@
+#ifndef DISTRICT_CONFIG_H
+#define DISTRICT_CONFIG_H
+
+#include "communication/bitslice.h"
+
+/*
+ * Output channels of the layout, at most SHARD_MAX. Every shard drives its own parallel port
+ * from its own CPU, which should be isolated from Linux (isolcpus) for the best timing.
+ */
+ShardConfig shard_config[] = {
+    {.port = 0x378, .cpu = 0},
+};
+
+/*
+ * Booster districts of the layout, at most DISTRICT_MAX per shard. Every district needs its
+ * own data lines of the parallel port of its shard, or .uart = 1 for a booster on a serial
+ * port driven by tools/uart_track. Decoders outside of all ranges are driven by the first
+ * district.
+ */
+DistrictConfig district_config[] = {
+    {.shard = 0, .lines = 0x11, .locomotive_first = 0, .locomotive_last = 127, .magnetic_first = 0, .magnetic_last = 511},
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef EMERGENCY_H
+#define EMERGENCY_H
+
+#include <rtai.h>
+#include <rtai_sched.h>
+#include <rtai_sem.h>
+
+#define EMERGENCY_REPEAT 3     /* Number of times an emergency packet is sent back to back */
+#define EMERGENCY_QUEUE_SIZE 8 /* Emergencies waiting for the emergency task */
+
+extern RT_TASK emergency_task;
+extern SEM emergency_sem;
+
+/**
+ * @brief Pre-encodes the broadcast emergency packets.
+ *
+ * Must be called once after the timer is started and before the emergency task runs,
+ * so the fast path only has to emit waveforms and never has to build one.
+ */
+void init_emergency(void);
+
+/**
+ * @brief Requests emergency packets at the next packet boundary.
+ *
+ * The locomotive slots are updated as well, so their refresh packets keep the decoders
+ * stopped afterwards. The requests are served by the emergency task in the order they were
+ * made. Each district takes the emergency at its next packet boundary, also between the
+ * repetitions of a packet, without waiting for the rails.
+ * Called with command_sem held only.
+ *
+ * @param kind The kind of emergency packet (see enum emergency_kind).
+ * @param address The address of the locomotive to stop, 0 to address all decoders.
+ * @return int Returns 0 on success, -1 if the request is invalid or EMERGENCY_QUEUE_SIZE requests are waiting.
+ */
+int request_emergency(int kind, int address);
+
+/**
+ * @brief Sends requested emergency packets as soon as the current packet of each district is finished.
+ *
+ * @param arg Unused.
+ */
+void send_emergency_task(long arg);
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef INTERLOCKING_H
+#define INTERLOCKING_H
+
+#include "telegram/system.h"
+
+#define INTERLOCK_WORDS (INTERLOCK_ELEMENTS / 64) /* 64 elements per word of a set */
+#define INTERLOCK_ROUTES 16                       /* Routes which may hold locks at the same time */
+
+/**
+ * @struct ElementSet
+ * @brief A set of interlocking elements, one bit per element.
+ *
+ * The range of words holding elements is tracked, so operations on small sets only
+ * touch the words they use no matter how many elements the layout has.
+ */
+typedef struct
+{
+    unsigned long long bits[INTERLOCK_WORDS]; // Bit e % 64 of word e / 64 is set for element e.
+    int first_word;                           // First word holding an element, INTERLOCK_WORDS if empty.
+    int last_word;                            // Last word holding an element, -1 if empty.
+} ElementSet;
+
+/**
+ * @brief Empties a set.
+ *
+ * @param set The set.
+ */
+void element_set_clear(ElementSet *set);
+
+/**
+ * @brief Adds an element to a set.
+ *
+ * @param set The set.
+ * @param element The element (0 to INTERLOCK_ELEMENTS - 1).
+ * @return int Returns 0 on success, -1 if the element is out of range.
+ */
+int element_set_add(ElementSet *set, int element);
+
+/**
+ * @brief Locks the elements of a route if none of them is locked by another route.
+ *
+ * The conflict check is a word-wide AND of the set with the locked elements.
+ *
+ * @param route The route, must not hold locks already.
+ * @param elements The elements of the route.
+ * @return int Returns 0 on success, -1 if an element is locked or all route entries are in use.
+ */
+int interlock_route(unsigned short route, const ElementSet *elements);
+
+/**
+ * @brief Releases elements locked by a route.
+ *
+ * Elements not locked by the route are ignored. The route gives up its entry once it holds
+ * no element anymore.
+ *
+ * @param route The route.
+ * @param elements The elements to release, NULL to release all elements of the route.
+ * @return int Returns the number of released elements, -1 if the route holds no locks.
+ */
+int interlock_release(unsigned short route, const ElementSet *elements);
+
+/**
+ * @brief Tells whether an element is locked by any route.
+ *
+ * @param element The element.
+ * @return int 1 if it is locked, 0 otherwise.
+ */
+int interlock_is_locked(int element);
+
+#endif
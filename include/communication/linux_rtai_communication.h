@@ -3,17 +3,196 @@
 
 #include <stdint.h>
 
+/**
+ * @struct AckStatistics
+ * @brief Round trip estimation and retry counters of one command type.
+ *
+ * This structure contains the following fields:
+ * - commands: Number of commands sent.
+ * - retries: Number of retransmissions after a timeout.
+ * - failures: Number of commands which were never acknowledged.
+ * - rejections: Number of commands rejected by the module.
+ * - samples: Number of measured round trips.
+ * - srtt: Smoothed round trip time in microseconds.
+ * - rttvar: Round trip time variance in microseconds.
+ * - timeout: Current retry timeout in microseconds.
+ */
+typedef struct
+{
+    unsigned long commands;   // Number of commands sent.
+    unsigned long retries;    // Number of retransmissions after a timeout.
+    unsigned long failures;   // Number of commands which were never acknowledged.
+    unsigned long rejections; // Number of commands rejected by the module.
+    unsigned long samples;    // Number of measured round trips.
+    long srtt;                // Smoothed round trip time in microseconds.
+    long rttvar;              // Round trip time variance in microseconds.
+    long timeout;             // Current retry timeout in microseconds.
+} AckStatistics;
+
 /**
  * @brief Sends a 16-bit data value with acknowledgement.
  *
  * This function attempts to send the provided 16-bit data to a receiving process
  * over the RTAI communication framework and waits for an acknowledgement. In case
  * of failure, the transmission is retried up to the number of attempts specified.
+ * A command rejected by the module is not retried.
+ *
+ * The time to wait for the acknowledgement follows the smoothed round trip time of the
+ * command type and doubles with each retry.
  *
  * @param data The data value to be transmitted.
  * @param attempts The maximum number of transmission attempts (defaults to 3).
- * @return int Returns a status code indicating success or failure of the transmission.
+ * @return int Returns 0 on success, -2 if the module rejected the command, -1 on other failures.
  */
 int send_with_ack(unsigned short data, int attempts);
 
-#endif
\ No newline at end of file
+/**
+ * @brief Sends a complete command as it is, for example from a session log, and waits for the acknowledgement.
+ *
+ * @param command The header word of the command followed by its payload.
+ * @param count The number of words.
+ * @param attempts The maximum number of transmission attempts.
+ * @return int Returns 0 on success, -2 if the module rejected the command, -1 on other failures.
+ */
+int send_raw_with_ack(const unsigned short *command, int count, int attempts);
+
+/**
+ * @brief Sends a system command with its payload and waits for the acknowledgement.
+ *
+ * The header and the payload are written in one piece so the module always receives
+ * the complete command. The acknowledgement echoes the header word.
+ *
+ * @param opcode The operation requested from the module (see enum system_opcode).
+ * @param payload The payload words following the header, may be NULL if count is 0.
+ * @param count The number of payload words (0 to SYSTEM_MAX_PAYLOAD).
+ * @param attempts The maximum number of transmission attempts.
+ * @return int Returns 0 on success, a negative value on failure.
+ */
+int send_system_with_ack(unsigned short opcode, const unsigned short *payload, int count, int attempts);
+
+/**
+ * @brief Sends a command which the module holds back and executes at the given time.
+ *
+ * The acknowledgement only confirms that the module holds the command. The module publishes
+ * EVENT_SCHEDULED when it executed the command.
+ *
+ * @param absolute 1 if time is an RT time of the module, 0 if it is a delay from the reception.
+ * @param time The RT time or the delay in nanoseconds.
+ * @param command The header word of the command followed by its payload.
+ * @param count The number of words (1 to SCHEDULE_MAX_COMMAND).
+ * @param attempts The maximum number of transmission attempts.
+ * @return int Returns 0 on success, a negative value on failure.
+ */
+int send_scheduled_with_ack(int absolute, unsigned long long time, const unsigned short *command, int count, int attempts);
+
+/**
+ * @brief Opens the event fifo of the module for reading.
+ *
+ * The fifo is opened non-blocking so the caller can wait for it with select().
+ *
+ * @return int The file descriptor of the event fifo or a negative value on failure.
+ */
+int open_event_fifo(void);
+
+/**
+ * @brief Opens the capture fifo for non-blocking reads of CaptureData records.
+ *
+ * The module only writes to it while the capture is enabled with SYSTEM_CAPTURE.
+ *
+ * @return int The file descriptor, a negative value on failure.
+ */
+int open_capture_fifo(void);
+
+/**
+ * @brief Opens the trace fifo for non-blocking reads of TraceData records.
+ *
+ * The module only writes to it while the trace stream is enabled with SYSTEM_TRACE.
+ *
+ * @return int The file descriptor, a negative value on failure.
+ */
+int open_trace_fifo(void);
+
+/**
+ * @brief Opens the UART fifo for non-blocking reads of UartData records.
+ *
+ * The module writes the packets of all districts driven by a UART backend to it.
+ *
+ * @return int The file descriptor, a negative value on failure.
+ */
+int open_uart_fifo(void);
+
+/**
+ * @brief Requests the statistics of the module and waits for the answer.
+ *
+ * Records of other kinds which are still in the event fifo are discarded.
+ *
+ * @param values Receives the value of each statistic, indexed by statistic_id.
+ * @return int Returns 0 on success, a negative value if the module did not answer.
+ */
+int request_statistics(unsigned long long values[]);
+
+/**
+ * @brief Requests the statistics like request_statistics() and lets the worst values of the module start over.
+ *
+ * The next request reports the worst values since this one.
+ *
+ * @param values Receives the value of each statistic, indexed by statistic_id.
+ * @return int Returns 0 on success, a negative value if the module did not answer.
+ */
+int request_statistics_reset(unsigned long long values[]);
+
+/**
+ * @brief Sends a locomotive or accessory command and waits until it was transmitted on the rails.
+ *
+ * The command is acknowledged like send_with_ack() as soon as the module queued it. The call then
+ * waits for the EVENT_TRANSMITTED record the module publishes after the requested repetitions.
+ *
+ * @param data The locomotive or accessory data word.
+ * @param repetitions The number of repetitions to wait for (1 to TRANSMIT_REPEAT_MAX).
+ * @param first Receives the RT time the first bit started in nanoseconds.
+ * @param last Receives the RT time the last bit ended in nanoseconds.
+ * @param attempts The maximum number of transmission attempts.
+ * @return int Returns the number of repetitions sent, which is below the requested ones if a newer
+ *             command replaced the packet, or a negative value on failure.
+ */
+int send_transmit_with_ack(unsigned short data, int repetitions, unsigned long long *first, unsigned long long *last, int attempts);
+
+/**
+ * @brief Sends a route and waits until all its accessory packets were transmitted on the rails.
+ *
+ * The module locks the turnouts and track sections of the route first and rejects it if one
+ * of them is locked by another route.
+ *
+ * @param route The route, echoed by the module in its completion.
+ * @param steps The accessory data words in the order they are sent.
+ * @param count The number of data words (1 to ROUTE_MAX_STEPS).
+ * @param sections The interlocking elements of the track sections of the route.
+ * @param section_count The number of track sections (0 to ROUTE_MAX_SECTIONS).
+ * @param first Receives the RT time the first bit started in nanoseconds.
+ * @param last Receives the RT time the last bit ended in nanoseconds.
+ * @param attempts The maximum number of transmission attempts.
+ * @return int Returns the number of packets sent, -2 if the route was rejected, -1 on other failures.
+ */
+int send_route_with_ack(unsigned short route, const unsigned short *steps, int count, const unsigned short *sections, int section_count,
+                        unsigned long long *first, unsigned long long *last, int attempts);
+
+/**
+ * @brief Releases interlocking elements locked by a route.
+ *
+ * @param route The route.
+ * @param elements The elements to release.
+ * @param count The number of elements, 0 releases all elements of the route.
+ * @param attempts The maximum number of transmission attempts.
+ * @return int Returns 0 on success, -2 if the route holds no locks, -1 on other failures.
+ */
+int release_route(unsigned short route, const unsigned short *elements, int count, int attempts);
+
+/**
+ * @brief Returns the round trip estimation and retry counters of a command type.
+ *
+ * @param type The type bits of the command (01 = Locomotive, 10 = Magnetic, 11 = System).
+ * @param stats Receives the statistics.
+ */
+void get_ack_statistics(unsigned short type, AckStatistics *stats);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef PLAN_H
+#define PLAN_H
+
+#include <rtai.h>
+#include <rtai_sched.h>
+
+#define PERIOD_MAG_TASK 70000000      /* Period of the accessory task, one accessory packet each */
+#define PERIOD_LOC_TASK 60000000      /* Shortest refresh interval of a locomotive */
+#define PLAN_EMERGENCY_PERCENT 5      /* Share of each district kept free for emergency packets */
+#define PLAN_REFRESH_MAX 480000000    /* Longest refresh interval, locomotives which would need more are refused */
+#define PLAN_IDLE_RELEASE 50          /* Refreshes of an unchanged standing state until a slot is released to PLAN_REFRESH_MAX */
+
+/**
+ * @brief Computes the capacity of a district from the worst packet, must be called after init_track()
+ *        and init_protocol().
+ */
+void init_plan(void);
+
+/**
+ * @brief Admits a locomotive slot to the refresh of its district.
+ *
+ * A slot is planned until it is released, a released slot is planned again by its next command.
+ * The refresh intervals of all slots of the district are stretched to keep the locomotive packets
+ * within the share left by the accessory and emergency packets. Called with command_sem held only.
+ *
+ * @param slot The index of the slot.
+ * @return int Returns 0 if the slot is refreshed, -1 if its district would need a refresh interval
+ *             longer than PLAN_REFRESH_MAX.
+ */
+int plan_admit(int slot);
+
+/**
+ * @brief Releases a locomotive slot to the longest refresh interval.
+ *
+ * The task of a slot releases it after PLAN_IDLE_RELEASE refreshes of the same state at speed 0.
+ * The slot is still refreshed every PLAN_REFRESH_MAX, so a decoder which missed a packet or lost
+ * power gets its state back. The other slots of the district are refreshed more often again.
+ * Called with command_sem held only.
+ *
+ * @param slot The index of the slot.
+ */
+void plan_release(int slot);
+
+/**
+ * @brief Tells whether a locomotive slot is released to the longest refresh interval.
+ *
+ * @param slot The index of the slot.
+ * @return int 1 if the slot was released and not planned again since, 0 otherwise.
+ */
+int plan_released(int slot);
+
+/**
+ * @brief Plans the refresh intervals again after the consists changed.
+ *
+ * The first member of a consist refreshes all members, it takes the longest interval of their
+ * districts. Called with command_sem held only.
+ */
+void plan_update(void);
+
+/**
+ * @brief Returns the offset of the first refresh of a slot within the period.
+ *
+ * The slots are spread evenly over the period, so their packets are not handed to the
+ * districts at the same time.
+ *
+ * @param slot The index of the slot.
+ * @return RTIME The offset in nanoseconds.
+ */
+RTIME plan_phase(int slot);
+
+#endif
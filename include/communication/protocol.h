@@ -0,0 +1,77 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include "telegram/locomotive.h"
+#include "communication/waveform.h"
+
+#define MOTOROLA_SHORT_TIME 26000  /* 26 microseconds, the short part of a Motorola bit */
+#define MOTOROLA_LONG_TIME 182000  /* 182 microseconds, the long part of a Motorola bit */
+#define MOTOROLA_PAUSE 1500000     /* 1.5 ms low after each Motorola frame */
+#define MOTOROLA_SIGNAL MOTOROLA_LONG_TIME, MOTOROLA_SHORT_TIME, MOTOROLA_SHORT_TIME, MOTOROLA_LONG_TIME, MOTOROLA_PAUSE, 0
+
+/**
+ * @enum locomotive_protocol
+ * @brief The protocols of the locomotive decoders.
+ *
+ * - PROTOCOL_DCC_SHORT: DCC with a 7-bit address, the default of every slot.
+ * - PROTOCOL_DCC_LONG: DCC with a 14-bit address.
+ * - PROTOCOL_MOTOROLA: Märklin-Motorola (MM1), every frame is sent twice.
+ */
+enum locomotive_protocol
+{
+    PROTOCOL_DCC_SHORT = 0,
+    PROTOCOL_DCC_LONG = 1,
+    PROTOCOL_MOTOROLA = 2,
+};
+
+/**
+ * @struct LocomotiveConfig
+ * @brief Assigns a protocol and a decoder address to a locomotive slot.
+ *
+ * This structure contains the following fields:
+ * - address: The address of the slot the commands use, 1 - LOC_MSQ_SIZE.
+ * - protocol: The protocol of the decoder, see locomotive_protocol.
+ * - decoder: The address of the decoder in its protocol.
+ */
+typedef struct
+{
+    int address;  // Address of the slot the commands use.
+    int protocol; // Protocol of the decoder.
+    int decoder;  // Address of the decoder in its protocol.
+} LocomotiveConfig;
+
+/**
+ * @brief Reads the protocols of the slots, must be called after the timer is started.
+ */
+void init_protocol(void);
+
+/**
+ * @brief Encodes the packet of a locomotive in the protocol of its decoder.
+ *
+ * Addresses without a slot are sent as DCC short addresses. The protocol is chosen once per
+ * packet, each protocol has its own encoder with its timing compiled in.
+ *
+ * @param data The state of the locomotive, its address selects the slot.
+ * @param waveform Receives the encoded packet.
+ * @return int The number of times the packet has to be sent back to back.
+ */
+int encode_locomotive(LocomotiveData data, Waveform *waveform);
+
+/**
+ * @brief Returns the protocol of a locomotive.
+ *
+ * @param address The address of the locomotive.
+ * @return int The protocol, see locomotive_protocol.
+ */
+int locomotive_protocol(int address);
+
+/**
+ * @brief Returns the longest time the packets of a protocol take on a district.
+ *
+ * @param protocol The protocol, see locomotive_protocol.
+ * @param uart The district is driven by a UART backend.
+ * @return long The time of all repetitions in microseconds.
+ */
+long protocol_packet_time(int protocol, int uart);
+
+#endif
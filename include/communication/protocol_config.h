@@ -0,0 +1,16 @@
+#ifndef PROTOCOL_CONFIG_H
+#define PROTOCOL_CONFIG_H
+
+#include "communication/protocol.h"
+
+/*
+ * Locomotives whose decoders don't take a DCC short address equal to their slot address.
+ * The commands keep using the slot address, its packets go to the decoder address in the
+ * given protocol. Motorola decoders can't be driven by a UART district.
+ */
+LocomotiveConfig locomotive_config[] = {
+    // {.address = 1, .protocol = PROTOCOL_DCC_LONG, .decoder = 1234},
+    // {.address = 2, .protocol = PROTOCOL_MOTOROLA, .decoder = 24},
+};
+
+#endif
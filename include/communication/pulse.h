@@ -0,0 +1,37 @@
+#ifndef PULSE_H
+#define PULSE_H
+
+#include <rtai.h>
+#include <rtai_sched.h>
+#include <rtai_sem.h>
+
+#include "telegram/magnetic.h"
+
+#define PULSE_TIME 100000000 /* 100 milliseconds from the end of an activation to its deactivation packet */
+#define PULSE_QUEUE_SIZE 64  /* Solenoids which may wait for their deactivation at the same time */
+
+extern RT_TASK pulse_task;
+extern SEM pulse_sem;
+extern SEM pulse_queue_sem;
+
+/**
+ * @brief Schedules the deactivation packet of an accessory which was just activated.
+ *
+ * The deactivation is sent PULSE_TIME after the activation left the rails. A solenoid which is
+ * activated again before its deactivation keeps one pending deactivation, it is moved to the end
+ * of the new pulse.
+ *
+ * @param mag The activation which was sent.
+ * @param activated The end of the last bit of the activation in nanoseconds.
+ * @return int Returns 0 on success, -1 if the queue is full.
+ */
+int schedule_pulse_off(MagneticData mag, RTIME activated);
+
+/**
+ * @brief Sends the deactivation packets when their time has come.
+ *
+ * @param arg Unused.
+ */
+void send_pulse_task(long arg);
+
+#endif
@@ -7,33 +7,134 @@
 
 #include "telegram/locomotive.h"
 #include "telegram/magnetic.h"
+#include "telegram/system.h"
+#include "communication/waveform.h"
+#include "communication/deadline.h"
 
 #define BIT_1_TIME 58000  /* 58 microseconds*/
 #define BIT_0_TIME 100000 /* 100 microsecdons*/
+#define DCC_SIGNAL BIT_1_TIME, BIT_1_TIME, BIT_0_TIME, BIT_0_TIME, 0, 1 /* Timing for DEFINE_WAVEFORM_ENCODER() */
 #define LPT1 0x378        /*Pin of parallelport*/
 #define LOC_MSQ_SIZE 3
 #define MAG_MSQ_SIZE 4
 
-static SEM bit_sem;
-static SEM loc_sem[LOC_MSQ_SIZE];
-static SEM mag_sem[MAG_MSQ_SIZE];
+/**
+ * @struct LocomotiveSlot
+ * @brief Everything one locomotive task reads and writes.
+ *
+ * Each slot is aligned to its own cache lines, so the tasks of different slots never
+ * share one, even when they run on different CPUs.
+ */
+typedef struct
+{
+    LocomotiveData data;      // State sent to the locomotive.
+    SEM sem;                  // Guards data.
+    RT_TASK task;             // Task refreshing the locomotive.
+    Deadline deadline;        // Activations of the task.
+    unsigned short published; // Last data word published on the state-change stream.
+    int publish_pending;      // Publish the slot on its next transmission.
+    Waveform waveform;        // Waveform of the last packet.
 
-RT_TASK loco_tasks[LOC_MSQ_SIZE];
-RT_TASK *msg_periodic_task;
-RT_TASK *magnetic_task = NULL;
+    // Completion report requested with SYSTEM_TRANSMIT
+    int report_requested;       // Repetitions requested for data, guarded by sem.
+    int report_remaining;       // Repetitions left until the report is published.
+    unsigned int report_sent;   // Repetitions sent so far.
+    unsigned short report_data; // Data word being reported.
+    RTIME report_first;         // Start of the first bit in nanoseconds.
+    RTIME report_last;          // End of the last bit in nanoseconds.
 
-unsigned long long message = 0xFFFC066230C00000; // 0x5555555555555555;
-int length = 42;
-const int locomotive_count = 3;
-int magnetic_msg_count = 0;
-LocomotiveData locomotive_msg_queue[LOC_MSQ_SIZE] = {{.address = 00000011, .light = 1, .direction = 1, .speed = 15}};
-MagneticData magnetic_msg_queue[MAG_MSQ_SIZE] = {};
-static int loco_sent_count = 0; // Zählt gesendete Lokomotiv-Telegramme
+    // Speed ramp requested with SYSTEM_RAMP, guarded by sem
+    int ramp_active;            // The speed still moves towards the target.
+    LocomotiveData ramp_target; // Speed and direction to reach.
+    RTIME ramp_accel_time;      // Time per speed step accelerating in nanoseconds.
+    RTIME ramp_decel_time;      // Time per speed step decelerating in nanoseconds.
+    RTIME ramp_last_step;       // Time of the last speed step in nanoseconds.
 
-void send_bit_task(unsigned long long message, int length);
+    // Standing state refreshed without a change, only used by the task of the slot
+    unsigned short idle_data; // Data word of the last refresh.
+    int idle_refreshes;       // Refreshes of idle_data in a row while standing.
+
+    int consist; // Index + 1 of the consist refreshing the slot, 0 if its own task does, guarded by sem.
+    Waveform consist_waveforms[CONSIST_MAX_MEMBERS]; // Waveforms of the members while the task refreshes a consist.
+} ____cacheline_aligned LocomotiveSlot;
+
+/**
+ * @struct MagneticEntry
+ * @brief A pending accessory command in the accessory queue.
+ */
+typedef struct
+{
+    MagneticData data; // Command sent to the accessory.
+    int report;        // Repetitions after which EVENT_TRANSMITTED is published, 0 for none.
+} MagneticEntry;
+
+/**
+ * @enum magnetic_queue_result
+ * @brief Outcome of queue_magnetic_msg().
+ *
+ * - MAGNETIC_QUEUE_FULL: The queue holds no entry for the accessory and has no free entry.
+ * - MAGNETIC_QUEUED: The command was appended behind the pending commands.
+ * - MAGNETIC_MERGED: The command replaced the pending command of the same address and device.
+ */
+enum magnetic_queue_result
+{
+    MAGNETIC_QUEUE_FULL = -1,
+    MAGNETIC_QUEUED = 0,
+    MAGNETIC_MERGED = 1,
+};
+
+extern SEM magnetic_queue_sem;
+
+extern RT_TASK *msg_periodic_task;
+extern RT_TASK magnetic_task;
+extern Deadline magnetic_deadline;
+
+extern unsigned long long message;
+extern int length;
+extern const int locomotive_count;
+extern LocomotiveSlot locomotive_slots[LOC_MSQ_SIZE];
+
+/**
+ * @brief Marks every locomotive slot to be published on the state-change stream.
+ *
+ * The next transmission of each slot is then reported even if its data did not change,
+ * which gives a new subscriber a complete picture of the layout.
+ */
+void publish_all_locomotives(void);
+
+/**
+ * @brief Publishes a transmitted state on the state-change stream.
+ *
+ * @param data The data word which was transmitted.
+ */
+void publish_state_change(unsigned short data);
+
+/**
+ * @brief Queues an accessory command, coalescing it with a pending command for the same target.
+ *
+ * A pending command for the same address and device is updated in place and keeps its position,
+ * commands for distinct targets are sent in the order they arrived. A pending command waiting for
+ * its transmit report is never replaced, the new command is appended behind it.
+ *
+ * @param mag The command.
+ * @param report Repetitions after which EVENT_TRANSMITTED is published, 0 for none.
+ * @return int The outcome (see enum magnetic_queue_result).
+ */
+int queue_magnetic_msg(MagneticData mag, int report);
+
+/**
+ * @brief Writes the worst lateness and run time of the locomotive and accessory tasks and their
+ *        overruns into the statistics.
+ */
+void collect_deadline_statistics(void);
+
+/**
+ * @brief Lets the worst lateness and run time of the locomotive and accessory tasks start over.
+ */
+void reset_deadline_statistics(void);
 
 void send_magnetic_msg_task(long arg);
 
 void send_loco_msg_task(long i);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,40 @@
+#ifndef ROUTE_H
+#define ROUTE_H
+
+#include <rtai.h>
+#include <rtai_sched.h>
+#include <rtai_sem.h>
+
+#define ROUTE_SPACING 10000000      /* 10 milliseconds from the start of one route packet to the next */
+#define ROUTE_ACTIVE_MAX 2          /* Solenoids of a route which may fire at the same time */
+#define ROUTE_FIRING_TIME 120000000 /* 120 milliseconds a solenoid draws current, the activation and PULSE_TIME */
+#define ROUTE_QUEUE_SIZE 4          /* Routes waiting for the route task */
+
+extern RT_TASK route_task;
+extern SEM route_sem;
+
+/**
+ * @brief Requests a route to be set by the route task.
+ *
+ * The routes are set one after another in the order they were requested. The caller
+ * locks the elements of the route in the interlocking before.
+ *
+ * @param route The route, echoed in EVENT_ROUTE.
+ * @param steps The accessory data words in the order they are sent.
+ * @param count The number of data words (1 to ROUTE_MAX_STEPS).
+ * @return int Returns 0 on success, -1 if the request is invalid or ROUTE_QUEUE_SIZE routes are waiting.
+ */
+int request_route(unsigned short route, const unsigned short *steps, int count);
+
+/**
+ * @brief Sends the accessory packets of requested routes as a paced burst.
+ *
+ * The packets start ROUTE_SPACING apart. An activation waits until fewer than ROUTE_ACTIVE_MAX
+ * activations, also of the routes before, were sent within the last ROUTE_FIRING_TIME, which bounds the current
+ * drawn by the solenoids. Each activation is switched off by the pulse task.
+ *
+ * @param arg Unused.
+ */
+void send_route_task(long arg);
+
+#endif
@@ -3,8 +3,111 @@
 
 #define FIFO_CMD 3
 #define FIFO_ACK 4
+#define FIFO_EVENT 5
+#define FIFO_CAPTURE 6
+#define FIFO_TRACE 7
+#define FIFO_UART 8
+
+#include <rtai_sem.h>
+
+#include "telegram/event.h"
+#include "communication/waveform.h"
+
+extern int event_subscribed;
+extern unsigned long long statistics[STATISTIC_COUNT];
+
+extern SEM command_sem;
+extern volatile int capture_enabled;
 
 int fifo_handler(unsigned int fifo);
+
+/**
+ * @brief Executes a locomotive, accessory or system command.
+ *
+ * Used by the fifo handler and for the commands of the timer wheel. Commands are executed one
+ * at a time under command_sem, which the fifo handler holds in Linux context. A caller may have to
+ * wait for it, so the time the command was actually executed is returned. The caller sends no
+ * acknowledgement.
+ *
+ * @param command The header word of the command followed by its payload.
+ * @param count The number of words, the payload length of a system command must fit.
+ * @param executed Receives the RT time the command was executed in nanoseconds, may be NULL.
+ * @return int 0 if the command was served, -1 if it is invalid or can't be served now,
+ *             -2 if it is rejected.
+ */
+int execute_command(const unsigned short *command, int count, RTIME *executed);
 void send_ack(unsigned short raw);
 
-#endif
\ No newline at end of file
+/**
+ * @brief Rejects a command which can't be served, so the sender does not retry it.
+ *
+ * The rejection echoes the command with the acknowledge bit cleared.
+ *
+ * @param raw The header word of the rejected command.
+ */
+void send_nack(unsigned short raw);
+
+/**
+ * @brief Publishes a record on the event fifo.
+ *
+ * The record is dropped if the fifo is full, the event stream never blocks the caller.
+ *
+ * @param kind The kind of the event (see enum event_kind).
+ * @param data The raw data word the event refers to.
+ * @param count Kind specific counter.
+ */
+void publish_event(unsigned short kind, unsigned short data, unsigned int count);
+
+/**
+ * @brief Publishes the completion of a requested transmission on the event fifo.
+ *
+ * Completions are requested by the caller, so they are published without a subscription.
+ *
+ * @param kind The kind of the event (EVENT_TRANSMITTED or EVENT_ROUTE).
+ * @param data The data word or route which was transmitted.
+ * @param count The number of packets sent.
+ * @param first The start of the first bit in nanoseconds.
+ * @param last The end of the last bit in nanoseconds.
+ */
+void publish_completion(unsigned short kind, unsigned short data, unsigned int count, unsigned long long first, unsigned long long last);
+
+/**
+ * @brief Publishes all statistics as EVENT_STATISTIC records on the event fifo.
+ */
+void publish_statistics(void);
+
+/**
+ * @brief Lets the worst values of the statistics start over, the counters keep counting.
+ *
+ * The tasks update their worst values without a lock, a value they are writing at the same
+ * time may survive the reset.
+ */
+void reset_statistics(void);
+
+/**
+ * @brief Publishes a packet which left the rails on the capture fifo.
+ *
+ * Called by the track tasks for DCC packets while the capture is enabled. A record which does not fit into the
+ * fifo is dropped and counted in STATISTIC_CAPTURE_DROPPED.
+ *
+ * @param district The district the packet was sent in.
+ * @param waveform The waveform of the packet.
+ * @param start The start of the first bit in nanoseconds.
+ * @param end The end of the last bit in nanoseconds.
+ */
+void capture_packet(int district, const Waveform *waveform, RTIME start, RTIME end);
+
+/**
+ * @brief Publishes a packet of a district driven by a UART backend on the UART fifo.
+ *
+ * Called by the track tasks when the packet starts. A record which does not fit into the fifo
+ * is dropped and counted in STATISTIC_UART_DROPPED, the line time of the packet is kept. So is
+ * a packet which is no DCC packet, it keeps its time on the rails.
+ *
+ * @param district The district the packet is sent in.
+ * @param waveform The waveform of the packet.
+ * @return int The number of bytes the packet takes on the serial line, -1 if it can't be encoded.
+ */
+int uart_packet(int district, const Waveform *waveform);
+
+#endif
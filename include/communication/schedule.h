@@ -0,0 +1,49 @@
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <rtai.h>
+#include <rtai_sched.h>
+#include <rtai_sem.h>
+
+#include "telegram/system.h"
+
+#define SCHEDULE_SIZE 64       /* Commands which may wait for their execution at the same time */
+#define SCHEDULE_SLOTS 256     /* Slots of the timer wheel, a power of two */
+#define SCHEDULE_TICK_SHIFT 20 /* A slot of the timer wheel covers 2^20 ns, about one millisecond */
+
+extern RT_TASK schedule_task;
+extern SEM schedule_sem;
+extern SEM schedule_queue_sem;
+
+/**
+ * @brief Prepares the timer wheel, must be called before the first command is scheduled.
+ */
+void init_schedule(void);
+
+/**
+ * @brief Holds a command in the timer wheel until its time has come.
+ *
+ * A command whose time already passed is executed as soon as possible.
+ *
+ * @param due The RT time the command is executed in nanoseconds.
+ * @param command The header word of the command followed by its payload.
+ * @param count The number of words (1 to SCHEDULE_MAX_COMMAND).
+ * @return int Returns 0 on success, -1 if the timer wheel is full.
+ */
+int request_schedule(RTIME due, const unsigned short *command, int count);
+
+/**
+ * @brief Drops all commands which wait in the timer wheel.
+ *
+ * @return int The number of dropped commands.
+ */
+int cancel_schedule(void);
+
+/**
+ * @brief Executes the commands of the timer wheel when their time has come and publishes EVENT_SCHEDULED.
+ *
+ * @param arg Unused.
+ */
+void send_schedule_task(long arg);
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef SESSION_LOG_H
+#define SESSION_LOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define SESSION_LOG_MAGIC 0x4C434344 /* "DCCL" */
+#define SESSION_LOG_VERSION 1
+#define SESSION_LOG_MAX_WORDS 256 /* Most words of a recorded command, a system header and its full payload */
+
+/**
+ * @struct SessionLogHeader
+ * @brief The header of a session log.
+ *
+ * The header is followed by records, each a SessionLogRecord followed by its command words.
+ *
+ * This structure contains the following fields:
+ * - magic: SESSION_LOG_MAGIC.
+ * - version: SESSION_LOG_VERSION.
+ * - reserved: Always 0.
+ */
+typedef struct
+{
+    uint32_t magic;    // SESSION_LOG_MAGIC.
+    uint16_t version;  // SESSION_LOG_VERSION.
+    uint16_t reserved; // Always 0.
+} SessionLogHeader;
+
+/**
+ * @struct SessionLogRecord
+ * @brief A command of a session log.
+ *
+ * This structure contains the following fields:
+ * - time: Monotonic time the command was issued, in nanoseconds since the recording started.
+ * - count: Number of command words following the record.
+ * - reserved, padding: Always 0, keep the record aligned.
+ */
+typedef struct
+{
+    uint64_t time;     // Time the command was issued in nanoseconds since the recording started.
+    uint16_t count;    // Number of command words following the record.
+    uint16_t reserved; // Always 0.
+    uint32_t padding;  // Always 0.
+} SessionLogRecord;
+
+/**
+ * @brief Starts recording every command sent to the module into a session log.
+ *
+ * A running recording is stopped first.
+ *
+ * @param path The file of the session log, an existing file is replaced.
+ * @return int Returns 0 on success, -1 on failure.
+ */
+int session_log_start(const char *path);
+
+/**
+ * @brief Stops the recording.
+ *
+ * @return int The number of recorded commands, -1 if no recording was running.
+ */
+int session_log_stop(void);
+
+/**
+ * @brief Records a command if a recording is running.
+ *
+ * Retransmissions are not recorded, the caller records each command once.
+ *
+ * @param command The header word of the command followed by its payload.
+ * @param count The number of words.
+ */
+void session_log_write(const unsigned short *command, int count);
+
+/**
+ * @brief Opens a session log for reading and checks its header.
+ *
+ * @param path The file of the session log.
+ * @return FILE* The opened log positioned at the first record, NULL on failure.
+ */
+FILE *session_log_open(const char *path);
+
+/**
+ * @brief Reads the next record of a session log.
+ *
+ * @param log The log opened with session_log_open().
+ * @param record Receives the record.
+ * @param command Receives up to SESSION_LOG_MAX_WORDS command words.
+ * @return int Returns 1 if a record was read, 0 at the end of the log, -1 if the log is damaged.
+ */
+int session_log_read(FILE *log, SessionLogRecord *record, unsigned short *command);
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef COMMUNICATION_TRACE_H
+#define COMMUNICATION_TRACE_H
+
+#include <rtai.h>
+#include <rtai_sched.h>
+
+#include "telegram/trace.h"
+
+#define TRACE_RING_SIZE 2048 /* Records kept per CPU, a power of two */
+
+extern RT_TASK trace_task;
+extern volatile int trace_streaming;
+
+/**
+ * @brief Records an event in the ring of the current CPU.
+ *
+ * Never waits and takes no lock, so it may be called from every task and from the fifo handler.
+ * The oldest records of a ring are overwritten when it is full.
+ *
+ * @param time The RT time of the event in nanoseconds.
+ * @param kind The kind of the event (see enum trace_kind).
+ * @param data The kind specific data word.
+ * @param arg The kind specific argument.
+ */
+void trace_event_at(RTIME time, unsigned char kind, unsigned short data, unsigned int arg);
+
+/**
+ * @brief Records an event which happens now in the ring of the current CPU.
+ *
+ * @param kind The kind of the event (see enum trace_kind).
+ * @param data The kind specific data word.
+ * @param arg The kind specific argument.
+ */
+void trace_event(unsigned char kind, unsigned short data, unsigned int arg);
+
+/**
+ * @brief Returns the address and instruction bytes of a telegram as the data word of a packet record.
+ *
+ * @param message The telegram, most significant bit first, starting with its preamble.
+ * @return unsigned short The address byte in the high and the instruction byte in the low byte,
+ *                        0 for a telegram without a start bit.
+ */
+static inline unsigned short trace_packet_data(unsigned long long message)
+{
+    if (~message == 0)
+    {
+        return 0;
+    }
+    // The preamble ends with the start bit of the address byte, the instruction byte follows its own start bit
+    int start = __builtin_clzll(~message);
+    if (start > 63 - 17)
+    {
+        return 0;
+    }
+    return (unsigned short)((((message >> (63 - start - 8)) & 0xFF) << 8) | ((message >> (63 - start - 17)) & 0xFF));
+}
+
+/**
+ * @brief Moves the records of the rings to the trace fifo while the stream is enabled.
+ *
+ * @param arg Unused.
+ */
+void send_trace_task(long arg);
+
+#endif
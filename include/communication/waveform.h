@@ -0,0 +1,108 @@
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+
+#include <rtai.h>
+#include <rtai_sched.h>
+
+#define WAVEFORM_MAX_HALF_BITS 128 /* Two half bits per bit of a 64-bit telegram */
+
+/**
+ * @struct Waveform
+ * @brief A telegram encoded into the durations of its half bits.
+ *
+ * The rails are driven high for the first half bit and the level toggles with every
+ * following half bit, so sending a waveform needs no decisions per bit anymore.
+ *
+ * This structure contains the following fields:
+ * - count: Number of half bits of the waveform.
+ * - half_bits: Duration of each half bit in counts.
+ * - duration: Duration of the whole waveform in nanoseconds.
+ * - message, length: The encoded telegram, kept for the capture stream.
+ * - dcc: The telegram is a DCC packet, only these are captured and sent by a UART backend.
+ */
+typedef struct
+{
+    int count;                               // Number of half bits of the waveform.
+    RTIME half_bits[WAVEFORM_MAX_HALF_BITS]; // Duration of each half bit in counts, starting with the high level.
+    RTIME duration;                          // Duration of the whole waveform in nanoseconds.
+    unsigned long long message;              // The encoded telegram, most significant bit first.
+    int length;                              // Number of bits of the telegram.
+    int dcc;                                 // The telegram is a DCC packet.
+} Waveform;
+
+/*
+ * A signal is the timing of a protocol, a list of six values: the high and the low half of a
+ * 1-bit, the high and the low half of a 0-bit, the pause after the telegram in nanoseconds and
+ * whether the telegram is a DCC packet. The pause extends the last half bit, a signal has to end
+ * every bit low to keep the rails low during it.
+ */
+
+/**
+ * @brief Defines an encoder specialized for one signal.
+ *
+ * The encoder name(message, length, waveform) has the timing of the signal compiled in, so it
+ * decides nothing but the value of each bit. name##_init() converts the timing into counts, it
+ * must be called after the timer is started.
+ *
+ * @param name The name of the encoder.
+ * @param signal The signal, see above.
+ */
+#define DEFINE_WAVEFORM_ENCODER(name, signal) WAVEFORM_ENCODER(name, signal)
+
+#define WAVEFORM_ENCODER(name, one_high, one_low, zero_high, zero_low, pause, dcc_packet)  \
+    static RTIME name##_counts[5]; /* The timing of the signal in counts */                \
+                                                                                           \
+    void name##_init(void)                                                                 \
+    {                                                                                      \
+        name##_counts[0] = nano2count(one_high);                                           \
+        name##_counts[1] = nano2count(one_low);                                            \
+        name##_counts[2] = nano2count(zero_high);                                          \
+        name##_counts[3] = nano2count(zero_low);                                           \
+        name##_counts[4] = nano2count(pause);                                              \
+    }                                                                                      \
+                                                                                           \
+    void name(unsigned long long message, int length, Waveform *waveform)                  \
+    {                                                                                      \
+        int i;                                                                             \
+        waveform->count = 0;                                                               \
+        waveform->duration = 0;                                                            \
+        waveform->message = message;                                                       \
+        waveform->length = length;                                                         \
+        waveform->dcc = dcc_packet;                                                        \
+        for (i = 0; i < length && waveform->count + 2 <= WAVEFORM_MAX_HALF_BITS; i++)      \
+        {                                                                                  \
+            if (((message >> (63 - i)) & 0x01) == 1) /* 1-Bit */                           \
+            {                                                                              \
+                waveform->half_bits[waveform->count++] = name##_counts[0];                 \
+                waveform->half_bits[waveform->count++] = name##_counts[1];                 \
+                waveform->duration += (one_high) + (one_low);                              \
+            }                                                                              \
+            else /* 0-Bit */                                                               \
+            {                                                                              \
+                waveform->half_bits[waveform->count++] = name##_counts[2];                 \
+                waveform->half_bits[waveform->count++] = name##_counts[3];                 \
+                waveform->duration += (zero_high) + (zero_low);                            \
+            }                                                                              \
+        }                                                                                  \
+        if ((pause) > 0 && waveform->count > 0)                                            \
+        {                                                                                  \
+            waveform->half_bits[waveform->count - 1] += name##_counts[4];                  \
+            waveform->duration += (pause);                                                 \
+        }                                                                                  \
+    }
+
+/**
+ * @brief Converts the bit times into counts, must be called after the timer is started.
+ */
+void init_waveform(void);
+
+/**
+ * @brief Encodes a DCC telegram into a waveform.
+ *
+ * @param message The telegram, most significant bit first.
+ * @param length The number of bits of the telegram.
+ * @param waveform Receives the encoded waveform.
+ */
+void encode_waveform(unsigned long long message, int length, Waveform *waveform);
+
+#endif
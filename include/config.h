@@ -3,6 +3,7 @@
 
 #include "telegram/locomotive.h"
 #include "telegram/magnetic.h"
+#include "telegram/route.h"
 
 Locomotive locomotives_user[] = {
     {.alias = "loc3", .data = {
@@ -11,6 +12,12 @@ Locomotive locomotives_user[] = {
                           .light = 1,
                           .speed = 0,
                       }},
+    {.alias = "double", .data = {
+                            .address = 10,
+                            .direction = 1,
+                            .light = 1,
+                            .speed = 0,
+                        }},
 };
 
 Magnetic magnetic_user[] = {
@@ -48,4 +55,15 @@ Magnetic magnetic_user[] = {
                          }},
 };
 
+Route routes_user[] = {
+    {.alias = "yard", .count = 4, .steps = {
+                                      {.address = 0, .device = 0, .control = 1, .enable = 1},
+                                      {.address = 0, .device = 1, .control = 1, .enable = 1},
+                                      {.address = 0, .device = 2, .control = 0, .enable = 1},
+                                      {.address = 0, .device = 3, .control = 0, .enable = 1},
+                                  },
+     .section_count = 2,
+     .sections = {0, 1}},
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,58 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+
+#define SNAPSHOT_FILE "layout.snapshot" /* Snapshot of the decoder states, relative to the working directory */
+#define SNAPSHOT_MAGIC 0x53434344       /* "DCCS" */
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_LOCOMOTIVES 128     /* Locomotive addresses, one state per address */
+#define SNAPSHOT_MAGNETICS (512 * 4) /* Accessory outputs, one state per address * 4 + device */
+
+/**
+ * @struct SnapshotHeader
+ * @brief The header of the snapshot file.
+ *
+ * The header is followed by SNAPSHOT_LOCOMOTIVES locomotive data words indexed by address and
+ * SNAPSHOT_MAGNETICS accessory data words indexed by address * 4 + device. A word of 0 is an
+ * unknown state. Every word has a fixed place, so a new state rewrites only its own word.
+ *
+ * This structure contains the following fields:
+ * - magic: SNAPSHOT_MAGIC.
+ * - version: SNAPSHOT_VERSION.
+ * - reserved: Always 0.
+ */
+typedef struct
+{
+    uint32_t magic;    // SNAPSHOT_MAGIC.
+    uint16_t version;  // SNAPSHOT_VERSION.
+    uint16_t reserved; // Always 0.
+} SnapshotHeader;
+
+/**
+ * @brief Records the state of a decoder in the snapshot.
+ *
+ * The snapshot is opened on the first call and created if it does not exist or has another
+ * version. Accessory deactivations are not recorded, the activation holds the position.
+ *
+ * @param data The locomotive or accessory data word which was sent.
+ */
+void snapshot_record(unsigned short data);
+
+/**
+ * @brief Reads all states of the snapshot.
+ *
+ * @param locomotives Receives SNAPSHOT_LOCOMOTIVES locomotive data words, 0 for an unknown state.
+ * @param magnetics Receives SNAPSHOT_MAGNETICS accessory data words, 0 for an unknown state.
+ * @return int Returns 0 on success, -1 if there is no valid snapshot.
+ */
+int snapshot_read(unsigned short *locomotives, unsigned short *magnetics);
+
+/**
+ * @brief Forgets all states of the snapshot.
+ *
+ * @return int Returns 0 on success, -1 on failure.
+ */
+int snapshot_clear(void);
+
+#endif
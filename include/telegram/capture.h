@@ -0,0 +1,42 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+/**
+ * @struct CaptureData
+ * @brief Represents a record of the capture stream published by the rtai module.
+ *
+ * While the capture is enabled with SYSTEM_CAPTURE, the module publishes every locomotive and accessory
+ * command it executes and every packet that left the rails, except idle packets.
+ *
+ * This structure contains the following fields:
+ * - kind: Kind of the record (see enum capture_kind).
+ * - data: CAPTURE_COMMAND: the data word of the command. CAPTURE_PACKET: the district of the packet.
+ * - length: CAPTURE_PACKET: the number of bits of the packet.
+ * - message: CAPTURE_PACKET: the bits of the packet, most significant bit first.
+ * - start: RT time the command was executed or the first bit of the packet started in nanoseconds.
+ * - end: RT time the last bit of the packet ended in nanoseconds, equal to start for commands.
+ */
+typedef struct
+{
+    unsigned short kind;        // Kind of the record. Values: see enum capture_kind.
+    unsigned short data;        // Data word of the command or district of the packet.
+    unsigned int length;        // Number of bits of the packet.
+    unsigned long long message; // Bits of the packet, most significant bit first.
+    unsigned long long start;   // RT time the command was executed or the packet started in nanoseconds.
+    unsigned long long end;     // RT time the packet ended in nanoseconds.
+} CaptureData;
+
+/**
+ * @enum capture_kind
+ * @brief Kinds of records of the capture stream.
+ *
+ * - CAPTURE_COMMAND: A locomotive or accessory command was executed by the module.
+ * - CAPTURE_PACKET: A packet was sent on the rails, each repetition is a record of its own.
+ */
+enum capture_kind
+{
+    CAPTURE_COMMAND = 1,
+    CAPTURE_PACKET = 2,
+};
+
+#endif
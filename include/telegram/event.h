@@ -0,0 +1,125 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+/**
+ * @struct EventData
+ * @brief Represents a record published by the rtai module on the event fifo.
+ *
+ * This structure contains the following fields:
+ * - kind: Kind of the event (see enum event_kind).
+ * - data: The raw data word the event refers to (LocomotiveData, MagneticData, ...).
+ * - count: Kind specific counter.
+ * - time: RT timestamp of the event in nanoseconds.
+ * - value: Kind specific value.
+ */
+typedef struct
+{
+    unsigned short kind;      // Kind of the event. Values: see enum event_kind.
+    unsigned short data;      // Raw data word the event refers to.
+    unsigned int count;       // Kind specific counter.
+    unsigned long long time;  // RT timestamp of the event in nanoseconds.
+    unsigned long long value; // Kind specific value.
+} EventData;
+
+/**
+ * @enum event_kind
+ * @brief Kinds of records published on the event fifo.
+ *
+ * - EVENT_STATE: The decoder addressed by `data` was transmitted with a new state.
+ *                `count` holds the number of state changes published so far.
+ * - EVENT_STATISTIC: Answer to SYSTEM_STATISTICS. `data` holds the statistic_id, `value` its value
+ *                    and `count` the number of records belonging to the answer.
+ * - EVENT_TRANSMITTED: Answer to SYSTEM_TRANSMIT once the packet of `data` is on the rails. `count` holds
+ *                      the number of repetitions sent, `time` the start of the first bit and `value` the
+ *                      end of the last bit, both in RT nanoseconds. `count` is below the requested
+ *                      repetitions if a newer command for the same decoder replaced the packet.
+ * - EVENT_ROUTE: Answer to SYSTEM_ROUTE once every accessory packet of the route is on the rails.
+ *                `data` holds the route, `count` the number of packets sent, `time` the start of the
+ *                first bit and `value` the end of the last bit, both in RT nanoseconds.
+ * - EVENT_SCHEDULED: A command held by SYSTEM_SCHEDULE was executed. `data` holds its header word, `count`
+ *                    is 1 if it was served and 0 if it was invalid or rejected, `time` holds the RT time it
+ *                    was executed, after waiting for a command of the fifo, and `value` the RT time it was
+ *                    scheduled for, both in nanoseconds.
+ */
+enum event_kind
+{
+    EVENT_STATE = 1,
+    EVENT_STATISTIC = 2,
+    EVENT_TRANSMITTED = 3,
+    EVENT_ROUTE = 4,
+    EVENT_SCHEDULED = 5,
+};
+
+/**
+ * @enum statistic_id
+ * @brief Counters and measurements kept by the module, reported with EVENT_STATISTIC.
+ *
+ * Times are given in nanoseconds.
+ * - STATISTIC_EMERGENCY_COUNT: Number of emergency requests served by the fast path.
+ * - STATISTIC_EMERGENCY_LATENCY_LAST: Time from the last request until its first bit was on the rails
+ *                                     of every affected district.
+ * - STATISTIC_EMERGENCY_LATENCY_MAX: Worst time from a request until its first bit was on the rails
+ *                                    of every affected district.
+ * - STATISTIC_TRACK_BUSY_TIME: Time the rails carried locomotive, accessory and emergency packets.
+ * - STATISTIC_TRACK_IDLE_TIME: Time the rails carried idle packets filling the gaps.
+ * - STATISTIC_TRACK_PACKETS: Number of locomotive, accessory and emergency packets sent.
+ * - STATISTIC_IDLE_PACKETS: Number of idle packets sent.
+ * - STATISTIC_MAGNETIC_MERGED: Number of accessory commands which replaced a pending command for
+ *                              the same address and device.
+ * - STATISTIC_INTERLOCK_CONFLICTS: Number of routes and accessory commands rejected because an element
+ *                                  was locked by another route.
+ * - STATISTIC_SCHEDULED_COMMANDS: Number of commands executed from the timer wheel.
+ * - STATISTIC_SCHEDULE_LATENESS_MAX: Worst time a command of the timer wheel was executed after its time,
+ *                                    including the wait for a command of the fifo executed meanwhile.
+ * - STATISTIC_QUEUE_FULL: Number of commands left unacknowledged because the accessory queue or the
+ *                         timer wheel or the emergency queue was full.
+ * - STATISTIC_CAPTURE_DROPPED: Number of capture records lost because the capture fifo was full.
+ * - STATISTIC_DEADLINE_OVERRUNS: Number of activations of the locomotive and accessory tasks which ended
+ *                                after the release of their next activation.
+ * - STATISTIC_ACTIVATIONS_SKIPPED: Number of activations the tasks skipped with a stretched period.
+ * - STATISTIC_LOCO_LATENESS_MAX: Worst start of a locomotive task after its release in nanoseconds.
+ * - STATISTIC_LOCO_RUNTIME_MAX: Worst run time of an activation of a locomotive task in nanoseconds.
+ * - STATISTIC_MAGNETIC_LATENESS_MAX: Worst start of the accessory task after its release in nanoseconds.
+ * - STATISTIC_MAGNETIC_RUNTIME_MAX: Worst run time of an activation of the accessory task in nanoseconds.
+ * - STATISTIC_EDGE_LATENESS_MAX: Worst time a track task switched the port after the edge was due in nanoseconds.
+ * - STATISTIC_EDGES_LATE: Number of edges switched later than BITSLICE_EDGE_SLACK.
+ * - STATISTIC_PLAN_REFRESH_MAX: Longest refresh interval of a locomotive in the bandwidth plan in nanoseconds.
+ * - STATISTIC_PLAN_LOAD_MAX: Planned load of the busiest district in percent, including the share kept for
+ *                            accessory and emergency packets.
+ * - STATISTIC_PLAN_REFUSED: Number of locomotive commands refused because the district of the locomotive was full.
+ * - STATISTIC_TRACE_LOST: Number of trace records overwritten before the trace stream moved them to its fifo.
+ * - STATISTIC_UART_DROPPED: Number of packets of UART districts dropped because the UART fifo was full or
+ *                           they were no DCC packets.
+ */
+enum statistic_id
+{
+    STATISTIC_EMERGENCY_COUNT = 1,
+    STATISTIC_EMERGENCY_LATENCY_LAST,
+    STATISTIC_EMERGENCY_LATENCY_MAX,
+    STATISTIC_TRACK_BUSY_TIME,
+    STATISTIC_TRACK_IDLE_TIME,
+    STATISTIC_TRACK_PACKETS,
+    STATISTIC_IDLE_PACKETS,
+    STATISTIC_MAGNETIC_MERGED,
+    STATISTIC_INTERLOCK_CONFLICTS,
+    STATISTIC_SCHEDULED_COMMANDS,
+    STATISTIC_SCHEDULE_LATENESS_MAX,
+    STATISTIC_QUEUE_FULL,
+    STATISTIC_CAPTURE_DROPPED,
+    STATISTIC_DEADLINE_OVERRUNS,
+    STATISTIC_ACTIVATIONS_SKIPPED,
+    STATISTIC_LOCO_LATENESS_MAX,
+    STATISTIC_LOCO_RUNTIME_MAX,
+    STATISTIC_MAGNETIC_LATENESS_MAX,
+    STATISTIC_MAGNETIC_RUNTIME_MAX,
+    STATISTIC_EDGE_LATENESS_MAX,
+    STATISTIC_EDGES_LATE,
+    STATISTIC_PLAN_REFRESH_MAX,
+    STATISTIC_PLAN_LOAD_MAX,
+    STATISTIC_PLAN_REFUSED,
+    STATISTIC_TRACE_LOST,
+    STATISTIC_UART_DROPPED,
+    STATISTIC_COUNT,
+};
+
+#endif
@@ -46,4 +46,10 @@ typedef struct
  */
 IdleTelegram buildIdleTelegram();
 
+typedef union IdleConverter
+{
+    IdleTelegram it;
+    unsigned long long ull;
+} IdleConverter;
+
 #endif
\ No newline at end of file
@@ -74,6 +74,48 @@ typedef struct
     unsigned long long preamble : 14;         // [bit 50 - 63]    Preamble for synchronization. Fixed 14-bit value: 0b11111111111111 (0x3FFF).
 } LocomotiveTelegram;
 
+#define LONG_LOCOMOTIVE_LENGTH 51  /* Bits of a telegram to a long address */
+#define LONG_ADDRESS_MAX 10239      /* Highest long address, 11AAAAAA allows 0x27FF */
+
+/**
+ * @struct LongLocomotiveTelegram
+ * @brief Represents a locomotive telegram to a long (14-bit) address.
+ *
+ * The address takes two bytes, the first one starting with 0b11. The command byte is the
+ * same as the one of a LocomotiveTelegram.
+ * It contains the following fields:
+ * - reserved (13 bits): Reserved for future use. [bits 0 - 12]
+ * - stop_bit (1 bit): Stop bit of the telegram. Fixed value: 1. [bit 13]
+ * - checksum (8 bits): XOR of both address bytes and the command byte. [bits 14 - 21]
+ * - start_bit_cs (1 bit): Start bit for the checksum field. Fixed value: 0. [bit 22]
+ * - speed, light, direction, cmd_bits_7_6: The command byte. [bits 23 - 30]
+ * - start_bit_cmd (1 bit): Start bit for the command field. Fixed value: 0. [bit 31]
+ * - address_low (8 bits): The low byte of the address. [bits 32 - 39]
+ * - start_bit_low (1 bit): Start bit for the low address byte. Fixed value: 0. [bit 40]
+ * - address_high (6 bits): The high bits of the address. [bits 41 - 46]
+ * - long_bits (2 bits): Marks the long address. Fixed value: 0b11. [bits 47 - 48]
+ * - start_bit_address (1 bit): Start bit for the address field. Fixed value: 0. [bit 49]
+ * - preamble (14 bits): Preamble for synchronization. Fixed value: 0x3FFF. [bits 50 - 63]
+ */
+typedef struct
+{
+    unsigned long long reserved : 13;         // [bit 0 - 12]     Reserved for future use.
+    unsigned long long stop_bit : 1;          // [bit 13]         Stop bit of the telegram. Fixed value: 1.
+    unsigned long long checksum : 8;          // [bit 14 - 21]    An 8-bit field for the checksum value.
+    unsigned long long start_bit_cs : 1;      // [bit 22]         Start bit for the checksum field. Fixed value: 0.
+    unsigned long long speed : 4;             // [bit 23 - 26]    Speed of the locomotive. Values: 0 - 15 (0xF).
+    unsigned long long light : 1;             // [bit 27]         Indicates if the light is on. Values: 0, 1.
+    unsigned long long direction : 1;         // [bit 28]         Direction of the locomotive. Values: 0, 1.
+    unsigned long long cmd_bits_7_6 : 2;      // [bit 29 - 30]    Command bits 7 and 6. Fixed value: 0b01.
+    unsigned long long start_bit_cmd : 1;     // [bit 31]         Start bit for the command field. Fixed value: 0.
+    unsigned long long address_low : 8;       // [bit 32 - 39]    Low byte of the address.
+    unsigned long long start_bit_low : 1;     // [bit 40]         Start bit for the low address byte. Fixed value: 0.
+    unsigned long long address_high : 6;      // [bit 41 - 46]    High bits of the address. Values: 0 - 39.
+    unsigned long long long_bits : 2;         // [bit 47 - 48]    Marks the long address. Fixed value: 0b11.
+    unsigned long long start_bit_address : 1; // [bit 49]         Start bit for the address field. Fixed value: 0.
+    unsigned long long preamble : 14;         // [bit 50 - 63]    Preamble for synchronization. Fixed 14-bit value: 0b11111111111111 (0x3FFF).
+} LongLocomotiveTelegram;
+
 /**
  * @brief Constructs a LocomotiveTelegram from the given LocomotiveData.
  *
@@ -85,12 +127,27 @@ typedef struct
  */
 unsigned long long buildLocomotiveTelegram(LocomotiveData data);
 
+/**
+ * @brief Constructs a LongLocomotiveTelegram for a decoder with a long address.
+ *
+ * @param address The long address of the decoder, 1 - LONG_ADDRESS_MAX.
+ * @param data The LocomotiveData with speed, light and direction, its address is ignored.
+ * @return The telegram, LONG_LOCOMOTIVE_LENGTH bits most significant bit first.
+ */
+unsigned long long buildLongLocomotiveTelegram(int address, LocomotiveData data);
+
 typedef union LocomotiveConverter
 {
     LocomotiveTelegram lt;
     unsigned long long ull;
 } LocomotiveConverter;
 
+typedef union LongLocomotiveConverter
+{
+    LongLocomotiveTelegram lt;
+    unsigned long long ull;
+} LongLocomotiveConverter;
+
 typedef union LocomotiveDataConverter
 {
     LocomotiveData ld;
@@ -0,0 +1,47 @@
+#ifndef MOTOROLA_H
+#define MOTOROLA_H
+
+#define MOTOROLA_LENGTH 18       /* Bits of a Motorola frame */
+#define MOTOROLA_ADDRESS_MAX 80  /* Highest locomotive address, 80 is sent as trits 0000 */
+
+/**
+ * @struct MotorolaTelegram
+ * @brief Represents a Märklin-Motorola (MM1) locomotive frame.
+ *
+ * A frame has no preamble and no checksum, it is sent twice and the decoder only acts when
+ * both frames match. The address consists of four trits, a trit is sent as two bits:
+ * 0 as 00, 1 as 11 and 2 as 10. The speed bits are each sent twice as well.
+ *
+ * It contains the following fields:
+ * - reserved (46 bits): Reserved for future use. [bits 0 - 45]
+ * - speed (8 bits): The four speed bits, least significant first, each doubled. [bits 46 - 53]
+ * - function (2 bits): The function (light), 0b11 on, 0b00 off. [bits 54 - 55]
+ * - address (8 bits): The four address trits, least significant first. [bits 56 - 63]
+ */
+typedef struct
+{
+    unsigned long long reserved : 46; // [bit 0 - 45]     Reserved for future use.
+    unsigned long long speed : 8;     // [bit 46 - 53]    Speed bits, least significant first, each doubled.
+    unsigned long long function : 2;  // [bit 54 - 55]    Function bits. Values: 0b00 (off), 0b11 (on).
+    unsigned long long address : 8;   // [bit 56 - 63]    Address trits, least significant first.
+} MotorolaTelegram;
+
+/**
+ * @brief Constructs a MotorolaTelegram.
+ *
+ * A Motorola decoder has no direction bit, speed step 1 toggles its direction.
+ *
+ * @param address The address of the decoder, 1 - MOTOROLA_ADDRESS_MAX.
+ * @param function The function (light), 0 or 1.
+ * @param speed The speed code, 0 stops, 1 toggles the direction, 2 - 15 are the speed steps.
+ * @return The telegram, MOTOROLA_LENGTH bits most significant bit first.
+ */
+unsigned long long buildMotorolaTelegram(int address, int function, int speed);
+
+typedef union MotorolaConverter
+{
+    MotorolaTelegram mt;
+    unsigned long long ull;
+} MotorolaConverter;
+
+#endif
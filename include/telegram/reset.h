@@ -48,4 +48,10 @@ typedef struct
  */
 ResetAllTelegram buildResetAllTelegram();
 
+typedef union ResetAllConverter
+{
+    ResetAllTelegram rt;
+    unsigned long long ull;
+} ResetAllConverter;
+
 #endif
\ No newline at end of file
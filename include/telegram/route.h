@@ -0,0 +1,27 @@
+#ifndef ROUTE_TELEGRAM_H
+#define ROUTE_TELEGRAM_H
+
+#include "telegram/magnetic.h"
+#include "telegram/system.h"
+
+/**
+ * @struct Route
+ * @brief A named set of accessory commands which is set as one burst.
+ *
+ * This structure contains:
+ * - alias: The name of the route.
+ * - count: The number of accessory commands.
+ * - steps: The accessory commands in the order they are sent.
+ * - section_count: The number of track sections.
+ * - sections: The track sections (0 to INTERLOCK_ELEMENTS - INTERLOCK_TURNOUTS - 1) locked with the route.
+ */
+typedef struct
+{
+    char alias[20];                      // A character array with a fixed length of 20 for the alias name.
+    int count;                           // Number of accessory commands of the route.
+    MagneticData steps[ROUTE_MAX_STEPS]; // Accessory commands in the order they are sent.
+    int section_count;                   // Number of track sections of the route.
+    int sections[ROUTE_MAX_SECTIONS];    // Track sections locked with the route.
+} Route;
+
+#endif
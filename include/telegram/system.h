@@ -0,0 +1,125 @@
+#ifndef SYSTEM_H
+#define SYSTEM_H
+
+/**
+ * @struct SystemData
+ * @brief Represents the header of a system command with bit fields for various parameters.
+ *
+ * System commands control the rtai module itself instead of a single decoder. The header
+ * is followed by `length` unsigned short payload words whose meaning depends on the opcode.
+ *
+ * This structure contains the following fields:
+ * - length (8 bits): Number of payload words following the header (0 to 255).
+ * - opcode (5 bits): Operation requested from the module (see enum system_opcode).
+ * - type (2 bits): Type of data (01 = Locomotive, 10 = Magnetic, 11 = System).
+ * - ack (1 bit): Acknowledge flag (0 = not acknowledged, 1 = acknowledged).
+ */
+typedef struct
+{
+    unsigned short length : 8; // [bit 0 - 7]    Number of payload words following the header. Values: 0 - 255.
+    unsigned short opcode : 5; // [bit 8 - 12]   Operation requested from the module. Values: 0 - 31.
+    unsigned short type : 2;   // [bit 13 - 14]  Type of data: 01 (Locomotive), 10 (Magnetic), 11 (System)
+    unsigned short ack : 1;    // [bit 15]       Acknowledge: 0 (not), 1 (ack)
+} SystemData;
+
+/**
+ * @enum system_opcode
+ * @brief Operations which can be requested with a system command.
+ *
+ * - SYSTEM_WATCH: Subscribes (payload 1) or unsubscribes (payload 0) the state-change stream.
+ * - SYSTEM_EMERGENCY: Sends pre-encoded emergency packets at the next packet boundary.
+ *                     Payload: emergency kind (see enum emergency_kind), locomotive address (0 = all).
+ *                     The stop of a consist address is sent to the address of every member.
+ * - SYSTEM_STATISTICS: Publishes all statistics of the module as EVENT_STATISTIC records. With the payload
+ *                      STATISTICS_RESET the worst values start over afterwards, so the next request reports
+ *                      the worst values since this one. Counters keep counting.
+ * - SYSTEM_TRANSMIT: Queues a locomotive or accessory command like a plain data word and publishes
+ *                    EVENT_TRANSMITTED once it was sent the requested number of times.
+ *                    Payload: data word, repetitions (at least 1).
+ * - SYSTEM_RAMP: Moves a locomotive to the speed and direction of a data word one speed step at a time.
+ *                Light is applied at once. A change of direction decelerates to 0 first.
+ *                Payload: locomotive data word, milliseconds per step accelerating, milliseconds per
+ *                step decelerating.
+ * - SYSTEM_ROUTE: Locks the turnouts and track sections of a route and sets all its accessories as one
+ *                 paced burst, publishes EVENT_ROUTE when done. The command is rejected if an element
+ *                 is locked by another route.
+ *                 Payload: route, number of accessory data words, the accessory data words in the order
+ *                 they are sent, followed by the element numbers of the track sections.
+ * - SYSTEM_RELEASE: Releases elements locked by a route.
+ *                   Payload: route, followed by the element numbers to release (none = all of the route).
+ * - SYSTEM_CONSIST: Defines the locomotives driven together under one address, replacing an existing
+ *                   definition. Locomotive commands to that address are applied to all members at once.
+ *                   Payload: consist address, followed by one word per member holding its address in
+ *                   bits 0 - 6 and in bit 7 whether its direction is inverted (no member = dissolve).
+ *                   The consist address must be above the addresses of the locomotive slots, like the
+ *                   consist address a DCC decoder takes in CV19.
+ * - SYSTEM_SCHEDULE: Holds a command in the module and executes it at a given time, publishes EVENT_SCHEDULED
+ *                    when it was executed. The wrapped command is acknowledged by this command, an emergency
+ *                    stop of all locomotives drops all commands still waiting.
+ *                    Payload: flags (SCHEDULE_AT), time in nanoseconds as four words starting with the least
+ *                    significant one, followed by the command (a data word or a system command with its payload).
+ *                    The time is a delay from the reception of the command or, with SCHEDULE_AT, the RT time.
+ * - SYSTEM_LOAD: Restores the states of locomotives after the module was loaded, for example from a snapshot.
+ *                The states are refreshed from the next period on. Words of addresses without a slot are skipped.
+ *                Payload: locomotive data words.
+ * - SYSTEM_CAPTURE: Enables (payload 1) or disables (payload 0) the capture stream, which publishes every
+ *                   executed command and every packet on the rails as CaptureData records on its own fifo.
+ * - SYSTEM_DEGRADE: Lets locomotive tasks which overrun their period repeatedly skip activations until they
+ *                   keep up again (payload 1), or keeps every refresh (payload 0, the default).
+ * - SYSTEM_TRACE: Enables (payload 1) or disables (payload 0) the trace stream, which publishes the events
+ *                 recorded by the tasks as TraceData records on its own fifo.
+ */
+enum system_opcode
+{
+    SYSTEM_WATCH = 1,
+    SYSTEM_EMERGENCY = 2,
+    SYSTEM_STATISTICS = 3,
+    SYSTEM_TRANSMIT = 4,
+    SYSTEM_RAMP = 5,
+    SYSTEM_ROUTE = 6,
+    SYSTEM_RELEASE = 7,
+    SYSTEM_CONSIST = 8,
+    SYSTEM_SCHEDULE = 9,
+    SYSTEM_LOAD = 10,
+    SYSTEM_CAPTURE = 11,
+    SYSTEM_DEGRADE = 12,
+    SYSTEM_TRACE = 13,
+};
+
+/**
+ * @enum emergency_kind
+ * @brief Packets which can be requested with SYSTEM_EMERGENCY.
+ *
+ * - EMERGENCY_STOP: Emergency stop of one locomotive or of all locomotives (broadcast).
+ * - EMERGENCY_RESET: Digital decoder reset of all decoders, also restores the digital mode.
+ */
+enum emergency_kind
+{
+    EMERGENCY_STOP = 1,
+    EMERGENCY_RESET = 2,
+};
+
+#define SYSTEM_MAX_PAYLOAD 255
+#define TRANSMIT_REPEAT_MAX 16 /* Most repetitions a SYSTEM_TRANSMIT may request */
+#define ROUTE_MAX_STEPS 64      /* Most accessory data words of a SYSTEM_ROUTE */
+#define ROUTE_MAX_SECTIONS 32   /* Most track sections of a SYSTEM_ROUTE */
+#define CONSIST_MAX_MEMBERS 4   /* Locomotives per consist */
+#define CONSIST_INVERTED 0x80   /* Member word flag of a SYSTEM_CONSIST for a member driving reversed */
+#define SCHEDULE_AT 0x1         /* Flag of a SYSTEM_SCHEDULE whose time is the RT time instead of a delay */
+#define SCHEDULE_MAX_COMMAND 16 /* Most words of a command held by SYSTEM_SCHEDULE, including its header */
+#define STATISTICS_RESET 1      /* Payload of a SYSTEM_STATISTICS restarting the worst values */
+
+/*
+ * Elements of the interlocking. Turnouts are numbered address * 4 + device, track sections
+ * follow them starting at INTERLOCK_TURNOUTS.
+ */
+#define INTERLOCK_TURNOUTS 2048
+#define INTERLOCK_ELEMENTS 4096
+
+typedef union SystemDataConverter
+{
+    SystemData sd;
+    unsigned short us;
+} SystemDataConverter;
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/**
+ * @struct TraceData
+ * @brief Represents a record of the trace stream published by the rtai module.
+ *
+ * The module records the events in a ring per CPU at all times. While the stream is enabled with
+ * SYSTEM_TRACE, the records are moved to the trace fifo, starting with those still in the rings.
+ *
+ * This structure contains the following fields:
+ * - time: RT time of the event in nanoseconds.
+ * - kind: Kind of the event (see enum trace_kind).
+ * - cpu: CPU the event was recorded on.
+ * - data: Kind specific data word.
+ * - arg: Kind specific argument.
+ */
+typedef struct
+{
+    unsigned long long time; // RT time of the event in nanoseconds.
+    unsigned char kind;      // Kind of the event. Values: see enum trace_kind.
+    unsigned char cpu;       // CPU the event was recorded on.
+    unsigned short data;     // Kind specific data word.
+    unsigned int arg;        // Kind specific argument.
+} TraceData;
+
+/**
+ * @enum trace_kind
+ * @brief Kinds of records of the trace stream.
+ *
+ * - TRACE_COMMAND: A command is executed. `data` holds its header word, `arg` the number of words.
+ * - TRACE_ACK: A command was answered. `data` holds the word written to the acknowledge fifo, `arg` is 1
+ *              for a rejection.
+ * - TRACE_PACKET_HANDED: A task handed a packet to a district. `data` holds the address byte in the high
+ *                        and the instruction byte in the low byte, `arg` the district.
+ * - TRACE_PACKET_START, TRACE_PACKET_END: A packet started or ended on the rails, recorded at its end.
+ *                                         `data` and `arg` as for TRACE_PACKET_HANDED.
+ * - TRACE_SEM_WAIT: A task waited for a semaphore, recorded when it got it. `time` is the start of the
+ *                   wait, `data` the semaphore (see enum trace_sem), `arg` the wait in nanoseconds.
+ */
+enum trace_kind
+{
+    TRACE_COMMAND = 1,
+    TRACE_ACK = 2,
+    TRACE_PACKET_HANDED = 3,
+    TRACE_PACKET_START = 4,
+    TRACE_PACKET_END = 5,
+    TRACE_SEM_WAIT = 6,
+};
+
+/**
+ * @enum trace_sem
+ * @brief Semaphores whose waits are traced.
+ *
+ * - TRACE_SEM_COMMAND: command_sem, serializing the commands.
+ * - TRACE_SEM_RAILS: The rails of a district, held while a packet is handed and sent.
+ * - TRACE_SEM_DONE: The end of a handed packet on the rails.
+ */
+enum trace_sem
+{
+    TRACE_SEM_COMMAND = 1,
+    TRACE_SEM_RAILS = 2,
+    TRACE_SEM_DONE = 3,
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef UART_H
+#define UART_H
+
+#define UART_BAUD 17241       /* One UART bit lasts a half 1-bit, 58 us */
+#define UART_BIT_TIME 58000   /* Duration of one UART bit in nanoseconds */
+#define UART_FRAME_BITS 10    /* 8N1: start bit, eight data bits, stop bit */
+#define UART_MAX_BYTES 32     /* UART bytes of the longest encoded telegram, 23 for 64 bits */
+#define UART_ZERO_MAX 5       /* Longest half 0-bit in UART bits, 290 us */
+
+/**
+ * @struct UartData
+ * @brief Represents a record of the UART stream published by the rtai module.
+ *
+ * Districts driven by a UART backend have no data lines of a parallel port. The track task
+ * publishes each of their packets as the bytes of a serial line instead, a Linux process
+ * writes them to the serial port of the booster.
+ *
+ * This structure contains the following fields:
+ * - district: The district the packet is sent in.
+ * - length: Number of valid bytes.
+ * - bytes: The telegram encoded for an 8N1 serial line at UART_BAUD.
+ */
+typedef struct
+{
+    unsigned short district;              // The district the packet is sent in.
+    unsigned short length;                // Number of valid bytes.
+    unsigned char bytes[UART_MAX_BYTES]; // The telegram encoded for an 8N1 serial line at UART_BAUD.
+} UartData;
+
+/**
+ * @function encodeUartTelegram
+ * @brief Encodes a telegram into the bytes of an 8N1 serial line, whose levels form the DCC signal.
+ *
+ * Every UART bit lasts a half 1-bit, a half 0-bit lasts two to UART_ZERO_MAX UART bits. The start bit
+ * of every byte begins the first half of a DCC bit and its stop bit ends the second half, so the
+ * bits of the telegram are packed into whole bytes. Half 0-bits are stretched and one bits are added
+ * in front of the preamble and after the packet end bit where the bits don't fill a byte, taking
+ * the packing with the fewest bytes.
+ *
+ * @param message The telegram, most significant bit first.
+ * @param length The number of bits of the telegram.
+ * @param bytes Receives the bytes in the order they are sent.
+ * @param size The size of bytes.
+ * @return int The number of bytes, -1 if they don't fit into size.
+ */
+int encodeUartTelegram(unsigned long long message, int length, unsigned char *bytes, int size);
+
+#endif
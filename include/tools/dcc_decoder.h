@@ -0,0 +1,112 @@
+#ifndef DCC_DECODER_H
+#define DCC_DECODER_H
+
+#define DCC_PREAMBLE_MIN 10   /* One bits a decoder needs before the start bit of a packet */
+#define DCC_MAX_BYTES 6       /* Bytes of the longest packet including its error detection byte */
+#define DCC_LOCOMOTIVES 128   /* Locomotive decoders, indexed by address */
+#define DCC_OUTPUTS (512 * 4) /* Accessory outputs, indexed by address * 4 + device */
+
+/**
+ * @enum dcc_decode_result
+ * @brief Outcome of decoding the bits of a packet.
+ *
+ * - DCC_DECODED: The packet is complete and its error detection byte matches.
+ * - DCC_NO_PREAMBLE: Less than DCC_PREAMBLE_MIN one bits precede the start bit.
+ * - DCC_FRAMING: The bits end before the packet end bit or the packet is too long.
+ * - DCC_CHECKSUM: The error detection byte does not match.
+ */
+enum dcc_decode_result
+{
+    DCC_DECODED = 0,
+    DCC_NO_PREAMBLE = -1,
+    DCC_FRAMING = -2,
+    DCC_CHECKSUM = -3,
+};
+
+/**
+ * @enum dcc_packet_kind
+ * @brief Kinds of packets told apart by the decoder fleet.
+ */
+enum dcc_packet_kind
+{
+    DCC_IDLE = 0,
+    DCC_LOCOMOTIVE = 1,
+    DCC_ACCESSORY = 2,
+    DCC_BROADCAST = 3,
+    DCC_RESET = 4,
+    DCC_UNKNOWN = 5,
+};
+
+/**
+ * @struct DccPacket
+ * @brief The bytes of a decoded packet.
+ *
+ * This structure contains the following fields:
+ * - count: Number of bytes including the error detection byte.
+ * - bytes: The bytes in the order they were sent.
+ */
+typedef struct
+{
+    int count;                           // Number of bytes including the error detection byte.
+    unsigned char bytes[DCC_MAX_BYTES]; // The bytes in the order they were sent.
+} DccPacket;
+
+/**
+ * @struct DccLocomotiveDecoder
+ * @brief The state of an emulated locomotive decoder.
+ */
+typedef struct
+{
+    int known;               // A packet addressed to the decoder was received.
+    unsigned char speed;     // Speed step of the last speed packet.
+    unsigned char direction; // Direction of the last speed packet.
+    unsigned char light;     // Light of the last speed packet.
+} DccLocomotiveDecoder;
+
+/**
+ * @struct DccOutput
+ * @brief The state of an emulated accessory output.
+ */
+typedef struct
+{
+    int known;             // An activation of the output was received.
+    unsigned char control; // Position of the last activation.
+} DccOutput;
+
+/**
+ * @struct DccFleet
+ * @brief Emulated decoders of all locomotive addresses and accessory outputs.
+ */
+typedef struct
+{
+    DccLocomotiveDecoder locomotives[DCC_LOCOMOTIVES]; // Locomotive decoders indexed by address.
+    DccOutput outputs[DCC_OUTPUTS];                    // Accessory outputs indexed by address * 4 + device.
+    unsigned long packets;                             // Packets received.
+    unsigned long errors;                              // Packets a decoder dropped for framing or error detection.
+} DccFleet;
+
+/**
+ * @brief Decodes the bits of a packet the way a decoder receives them.
+ *
+ * @param message The bits, most significant bit first.
+ * @param length The number of bits.
+ * @param packet Receives the bytes.
+ * @return int DCC_DECODED or the reason the packet is dropped (see enum dcc_decode_result).
+ */
+int dcc_decode(unsigned long long message, int length, DccPacket *packet);
+
+/**
+ * @brief Applies a decoded packet to the decoders it is addressed to.
+ *
+ * Locomotive decoders follow speed packets to their address and broadcast speed packets, a reset
+ * packet stops all of them. Accessory outputs follow activations to their address and device.
+ *
+ * @param fleet The decoders.
+ * @param packet The decoded packet.
+ * @param decoder Receives the locomotive address, or DCC_LOCOMOTIVES plus the output index for
+ *                accessories, -1 for packets without a single addressee.
+ * @return int The kind of the packet (see enum dcc_packet_kind).
+ */
+int dcc_apply(DccFleet *fleet, const DccPacket *packet, int *decoder);
+
+#endif
@@ -36,4 +36,5 @@ done
 
 echo "Running..."
 
-./src/dcc
\ No newline at end of file
+# Bring the layout back to the state it had before the reload
+./src/dcc "snapshot --load"
\ No newline at end of file
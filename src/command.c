@@ -1,16 +1,30 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/select.h>
 
 #include "command.h"
 #include "config.h"
 #include "communication/linux_rtai_communication.h"
+#include "communication/session_log.h"
+#include "snapshot.h"
+#include "telegram/event.h"
+#include "telegram/system.h"
 
-#define CMD_CNT 5
+#define CMD_CNT 12
 Command commands[] = {
-    {"loc", cmd_loc, "Usage: loc (--address <address> | --alias <alias>) [OPTION]...\n", "Description: Gives access to the configuration for locomotives.\n", "Options:\n  -a <address>, --address <address>                                            Select the address of the locomotive which should be changed. Address range is 0 to 127.\n  -A <alias>, --alias <alias>                                                  Select the alias of the locomotive which should be changed. Is internally resolved to the address which is configured for this alias. The length of alias is limited to 20 characters.\n  -d (forward | backward), --direction (forward | backward)                    Set the direction in which the locomotive should drive.\n  -h, --help                                                                   Show this screen.\n  -l (on|off), --light (on|off)                                                Enable or disable the light of the locomotive.\n  --list                                                                       List the available locomotives.\n  -m, --monitor                                                                Shows the current configuration of the locomotive.\n  -s <stop | e-stop | 0-15>, --speed <stop | e-stop | 0-15>                    Set the speed the locomotive should drive.\n"},
-    {"mag", cmd_mag, "Usage: mag (--address <address> --device <device> | --alias <alias>) [OPTION]...\n", "Description: Gives access to the configuration for magnetic accessories.\n", "Options:\n  -a <address>, --address <address>                                            Select the address of the accessory which should be changed. Address range is 0 to 511.\n  -A <alias>, --alias <alias>                                                  Select the alias of the accessory which should be changed. Is internally resolved to the address which is configured for this alias. The length of alias is limited to 20 characters.\n  -d <device>, --device <device>                                               Select the device (1-4) which which should be changed.\n  --list                                                                       List the available magnetics.\n  -m, --monitor                                                                Shows the current configuration of the magnetic.\n  -s (on|off), --switch (on|off)                                               Enable or disable the switch.\n"},
+    {"loc", cmd_loc, "Usage: loc (--address <address> | --alias <alias>) [OPTION]...\n", "Description: Gives access to the configuration for locomotives.\n", "Options:\n  -a <address>, --address <address>                                            Select the address of the locomotive which should be changed. Address range is 0 to 127.\n  -A <alias>, --alias <alias>                                                  Select the alias of the locomotive which should be changed. Is internally resolved to the address which is configured for this alias. The length of alias is limited to 20 characters.\n  -d (forward | backward), --direction (forward | backward)                    Set the direction in which the locomotive should drive.\n  -h, --help                                                                   Show this screen.\n  -l (on|off), --light (on|off)                                                Enable or disable the light of the locomotive.\n  --list                                                                       List the available locomotives.\n  -m, --monitor                                                                Shows the current configuration of the locomotive.\n  -s <stop | e-stop | 0-15>, --speed <stop | e-stop | 0-15>                    Set the speed the locomotive should drive.\n  -r <ms>[:<ms>], --ramp <ms>[:<ms>]                                           Reach speed and direction step by step, taking the given milliseconds per step accelerating and decelerating.\n  -t <ms>, --delay <ms>                                                        Let the module execute the command after the given milliseconds, fractions are allowed.\n  --at <ns>                                                                    Let the module execute the command at the given RT time of the module in nanoseconds.\n  -w <repetitions>, --wait <repetitions>                                       Wait until the command was transmitted on the rails the given number of times (1-16) and show when.\n"},
+    {"mag", cmd_mag, "Usage: mag (--address <address> --device <device> | --alias <alias>) [OPTION]...\n", "Description: Gives access to the configuration for magnetic accessories.\n", "Options:\n  -a <address>, --address <address>                                            Select the address of the accessory which should be changed. Address range is 0 to 511.\n  -A <alias>, --alias <alias>                                                  Select the alias of the accessory which should be changed. Is internally resolved to the address which is configured for this alias. The length of alias is limited to 20 characters.\n  -d <device>, --device <device>                                               Select the device (1-4) which which should be changed.\n  --list                                                                       List the available magnetics.\n  -m, --monitor                                                                Shows the current configuration of the magnetic.\n  -s (on|off), --switch (on|off)                                               Enable or disable the switch.\n  -t <ms>, --delay <ms>                                                        Let the module execute the command after the given milliseconds, fractions are allowed.\n  --at <ns>                                                                    Let the module execute the command at the given RT time of the module in nanoseconds.\n  -w <repetitions>, --wait <repetitions>                                       Send the command the given number of times (1-16) back to back and wait until it was transmitted on the rails.\n"},
     {"restore", cmd_restore, "Usage: restore [digital]\n", "Description: Restores the digital mode. Use this command if the system has switched to an alternative mode (analog mode).\n", ""},
+    {"consist", cmd_consist, "Usage: consist (--address <address> | --alias <alias>) (--member <address>[:inverted]... | --dissolve)\n", "Description: Drives several locomotives together under one address. Commands to that address reach all members in the same pass, inverted members drive in the opposite direction.\n", "Options:\n  -a <address>, --address <address>                                            Select the address the consist is driven with. Address range is 4 to 127, above the locomotive slots.\n  -A <alias>, --alias <alias>                                                  Select the alias of the consist. Is internally resolved to the address which is configured for this alias.\n  --dissolve                                                                   Dissolve the consist, its members are driven on their own again.\n  -m <address>[:inverted], --member <address>[:inverted]                       Add a locomotive to the consist, up to 4 members.\n"},
+    {"snapshot", cmd_snapshot, "Usage: snapshot (--load [--accessories] | --show | --clear)\n", "Description: Gives access to the snapshot of the decoder states. Every state sent by this prompt or shown by watch is recorded, after the module was reloaded the snapshot brings the layout back in one batch.\n", "Options:\n  --accessories                                                                Also send the recorded positions of the accessories, one command each.\n  --clear                                                                      Forget all recorded states.\n  --load                                                                       Restore the recorded locomotive states in the module.\n  --show                                                                       List the recorded states.\n"},
+    {"record", cmd_record, "Usage: record (--start <file> | --stop)\n", "Description: Records every command sent to the module with its time into a session log, which can be replayed with tools/replay.\n", "Options:\n  --start <file>                                                               Start recording into the given file, an existing file is replaced.\n  --stop                                                                       Stop recording.\n"},
+    {"route", cmd_route, "Usage: route <alias>\n       route --release <alias> [<section>]...\n       route --list\n", "Description: Locks the turnouts and track sections of a route and sets all its accessories as one paced burst, waits until the last one was transmitted. A route is rejected while one of its elements is locked by another route.\n", "Options:\n  --list                                                                       List the available routes.\n  --release <alias> [<section>]...                                             Release the given track sections of a route, or the whole route if no section is given.\n"},
+    {"stop", cmd_stop, "Usage: stop\n", "Description: Stops all locomotives immediately. The emergency stop is sent to all decoders before any other pending message.\n", ""},
+    {"stats", cmd_stats, "Usage: stats [--degrade (on|off)]\n", "Description: Shows the round trip and retry statistics of the commands sent by this prompt and the statistics of the module, including the deadlines of its tasks.\n", "Options:\n  --degrade (on|off)                                                           Let locomotive tasks which overrun their period repeatedly skip refreshes until they keep up again. Off by default.\n"},
+    {"watch", cmd_watch, "Usage: watch [OPTION]...\n", "Description: Shows a live view of the state the module transmits to the decoders. Press enter to stop.\n", "Options:\n  -r <rate>, --rate <rate>                                                     Set the refresh rate of the view in Hz (1-50). Defaults to 10.\n"},
     {"help", cmd_help, "Usage: help\n       help <command>\n", "Description: Show this help or used with <command> --help.\n", ""},
     {"exit", NULL, "Usage: exit\n", "Description: Terminates the current prompt. Also sends a reset message to all decoders.\n", ""},
     {NULL, NULL, NULL}};
@@ -110,6 +124,99 @@ int handle_command(const char *command, char *args)
     return 1;
 }
 
+/**
+ * @brief Sends a locomotive or accessory command, optionally waiting until it is on the rails.
+ *
+ * @param data The data word of the command.
+ * @param wait The number of transmissions to wait for, 0 to return after the acknowledgement.
+ */
+static void send_command(unsigned short data, int wait)
+{
+    if (wait <= 0)
+    {
+        if (send_with_ack(data, 3) == 0)
+        {
+            snapshot_record(data);
+        }
+        return;
+    }
+
+    unsigned long long first, last;
+    int sent = send_transmit_with_ack(data, wait, &first, &last, 3);
+    if (sent < 0)
+    {
+        return;
+    }
+    snapshot_record(data);
+    if (sent < wait)
+    {
+        printf("Replaced by a newer command after %d of %d transmissions.\n", sent, wait);
+    }
+    printf("Transmitted %d time(s): first bit at %llu ns, last bit at %llu ns (%llu us on the rails)\n", sent, first, last, (last - first) / 1000);
+}
+
+/**
+ * @brief Parses the value of a delay or execution time option.
+ *
+ * @param option The option, "--at" for an RT time of the module, otherwise a delay.
+ * @param value The value of the option, may be NULL.
+ * @param absolute Receives 1 for an RT time, 0 for a delay.
+ * @param time Receives the RT time or delay in nanoseconds.
+ * @return int Returns 1 if the value is valid, 0 otherwise.
+ */
+static int parse_schedule(const char *option, const char *value, int *absolute, unsigned long long *time)
+{
+    if (value == NULL)
+    {
+        printf("Missing argument for %s\n", option);
+        return 0;
+    }
+    if (strcmp(option, "--at") == 0)
+    {
+        *absolute = 1;
+        if (sscanf(value, "%llu", time) != 1)
+        {
+            printf("Invalid argument '%s' for %s\n", value, option);
+            return 0;
+        }
+        return 1;
+    }
+
+    // The delay is given in milliseconds, fractions allow sub-millisecond timing
+    double delay_ms;
+    *absolute = 0;
+    if (sscanf(value, "%lf", &delay_ms) != 1 || delay_ms < 0)
+    {
+        printf("Invalid argument '%s' for %s\n", value, option);
+        return 0;
+    }
+    *time = (unsigned long long)(delay_ms * 1000000.0);
+    return 1;
+}
+
+/**
+ * @brief Sends a command which the module executes at the given time.
+ *
+ * @param command The header word of the command followed by its payload.
+ * @param count The number of words.
+ * @param absolute 1 if time is an RT time of the module, 0 if it is a delay.
+ * @param time The RT time or delay in nanoseconds.
+ */
+static void send_scheduled(const unsigned short *command, int count, int absolute, unsigned long long time)
+{
+    if (send_scheduled_with_ack(absolute, time, command, count, 3) == 0)
+    {
+        if (absolute)
+        {
+            printf("Scheduled for %llu ns\n", time);
+        }
+        else
+        {
+            printf("Scheduled in %.3f ms\n", time / 1000000.0);
+        }
+    }
+}
+
 void cmd_loc(char *args)
 {
     const char *cmd_name = "loc";
@@ -126,7 +233,14 @@ void cmd_loc(char *args)
     int direction = -1;
     int light = -1;
     int speed = -1;
+    int emergency = 0;
     int monitor = 0;
+    int wait = 0;
+    int accel_ms = -1;
+    int decel_ms = -1;
+    int scheduled = 0;
+    int absolute = 0;
+    unsigned long long schedule_time = 0;
 
     // Tokenize the arguments
     char *option = strtok(args, " ");
@@ -234,6 +348,7 @@ void cmd_loc(char *args)
                 else if (strcmp(value, "e-stop") == 0)
                 {
                     speed = 1;
+                    emergency = 1;
                 }
                 else if (sscanf(value, "%d", &speed) != 1 || speed > 15)
                 {
@@ -247,6 +362,56 @@ void cmd_loc(char *args)
                 options_valid = 0;
             }
         }
+        else if (strcmp(option, "-r") == 0 || strcmp(option, "--ramp") == 0)
+        {
+            // Get the value for the ramp, the deceleration defaults to the acceleration
+            char *value = strtok(NULL, " ");
+            if (value != NULL)
+            {
+                int parsed = sscanf(value, "%d:%d", &accel_ms, &decel_ms);
+                if (parsed == 1)
+                {
+                    decel_ms = accel_ms;
+                }
+                if (parsed < 1 || accel_ms < 0 || accel_ms > 65535 || decel_ms < 0 || decel_ms > 65535)
+                {
+                    printf("Invalid argument '%s' for ramp\n", value);
+                    options_valid = 0;
+                }
+            }
+            else
+            {
+                printf("Missing argument for ramp\n");
+                options_valid = 0;
+            }
+        }
+        else if (strcmp(option, "-w") == 0 || strcmp(option, "--wait") == 0)
+        {
+            // Get the value for the repetitions
+            char *value = strtok(NULL, " ");
+            if (value != NULL)
+            {
+                if (sscanf(value, "%d", &wait) != 1 || wait < 1 || wait > TRANSMIT_REPEAT_MAX)
+                {
+                    printf("Invalid argument '%s' for wait\n", value);
+                    options_valid = 0;
+                }
+            }
+            else
+            {
+                printf("Missing argument for wait\n");
+                options_valid = 0;
+            }
+        }
+        else if (strcmp(option, "-t") == 0 || strcmp(option, "--delay") == 0 || strcmp(option, "--at") == 0)
+        {
+            // Get the value for the delay or execution time
+            scheduled = 1;
+            if (!parse_schedule(option, strtok(NULL, " "), &absolute, &schedule_time))
+            {
+                options_valid = 0;
+            }
+        }
         else if (strcmp(option, "-m") == 0 || strcmp(option, "--monitor") == 0)
         {
             monitor = 1;
@@ -272,6 +437,17 @@ void cmd_loc(char *args)
         option = strtok(NULL, " ");
     }
 
+    if (accel_ms >= 0 && (wait > 0 || emergency))
+    {
+        printf("Option ramp can't be combined with wait or e-stop\n");
+        options_valid = 0;
+    }
+    if (scheduled && (wait > 0 || emergency))
+    {
+        printf("Option delay can't be combined with wait or e-stop\n");
+        options_valid = 0;
+    }
+
     if (!options_valid)
     {
         printf("See '%s --help' for more informations.\n", cmd_name);
@@ -289,7 +465,7 @@ void cmd_loc(char *args)
                 .direction = 0,
                 .light = 0,
                 .speed = 0,
-                .type = 0,
+                .type = 0b01,
                 .ack = 0,
             }};
 
@@ -358,9 +534,38 @@ void cmd_loc(char *args)
 
         // TODO: Send changes to rtai part and check for acknowledge. Measure time between send and checks. Check the timeout exceeded. Check the FIFO contains the message if not but no acknowledge resend.
         // Send not changes instead send unsigned short rtai side needs to check if there is a matching object to the address
+        // An emergency stop takes the fast path first, the state update only keeps the locomotive stopped
+        if (emergency)
+        {
+            unsigned short payload[] = {EMERGENCY_STOP, loc.data.address};
+            send_system_with_ack(SYSTEM_EMERGENCY, payload, 2, 3);
+        }
+
         LocomotiveDataConverter converter;
         converter.ld = loc.data;
-        send_with_ack(converter.us, 3);
+        if (accel_ms >= 0 && scheduled)
+        {
+            SystemDataConverter header = {.sd = {.length = 3, .opcode = SYSTEM_RAMP, .type = 0b11, .ack = 0}};
+            unsigned short command[] = {header.us, converter.us, accel_ms, decel_ms};
+            send_scheduled(command, 4, absolute, schedule_time);
+        }
+        else if (accel_ms >= 0)
+        {
+            // The module steps the speed itself, one command replaces the whole ramp
+            unsigned short payload[] = {converter.us, accel_ms, decel_ms};
+            if (send_system_with_ack(SYSTEM_RAMP, payload, 3, 3) == 0)
+            {
+                snapshot_record(converter.us);
+            }
+        }
+        else if (scheduled)
+        {
+            send_scheduled(&converter.us, 1, absolute, schedule_time);
+        }
+        else
+        {
+            send_command(converter.us, wait);
+        }
     }
     else
     {
@@ -386,6 +591,10 @@ void cmd_mag(char *args)
     int device = -1;
     int control = -1;
     int monitor = 0;
+    int wait = 0;
+    int scheduled = 0;
+    int absolute = 0;
+    unsigned long long schedule_time = 0;
 
     // Tokenize the arguments
     char *option = strtok(args, " ");
@@ -474,6 +683,33 @@ void cmd_mag(char *args)
                 options_valid = 0;
             }
         }
+        else if (strcmp(option, "-w") == 0 || strcmp(option, "--wait") == 0)
+        {
+            // Get the value for the repetitions
+            char *value = strtok(NULL, " ");
+            if (value != NULL)
+            {
+                if (sscanf(value, "%d", &wait) != 1 || wait < 1 || wait > TRANSMIT_REPEAT_MAX)
+                {
+                    printf("Invalid argument '%s' for wait\n", value);
+                    options_valid = 0;
+                }
+            }
+            else
+            {
+                printf("Missing argument for wait\n");
+                options_valid = 0;
+            }
+        }
+        else if (strcmp(option, "-t") == 0 || strcmp(option, "--delay") == 0 || strcmp(option, "--at") == 0)
+        {
+            // Get the value for the delay or execution time
+            scheduled = 1;
+            if (!parse_schedule(option, strtok(NULL, " "), &absolute, &schedule_time))
+            {
+                options_valid = 0;
+            }
+        }
         else if (strcmp(option, "-m") == 0 || strcmp(option, "--monitor") == 0)
         {
             monitor = 1;
@@ -499,6 +735,12 @@ void cmd_mag(char *args)
         option = strtok(NULL, " ");
     }
 
+    if (scheduled && wait > 0)
+    {
+        printf("Option delay can't be combined with wait\n");
+        options_valid = 0;
+    }
+
     if (!options_valid)
     {
         printf("See '%s --help' for more informations.\n", cmd_name);
@@ -516,7 +758,7 @@ void cmd_mag(char *args)
                 .control = 0,
                 .device = 0,
                 .enable = 0,
-                .type = 0,
+                .type = 0b10,
                 .ack = 0,
             }};
 
@@ -565,7 +807,8 @@ void cmd_mag(char *args)
                     magnetic_user[i].data.device = device;
                 }
 
-                mag.data.enable = magnetic_user[i].data.enable;
+                // Every command fires the solenoid, the module sends the deactivation after the pulse
+                mag.data.enable = 1;
                 break;
             }
         }
@@ -578,7 +821,14 @@ void cmd_mag(char *args)
         // TODO: Send changes to rtai part and check for acknowledge. Measure time between send and checks. Check the timeout exceeded. Check the FIFO contains the message if not but no acknowledge resend.
         MagneticDataConverter converter;
         converter.md = mag.data;
-        send_with_ack(converter.us, 3);
+        if (scheduled)
+        {
+            send_scheduled(&converter.us, 1, absolute, schedule_time);
+        }
+        else
+        {
+            send_command(converter.us, wait);
+        }
     }
     else
     {
@@ -632,9 +882,20 @@ void cmd_restore(char *args)
     switch (mode)
     {
     case digital:
+    {
         printf("Restore mode: digital\n");
-        // TODO: Call corrsponding function
+        // Decoders which fell back to analog mode return to digital mode after a reset packet
+        unsigned short payload[] = {EMERGENCY_RESET, 0};
+        if (send_system_with_ack(SYSTEM_EMERGENCY, payload, 2, 3) == 0)
+        {
+            size_t num_locomotives = sizeof(locomotives_user) / sizeof(locomotives_user[0]);
+            for (size_t i = 0; i < num_locomotives; i++)
+            {
+                locomotives_user[i].data.speed = 0;
+            }
+        }
         break;
+    }
     case analog:
         printf("Currently unsupported to switch to mode 'analog'!");
         break;
@@ -652,6 +913,887 @@ void cmd_restore(char *args)
     }
 }
 
+void cmd_consist(char *args)
+{
+    const char *cmd_name = "consist";
+    int options_valid = 1;
+
+    int address = -1;
+    char alias[20] = "";
+    int dissolve = 0;
+    unsigned short members[CONSIST_MAX_MEMBERS];
+    int member_count = 0;
+
+    // Tokenize the arguments
+    char *option = strtok(args, " ");
+    while (option != NULL)
+    {
+        if (strcmp(option, "-a") == 0 || strcmp(option, "--address") == 0)
+        {
+            // Get the value for the address
+            char *value = strtok(NULL, " ");
+            if (value != NULL)
+            {
+                if (sscanf(value, "%d", &address) != 1 || address < 1 || address > 127)
+                {
+                    printf("Invalid argument '%s' for address\n", value);
+                    options_valid = 0;
+                }
+            }
+            else
+            {
+                printf("Missing argument for address\n");
+                options_valid = 0;
+            }
+        }
+        else if (strcmp(option, "-A") == 0 || strcmp(option, "--alias") == 0)
+        {
+            // Get the value for the alias
+            char *value = strtok(NULL, " ");
+            if (value != NULL)
+            {
+                // Only allow alphanumeric aliases
+                if (sscanf(value, "%19[A-Za-z0-9]", alias) != 1)
+                {
+                    printf("Invalid argument '%s' for alias\n", value);
+                    options_valid = 0;
+                }
+            }
+            else
+            {
+                printf("Missing argument for alias\n");
+                options_valid = 0;
+            }
+        }
+        else if (strcmp(option, "-m") == 0 || strcmp(option, "--member") == 0)
+        {
+            // Get the value for the member, optionally followed by its inversion
+            char *value = strtok(NULL, " ");
+            if (value != NULL)
+            {
+                int member;
+                char suffix[10] = "";
+                int parsed = sscanf(value, "%d:%9s", &member, suffix);
+                if (parsed < 1 || member < 1 || member > 127 || (parsed == 2 && strcmp(suffix, "inverted") != 0) || member_count >= CONSIST_MAX_MEMBERS)
+                {
+                    printf("Invalid argument '%s' for member\n", value);
+                    options_valid = 0;
+                }
+                else
+                {
+                    members[member_count++] = member | (parsed == 2 ? CONSIST_INVERTED : 0);
+                }
+            }
+            else
+            {
+                printf("Missing argument for member\n");
+                options_valid = 0;
+            }
+        }
+        else if (strcmp(option, "--dissolve") == 0)
+        {
+            dissolve = 1;
+        }
+        else
+        {
+            printf("Unknown option '%s' for command '%s'\n", option, cmd_name);
+            options_valid = 0;
+        }
+
+        // Move to the next option
+        option = strtok(NULL, " ");
+    }
+
+    // Resolve the alias to the address of the consist
+    if (alias[0] != '\0')
+    {
+        size_t num_locomotives = sizeof(locomotives_user) / sizeof(locomotives_user[0]);
+        for (size_t i = 0; i < num_locomotives; i++)
+        {
+            if (strcmp(alias, locomotives_user[i].alias) == 0)
+            {
+                address = locomotives_user[i].data.address;
+            }
+        }
+        if (address < 0)
+        {
+            printf("Unknown alias '%s'\n", alias);
+            options_valid = 0;
+        }
+    }
+
+    if (options_valid && (address < 0 || dissolve == (member_count > 0)))
+    {
+        for (int i = 0; i < CMD_CNT; i++)
+        {
+            if (strcmp(cmd_name, commands[i].name) == 0)
+            {
+                printf(commands[i].usage);
+                return;
+            }
+        }
+    }
+    if (!options_valid)
+    {
+        printf("See '%s --help' for more informations.\n", cmd_name);
+        return;
+    }
+
+    unsigned short payload[1 + CONSIST_MAX_MEMBERS];
+    payload[0] = address;
+    memcpy(&payload[1], members, member_count * sizeof(unsigned short));
+    if (send_system_with_ack(SYSTEM_CONSIST, payload, 1 + member_count, 3) == 0)
+    {
+        if (dissolve)
+        {
+            printf("Consist %d dissolved\n", address);
+        }
+        else
+        {
+            printf("Consist %d drives %d locomotives\n", address, member_count);
+        }
+    }
+}
+
+void cmd_snapshot(char *args)
+{
+    const char *cmd_name = "snapshot";
+    int options_valid = 1;
+
+    int load = 0;
+    int accessories = 0;
+    int show = 0;
+    int clear = 0;
+
+    // Tokenize the arguments
+    char *option = strtok(args, " ");
+    while (option != NULL)
+    {
+        if (strcmp(option, "--load") == 0)
+        {
+            load = 1;
+        }
+        else if (strcmp(option, "--accessories") == 0)
+        {
+            accessories = 1;
+        }
+        else if (strcmp(option, "--show") == 0)
+        {
+            show = 1;
+        }
+        else if (strcmp(option, "--clear") == 0)
+        {
+            clear = 1;
+        }
+        else
+        {
+            printf("Unknown option '%s' for command '%s'\n", option, cmd_name);
+            options_valid = 0;
+        }
+
+        // Move to the next option
+        option = strtok(NULL, " ");
+    }
+
+    if (options_valid && (load + show + clear != 1 || (accessories && !load)))
+    {
+        for (int i = 0; i < CMD_CNT; i++)
+        {
+            if (strcmp(cmd_name, commands[i].name) == 0)
+            {
+                printf(commands[i].usage);
+                return;
+            }
+        }
+    }
+    if (!options_valid)
+    {
+        printf("See '%s --help' for more informations.\n", cmd_name);
+        return;
+    }
+
+    if (clear)
+    {
+        if (snapshot_clear() == 0)
+        {
+            printf("Snapshot cleared\n");
+        }
+        return;
+    }
+
+    static unsigned short locomotives[SNAPSHOT_LOCOMOTIVES];
+    static unsigned short magnetics[SNAPSHOT_MAGNETICS];
+    if (snapshot_read(locomotives, magnetics) != 0)
+    {
+        printf("No snapshot in '%s'\n", SNAPSHOT_FILE);
+        return;
+    }
+
+    if (show)
+    {
+        for (int i = 0; i < SNAPSHOT_LOCOMOTIVES; i++)
+        {
+            if (locomotives[i] != 0)
+            {
+                LocomotiveDataConverter converter = {.us = locomotives[i]};
+                printf("\tlocomotive %d - direction: %d, light: %d, speed: %d\n", converter.ld.address, converter.ld.direction, converter.ld.light, converter.ld.speed);
+            }
+        }
+        for (int i = 0; i < SNAPSHOT_MAGNETICS; i++)
+        {
+            if (magnetics[i] != 0)
+            {
+                MagneticDataConverter converter = {.us = magnetics[i]};
+                printf("\taccessory %d device %d - control: %d\n", converter.md.address, converter.md.device + 1, converter.md.control);
+            }
+        }
+        return;
+    }
+
+    // All locomotives go to the module in one command, so the refresh resumes with the next period
+    unsigned short payload[SNAPSHOT_LOCOMOTIVES];
+    int count = 0;
+    for (int i = 0; i < SNAPSHOT_LOCOMOTIVES; i++)
+    {
+        if (locomotives[i] != 0)
+        {
+            payload[count++] = locomotives[i];
+        }
+    }
+    if (count > 0 && send_system_with_ack(SYSTEM_LOAD, payload, count, 3) != 0)
+    {
+        return;
+    }
+    printf("Restored %d locomotive(s)\n", count);
+
+    if (accessories)
+    {
+        // Turnouts keep their position without power, their packets are only sent on request
+        int restored = 0;
+        for (int i = 0; i < SNAPSHOT_MAGNETICS; i++)
+        {
+            if (magnetics[i] != 0 && send_with_ack(magnetics[i], 3) == 0)
+            {
+                restored++;
+            }
+        }
+        printf("Restored %d accessory position(s)\n", restored);
+    }
+}
+
+void cmd_record(char *args)
+{
+    const char *cmd_name = "record";
+    int options_valid = 1;
+
+    char *path = NULL;
+    int stop = 0;
+
+    // Tokenize the arguments
+    char *option = strtok(args, " ");
+    while (option != NULL)
+    {
+        if (strcmp(option, "--start") == 0)
+        {
+            // Get the file of the session log
+            path = strtok(NULL, " ");
+            if (path == NULL)
+            {
+                printf("Missing argument for start\n");
+                options_valid = 0;
+            }
+        }
+        else if (strcmp(option, "--stop") == 0)
+        {
+            stop = 1;
+        }
+        else
+        {
+            printf("Unknown option '%s' for command '%s'\n", option, cmd_name);
+            options_valid = 0;
+        }
+
+        // Move to the next option
+        option = strtok(NULL, " ");
+    }
+
+    if (options_valid && (path != NULL) == stop)
+    {
+        for (int i = 0; i < CMD_CNT; i++)
+        {
+            if (strcmp(cmd_name, commands[i].name) == 0)
+            {
+                printf(commands[i].usage);
+                return;
+            }
+        }
+    }
+    if (!options_valid)
+    {
+        printf("See '%s --help' for more informations.\n", cmd_name);
+        return;
+    }
+
+    if (stop)
+    {
+        int count = session_log_stop();
+        if (count < 0)
+        {
+            printf("No recording running\n");
+        }
+        else
+        {
+            printf("Recording stopped after %d command(s)\n", count);
+        }
+        return;
+    }
+    if (session_log_start(path) == 0)
+    {
+        printf("Recording into '%s'\n", path);
+    }
+}
+
+void cmd_route(char *args)
+{
+    const char *cmd_name = "route";
+    size_t num_routes = sizeof(routes_user) / sizeof(routes_user[0]);
+    int release = 0;
+
+    char *option = strtok(args, " ");
+    if (option != NULL && strcmp(option, "--list") == 0)
+    {
+        // List the available routes
+        printf("Routes:\n");
+        for (size_t i = 0; i < num_routes; i++)
+        {
+            printf("\t%s - %d accessories, sections:", routes_user[i].alias, routes_user[i].count);
+            for (int section = 0; section < routes_user[i].section_count; section++)
+            {
+                printf(" %d", routes_user[i].sections[section]);
+            }
+            printf("\n");
+        }
+        return;
+    }
+    if (option != NULL && strcmp(option, "--release") == 0)
+    {
+        release = 1;
+        option = strtok(NULL, " ");
+    }
+    if (option == NULL)
+    {
+        for (int i = 0; i < CMD_CNT; i++)
+        {
+            if (strcmp(cmd_name, commands[i].name) == 0)
+            {
+                printf(commands[i].usage);
+                return;
+            }
+        }
+    }
+
+    // The route is numbered by its position in the roster
+    size_t index = 0;
+    while (index < num_routes && strcmp(option, routes_user[index].alias) != 0)
+    {
+        index++;
+    }
+    if (index == num_routes)
+    {
+        printf("Unknown route '%s'\n", option);
+        printf("See '%s --list' for the available routes.\n", cmd_name);
+        return;
+    }
+    Route *route = &routes_user[index];
+
+    if (release)
+    {
+        // Sections are released one by one as the train clears them, without sections the whole route is released
+        unsigned short elements[ROUTE_MAX_SECTIONS];
+        int count = 0;
+        char *value;
+        while ((value = strtok(NULL, " ")) != NULL)
+        {
+            int section;
+            if (count >= ROUTE_MAX_SECTIONS || sscanf(value, "%d", &section) != 1 || section < 0 || section >= INTERLOCK_ELEMENTS - INTERLOCK_TURNOUTS)
+            {
+                printf("Invalid argument '%s' for section\n", value);
+                printf("See '%s --help' for more informations.\n", cmd_name);
+                return;
+            }
+            elements[count++] = INTERLOCK_TURNOUTS + section;
+        }
+        if (release_route(index, elements, count, 3) == 0)
+        {
+            printf("Route %s released\n", route->alias);
+        }
+        return;
+    }
+
+    if (strtok(NULL, " ") != NULL)
+    {
+        printf("Too many arguments for command '%s'\n", cmd_name);
+        printf("See '%s --help' for more informations.\n", cmd_name);
+        return;
+    }
+
+    unsigned short steps[ROUTE_MAX_STEPS];
+    for (int step = 0; step < route->count; step++)
+    {
+        MagneticDataConverter converter;
+        converter.md = route->steps[step];
+        converter.md.type = 0b10;
+        converter.md.ack = 0;
+        steps[step] = converter.us;
+    }
+    unsigned short sections[ROUTE_MAX_SECTIONS];
+    for (int section = 0; section < route->section_count; section++)
+    {
+        sections[section] = INTERLOCK_TURNOUTS + route->sections[section];
+    }
+
+    unsigned long long first, last;
+    int sent = send_route_with_ack(index, steps, route->count, sections, route->section_count, &first, &last, 3);
+    if (sent == -2)
+    {
+        printf("Route %s conflicts with a locked route\n", route->alias);
+        return;
+    }
+    if (sent < 0)
+    {
+        return;
+    }
+
+    // Mirror the new states locally
+    size_t num_magnetics = sizeof(magnetic_user) / sizeof(magnetic_user[0]);
+    for (int step = 0; step < route->count; step++)
+    {
+        snapshot_record(steps[step]);
+        for (size_t m = 0; m < num_magnetics; m++)
+        {
+            if (magnetic_user[m].data.address == route->steps[step].address && magnetic_user[m].data.device == route->steps[step].device)
+            {
+                magnetic_user[m].data.control = route->steps[step].control;
+            }
+        }
+    }
+    printf("Route %s set and locked: %d packets, %llu ms from the first to the last bit\n", route->alias, sent, (last - first) / 1000000);
+}
+
+void cmd_stop(char *args)
+{
+    const char *cmd_name = "stop";
+
+    if (args && strlen(args) > 0)
+    {
+        printf("Unknown option '%s' for command '%s'\n", args, cmd_name);
+        printf("See '%s --help' for more informations.\n", cmd_name);
+        return;
+    }
+
+    unsigned short payload[] = {EMERGENCY_STOP, 0};
+    if (send_system_with_ack(SYSTEM_EMERGENCY, payload, 2, 3) == 0)
+    {
+        // The module keeps all locomotives in emergency stop, mirror it locally
+        size_t num_locomotives = sizeof(locomotives_user) / sizeof(locomotives_user[0]);
+        for (size_t i = 0; i < num_locomotives; i++)
+        {
+            locomotives_user[i].data.speed = 1;
+        }
+        // A warm restart must not start the trains again
+        static unsigned short locomotives[SNAPSHOT_LOCOMOTIVES];
+        static unsigned short magnetics[SNAPSHOT_MAGNETICS];
+        if (snapshot_read(locomotives, magnetics) == 0)
+        {
+            for (int i = 0; i < SNAPSHOT_LOCOMOTIVES; i++)
+            {
+                if (locomotives[i] != 0)
+                {
+                    LocomotiveDataConverter converter = {.us = locomotives[i]};
+                    converter.ld.speed = 1;
+                    snapshot_record(converter.us);
+                }
+            }
+        }
+        printf("Emergency stop sent to all locomotives\n");
+    }
+}
+
+void cmd_stats(char *args)
+{
+    const char *cmd_name = "stats";
+    const char *names[STATISTIC_COUNT] = {
+        [STATISTIC_EMERGENCY_COUNT] = "emergency requests",
+        [STATISTIC_EMERGENCY_LATENCY_LAST] = "emergency latency last (ns)",
+        [STATISTIC_EMERGENCY_LATENCY_MAX] = "emergency latency max (ns)",
+        [STATISTIC_TRACK_BUSY_TIME] = "track busy time (ns)",
+        [STATISTIC_TRACK_IDLE_TIME] = "track idle time (ns)",
+        [STATISTIC_TRACK_PACKETS] = "packets sent",
+        [STATISTIC_IDLE_PACKETS] = "idle packets sent",
+        [STATISTIC_MAGNETIC_MERGED] = "accessory commands merged",
+        [STATISTIC_INTERLOCK_CONFLICTS] = "interlocking conflicts",
+        [STATISTIC_SCHEDULED_COMMANDS] = "scheduled commands executed",
+        [STATISTIC_SCHEDULE_LATENESS_MAX] = "scheduled command lateness max (ns)",
+        [STATISTIC_QUEUE_FULL] = "commands refused, queue full",
+        [STATISTIC_CAPTURE_DROPPED] = "capture records dropped",
+        [STATISTIC_DEADLINE_OVERRUNS] = "task periods overrun",
+        [STATISTIC_ACTIVATIONS_SKIPPED] = "refreshes skipped to keep up",
+        [STATISTIC_LOCO_LATENESS_MAX] = "locomotive task lateness max (ns)",
+        [STATISTIC_LOCO_RUNTIME_MAX] = "locomotive task run time max (ns)",
+        [STATISTIC_MAGNETIC_LATENESS_MAX] = "accessory task lateness max (ns)",
+        [STATISTIC_MAGNETIC_RUNTIME_MAX] = "accessory task run time max (ns)",
+        [STATISTIC_EDGE_LATENESS_MAX] = "edge lateness max (ns)",
+        [STATISTIC_EDGES_LATE] = "edges late",
+        [STATISTIC_PLAN_REFRESH_MAX] = "planned refresh interval max (ns)",
+        [STATISTIC_PLAN_LOAD_MAX] = "planned district load max (%)",
+        [STATISTIC_PLAN_REFUSED] = "locomotives refused, district full",
+        [STATISTIC_TRACE_LOST] = "trace records lost",
+        [STATISTIC_UART_DROPPED] = "UART packets dropped",
+    };
+
+    if (args && strlen(args) > 0)
+    {
+        char option[16], value[8];
+        if (sscanf(args, "%15s %7s", option, value) == 2 && strcmp(option, "--degrade") == 0 &&
+            (strcmp(value, "on") == 0 || strcmp(value, "off") == 0))
+        {
+            unsigned short payload = strcmp(value, "on") == 0;
+            if (send_system_with_ack(SYSTEM_DEGRADE, &payload, 1, 3) == 0)
+            {
+                printf("Degraded refresh on overruns %s\n", value);
+            }
+            else
+            {
+                printf("Failed to set the degraded refresh\n");
+            }
+            return;
+        }
+        printf("Unknown option '%s' for command '%s'\n", args, cmd_name);
+        printf("See '%s --help' for more informations.\n", cmd_name);
+        return;
+    }
+
+    // The round trips are measured here, they are shown even if the module does not answer
+    const char *types[] = {NULL, "locomotive", "magnetic", "system"};
+    printf("Acknowledge statistics:\n");
+    printf("\t%-12s %10s %10s %10s %10s %12s %12s %12s\n", "type", "commands", "retries", "failures", "rejected", "srtt (us)", "rttvar (us)", "timeout (us)");
+    for (unsigned short type = 1; type <= 3; type++)
+    {
+        AckStatistics ack;
+        get_ack_statistics(type, &ack);
+        printf("\t%-12s %10lu %10lu %10lu %10lu %12ld %12ld %12ld\n", types[type], ack.commands, ack.retries, ack.failures, ack.rejections, ack.srtt, ack.rttvar, ack.timeout);
+    }
+
+    unsigned long long values[STATISTIC_COUNT] = {0};
+    if (request_statistics(values) != 0)
+    {
+        return;
+    }
+
+    printf("Module statistics:\n");
+    for (int id = 1; id < STATISTIC_COUNT; id++)
+    {
+        printf("\t%-40s %llu\n", names[id] ? names[id] : "unknown", values[id]);
+    }
+
+    // Utilization is the share of the rail time carrying useful packets, the rest is gap filling
+    unsigned long long rail_time = values[STATISTIC_TRACK_BUSY_TIME] + values[STATISTIC_TRACK_IDLE_TIME];
+    if (rail_time > 0)
+    {
+        printf("\t%-40s %.1f %%\n", "track utilization", 100.0 * values[STATISTIC_TRACK_BUSY_TIME] / rail_time);
+        printf("\t%-40s %.1f %%\n", "idle ratio", 100.0 * values[STATISTIC_TRACK_IDLE_TIME] / rail_time);
+    }
+}
+
+/**
+ * @brief A row of the watch view, holding the last state received for one decoder.
+ */
+typedef struct
+{
+    unsigned short data;     // The last data word published for the decoder.
+    unsigned long long time; // RT timestamp of the last change in nanoseconds.
+    int dirty;               // Changed since the row was rendered last.
+} WatchRow;
+
+static WatchRow watch_rows[128 + 512 * 4];
+static short watch_loco_row[128];
+static short watch_mag_row[512 * 4];
+static int watch_row_count;
+
+/**
+ * @brief Looks up the row of the decoder addressed by a data word, adding it if necessary.
+ *
+ * @param data The data word of a locomotive or magnetic.
+ * @return int The index of the row or -1 if the data word addresses no decoder.
+ */
+static int watch_row(unsigned short data)
+{
+    short *row;
+    unsigned short type = (data >> 13) & 0x3;
+
+    if (type == 0x1)
+    {
+        LocomotiveDataConverter converter = {.us = data};
+        row = &watch_loco_row[converter.ld.address];
+    }
+    else if (type == 0x2)
+    {
+        MagneticDataConverter converter = {.us = data};
+        row = &watch_mag_row[converter.md.address * 4 + converter.md.device];
+    }
+    else
+    {
+        return -1;
+    }
+
+    if (*row < 0)
+    {
+        *row = watch_row_count++;
+        watch_rows[*row].data = data;
+        watch_rows[*row].time = 0;
+        watch_rows[*row].dirty = 1;
+    }
+    return *row;
+}
+
+/**
+ * @brief Redraws a single row of the watch view in place.
+ *
+ * @param index The index of the row.
+ */
+static void watch_render_row(int index)
+{
+    WatchRow *row = &watch_rows[index];
+    unsigned short type = (row->data >> 13) & 0x3;
+
+    printf("\033[%d;1H\033[2K", WATCH_HEADER_LINES + index + 1);
+    if (type == 0x1)
+    {
+        LocomotiveDataConverter converter = {.us = row->data};
+        const char *alias = "";
+        for (size_t i = 0; i < sizeof(locomotives_user) / sizeof(locomotives_user[0]); i++)
+        {
+            if (locomotives_user[i].data.address == converter.ld.address)
+            {
+                alias = locomotives_user[i].alias;
+            }
+        }
+        printf("loc %3d     (%-20s) direction: %-8s light: %-3s speed: %2d", converter.ld.address, alias, converter.ld.direction ? "forward" : "backward", converter.ld.light ? "on" : "off", converter.ld.speed);
+    }
+    else
+    {
+        MagneticDataConverter converter = {.us = row->data};
+        const char *alias = "";
+        for (size_t i = 0; i < sizeof(magnetic_user) / sizeof(magnetic_user[0]); i++)
+        {
+            if (magnetic_user[i].data.address == converter.md.address && magnetic_user[i].data.device == converter.md.device)
+            {
+                alias = magnetic_user[i].alias;
+            }
+        }
+        printf("mag %3d / %d (%-20s) control: %-3s      enable: %-3s", converter.md.address, converter.md.device + 1, alias, converter.md.control ? "on" : "off", converter.md.enable ? "on" : "off");
+    }
+
+    if (row->time > 0)
+    {
+        printf("  @ %llu.%06llu s", row->time / 1000000000ULL, (row->time % 1000000000ULL) / 1000ULL);
+    }
+    else
+    {
+        printf("  @ -");
+    }
+    row->dirty = 0;
+}
+
+static long long watch_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+void cmd_watch(char *args)
+{
+    const char *cmd_name = "watch";
+    int options_valid = 1;
+
+    int rate = WATCH_REFRESH_RATE;
+
+    // Tokenize the arguments
+    char *option = strtok(args, " ");
+    while (option != NULL)
+    {
+        if (strcmp(option, "-r") == 0 || strcmp(option, "--rate") == 0)
+        {
+            // Get the value for the refresh rate
+            char *value = strtok(NULL, " ");
+            if (value != NULL)
+            {
+                if (sscanf(value, "%d", &rate) != 1 || rate < 1 || rate > 50)
+                {
+                    printf("Invalid argument '%s' for rate\n", value);
+                    options_valid = 0;
+                }
+            }
+            else
+            {
+                printf("Missing argument for rate\n");
+                options_valid = 0;
+            }
+        }
+        else
+        {
+            printf("Unknown option '%s' for command '%s'\n", option, cmd_name);
+            options_valid = 0;
+        }
+
+        // Move to the next option
+        option = strtok(NULL, " ");
+    }
+
+    if (!options_valid)
+    {
+        printf("See '%s --help' for more informations.\n", cmd_name);
+        return;
+    }
+
+    int fd_event = open_event_fifo();
+    if (fd_event < 0)
+    {
+        return;
+    }
+
+    // Discard records left over from an earlier subscription
+    char stale[SIZE_EVENT_BUFFER];
+    while (read(fd_event, stale, sizeof(stale)) > 0)
+    {
+    }
+
+    unsigned short subscribe = 1;
+    if (send_system_with_ack(SYSTEM_WATCH, &subscribe, 1, 3) != 0)
+    {
+        close(fd_event);
+        return;
+    }
+
+    // Known decoders get their rows first, so the view keeps the order of the configuration
+    memset(watch_loco_row, -1, sizeof(watch_loco_row));
+    memset(watch_mag_row, -1, sizeof(watch_mag_row));
+    watch_row_count = 0;
+    for (size_t i = 0; i < sizeof(locomotives_user) / sizeof(locomotives_user[0]); i++)
+    {
+        LocomotiveDataConverter converter = {.ld = locomotives_user[i].data};
+        converter.ld.type = 0b01;
+        watch_row(converter.us);
+    }
+    for (size_t i = 0; i < sizeof(magnetic_user) / sizeof(magnetic_user[0]); i++)
+    {
+        MagneticDataConverter converter = {.md = magnetic_user[i].data};
+        converter.md.type = 0b10;
+        watch_row(converter.us);
+    }
+
+    printf("\033[2J\033[1;1HWatching the layout at %d Hz, press enter to stop.\n", rate);
+
+    long long frame_period = 1000000000LL / rate;
+    long long next_frame = watch_now();
+    int dirty = 1;
+    char buffer[SIZE_EVENT_BUFFER];
+    size_t buffered = 0;
+    int running = 1;
+
+    while (running)
+    {
+        // Render all pending changes at once, but never faster than the refresh rate
+        long long now = watch_now();
+        if (dirty > 0 && now >= next_frame)
+        {
+            for (int i = 0; i < watch_row_count; i++)
+            {
+                if (watch_rows[i].dirty)
+                {
+                    watch_render_row(i);
+                }
+            }
+            printf("\033[%d;1H", WATCH_HEADER_LINES + watch_row_count + 1);
+            fflush(stdout);
+            dirty = 0;
+            next_frame = now + frame_period;
+        }
+
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(STDIN_FILENO, &fds);
+        FD_SET(fd_event, &fds);
+
+        // Without pending changes block until the module publishes something
+        struct timeval timeout;
+        struct timeval *wait = NULL;
+        if (dirty > 0)
+        {
+            long long remaining = next_frame > now ? next_frame - now : 0;
+            timeout.tv_sec = remaining / 1000000000LL;
+            timeout.tv_usec = (remaining % 1000000000LL) / 1000;
+            wait = &timeout;
+        }
+
+        if (select(fd_event + 1, &fds, NULL, NULL, wait) < 0)
+        {
+            perror("select");
+            break;
+        }
+
+        if (FD_ISSET(STDIN_FILENO, &fds))
+        {
+            char line[MAX_INPUT];
+            if (!fgets(line, sizeof(line), stdin))
+            {
+                clearerr(stdin);
+            }
+            running = 0;
+        }
+
+        if (FD_ISSET(fd_event, &fds))
+        {
+            ssize_t r = read(fd_event, buffer + buffered, sizeof(buffer) - buffered);
+            if (r > 0)
+            {
+                buffered += r;
+                size_t offset = 0;
+                while (buffered - offset >= sizeof(EventData))
+                {
+                    EventData event;
+                    memcpy(&event, buffer + offset, sizeof(event));
+                    offset += sizeof(event);
+
+                    if (event.kind != EVENT_STATE)
+                    {
+                        continue;
+                    }
+                    // The view doubles as the recorder of the snapshot, it sees every state the module sends
+                    snapshot_record(event.data);
+                    int index = watch_row(event.data);
+                    if (index < 0)
+                    {
+                        continue;
+                    }
+                    watch_rows[index].data = event.data;
+                    watch_rows[index].time = event.time;
+                    watch_rows[index].dirty = 1;
+                    dirty = 1;
+                }
+                // Keep an incomplete record for the next read
+                memmove(buffer, buffer + offset, buffered - offset);
+                buffered -= offset;
+            }
+        }
+    }
+
+    subscribe = 0;
+    send_system_with_ack(SYSTEM_WATCH, &subscribe, 1, 3);
+    close(fd_event);
+}
+
 void cmd_help(char *args)
 {
     if (args && strlen(args) > 0)
@@ -0,0 +1,419 @@
+#include "communication/bitslice.h"
+
+#include "communication/railroad_communication.h"
+#include "communication/rtai_linux_communication.h"
+#include "communication/district_config.h"
+#include "communication/trace.h"
+#include "telegram/idle.h"
+#include "telegram/uart.h"
+
+District districts[DISTRICT_MAX * SHARD_MAX];
+int district_count = 0;
+Shard shards[SHARD_MAX];
+int shard_count = 0;
+
+static Waveform idle_waveform; // Pre-encoded idle packet
+static RTIME merge_counts;     // BITSLICE_MERGE_TIME in counts
+static RTIME slack_counts;     // BITSLICE_EDGE_SLACK in counts
+static RTIME idle_uart_counts; // Time of the idle packet on a serial line in counts
+
+void init_track(void)
+{
+  IdleConverter converter;
+  converter.it = buildIdleTelegram();
+  encode_waveform(converter.ull, length, &idle_waveform);
+  merge_counts = nano2count(BITSLICE_MERGE_TIME);
+  slack_counts = nano2count(BITSLICE_EDGE_SLACK);
+  unsigned char idle_bytes[UART_MAX_BYTES];
+  idle_uart_counts = nano2count((RTIME)encodeUartTelegram(converter.ull, length, idle_bytes, UART_MAX_BYTES) *
+                                UART_FRAME_BITS * UART_BIT_TIME);
+
+  int s, i;
+  district_count = 0;
+  shard_count = 0;
+  for (s = 0; s < sizeof(shard_config) / sizeof(shard_config[0]) && s < SHARD_MAX; s++)
+  {
+    Shard *shard = &shards[shard_count++];
+    shard->port = shard_config[s].port;
+    shard->cpu = shard_config[s].cpu;
+    shard->first_district = district_count;
+    shard->district_count = 0;
+
+    // The districts of a shard are stored contiguously, so its track task walks a plain range
+    unsigned char used = 0;
+    for (i = 0; i < sizeof(district_config) / sizeof(district_config[0]); i++)
+    {
+      if (district_config[i].shard != s)
+      {
+        continue;
+      }
+      // A UART district drives no data lines of the port
+      unsigned char lines = district_config[i].uart ? 0 : district_config[i].lines;
+      if (shard->district_count >= DISTRICT_MAX || (!district_config[i].uart && lines == 0) || (lines & used) != 0)
+      {
+        rt_printk("District %d ignored, its lines 0x%02x are empty or in use\n", i, lines);
+        continue;
+      }
+      used |= lines;
+
+      District *district = &districts[district_count++];
+      shard->district_count++;
+      // The rails are handed out by priority, an emergency bypasses them
+      rt_typed_sem_init(&district->rails, 1, CNT_SEM | PRIO_Q);
+      rt_sem_init(&district->done, 0);
+      rt_sem_init(&district->emergency_done, 0);
+      district->pending = NULL;
+      district->emergency = NULL;
+      district->in_emergency = 0;
+      district->resume = NULL;
+      district->shard = shard_count - 1;
+      district->lines = lines;
+      district->uart = district_config[i].uart;
+      district->locomotive_first = district_config[i].locomotive_first;
+      district->locomotive_last = district_config[i].locomotive_last;
+      district->magnetic_first = district_config[i].magnetic_first;
+      district->magnetic_last = district_config[i].magnetic_last;
+    }
+    shard->lines = used;
+  }
+}
+
+void cleanup_track(void)
+{
+  int i;
+  for (i = 0; i < district_count; i++)
+  {
+    rt_sem_delete(&districts[i].rails);
+    rt_sem_delete(&districts[i].done);
+    rt_sem_delete(&districts[i].emergency_done);
+  }
+}
+
+int district_of_locomotive(int address)
+{
+  int i;
+  for (i = 0; i < district_count; i++)
+  {
+    if (address >= districts[i].locomotive_first && address <= districts[i].locomotive_last)
+    {
+      return i;
+    }
+  }
+  return 0;
+}
+
+int district_of_magnetic(int address)
+{
+  int i;
+  for (i = 0; i < district_count; i++)
+  {
+    if (address >= districts[i].magnetic_first && address <= districts[i].magnetic_last)
+    {
+      return i;
+    }
+  }
+  return 0;
+}
+
+unsigned int cpu_of_locomotive(int address)
+{
+  return shards[districts[district_of_locomotive(address)].shard].cpu;
+}
+
+void collect_track_statistics(void)
+{
+  unsigned long long busy_time = 0, idle_time = 0, packets = 0, idle_packets = 0, edges_late = 0;
+  RTIME edge_lateness_max = 0;
+  int s;
+  for (s = 0; s < shard_count; s++)
+  {
+    busy_time += shards[s].busy_time;
+    idle_time += shards[s].idle_time;
+    packets += shards[s].packets;
+    idle_packets += shards[s].idle_packets;
+    edges_late += shards[s].edges_late;
+    if (shards[s].edge_lateness_max > edge_lateness_max)
+    {
+      edge_lateness_max = shards[s].edge_lateness_max;
+    }
+  }
+  statistics[STATISTIC_TRACK_BUSY_TIME] = busy_time;
+  statistics[STATISTIC_TRACK_IDLE_TIME] = idle_time;
+  statistics[STATISTIC_TRACK_PACKETS] = packets;
+  statistics[STATISTIC_IDLE_PACKETS] = idle_packets;
+  statistics[STATISTIC_EDGE_LATENESS_MAX] = count2nano(edge_lateness_max);
+  statistics[STATISTIC_EDGES_LATE] = edges_late;
+}
+
+void reset_track_statistics(void)
+{
+  int s;
+  for (s = 0; s < shard_count; s++)
+  {
+    shards[s].edge_lateness_max = 0;
+  }
+}
+
+void send_bit_task(int district, const Waveform *waveform, int repeat, RTIME *first, RTIME *last)
+{
+  District *d = &districts[district];
+  unsigned short packet = trace_packet_data(waveform->message);
+  RTIME wait = rt_get_time_ns();
+  RTIME now;
+
+  rt_sem_wait(&d->rails);
+  now = rt_get_time_ns();
+  trace_event_at(wait, TRACE_SEM_WAIT, TRACE_SEM_RAILS, (unsigned int)(now - wait));
+  trace_event_at(now, TRACE_PACKET_HANDED, packet, district);
+  d->pending_repeat = repeat;
+  smp_wmb();
+  d->pending = waveform;
+  rt_sem_wait(&d->done);
+  wait = now;
+  now = rt_get_time_ns();
+  trace_event_at(wait, TRACE_SEM_WAIT, TRACE_SEM_DONE, (unsigned int)(now - wait));
+  // The times belong to this waveform as long as the rails are held
+  if (first != NULL)
+  {
+    *first = d->started;
+  }
+  if (last != NULL)
+  {
+    *last = d->finished;
+  }
+  rt_sem_signal(&d->rails);
+}
+
+void hand_emergency_waveform(int district, const Waveform *waveform, int repeat)
+{
+  District *d = &districts[district];
+
+  d->emergency_repeat = repeat;
+  smp_wmb();
+  d->emergency = waveform;
+}
+
+RTIME wait_emergency_waveform(int district)
+{
+  District *d = &districts[district];
+
+  rt_sem_wait(&d->emergency_done);
+  return d->emergency_started;
+}
+
+/**
+ * @brief Returns the time until the first edge of the current waveform of a district.
+ *
+ * A UART district has no edges of its own, its packet is published for the UART backend and
+ * takes the time of its bytes on the serial line.
+ *
+ * @param d The district.
+ * @return RTIME The time in counts.
+ */
+static RTIME first_step(District *d)
+{
+  if (!d->uart)
+  {
+    return d->current->half_bits[0];
+  }
+  if (d->idle)
+  {
+    return idle_uart_counts;
+  }
+  int count = uart_packet(d - districts, d->current);
+  if (count < 0)
+  {
+    return nano2count(d->current->duration);
+  }
+  return nano2count((RTIME)count * UART_FRAME_BITS * UART_BIT_TIME);
+}
+
+/**
+ * @brief Puts the next waveform of a district on the rails, an idle packet if nothing is handed.
+ *
+ * @param d The district.
+ * @param at The time the waveform starts in counts.
+ */
+static void start_waveform(District *d, RTIME at)
+{
+  const Waveform *emergency = d->emergency;
+  const Waveform *pending = d->pending;
+  if (emergency != NULL)
+  {
+    smp_rmb();
+    d->current = emergency;
+    d->repeat = d->emergency_repeat;
+    d->idle = 0;
+    d->in_emergency = 1;
+    d->emergency = NULL;
+    d->emergency_started = count2nano(at);
+  }
+  else if (d->resume != NULL)
+  {
+    // The interrupted waveform continues where the emergency cut in
+    d->current = d->resume;
+    d->repeat = d->resume_repeat;
+    d->idle = 0;
+    d->resume = NULL;
+  }
+  else if (pending != NULL)
+  {
+    smp_rmb();
+    d->current = pending;
+    d->repeat = d->pending_repeat;
+    d->idle = 0;
+    d->pending = NULL;
+    d->started = count2nano(at);
+  }
+  else
+  {
+    d->current = &idle_waveform;
+    d->repeat = 1;
+    d->idle = 1;
+  }
+  d->half_bit = 0;
+  d->high = 1;
+  d->waveform_start = at;
+  d->next_edge = at + first_step(d);
+}
+
+/**
+ * @brief Moves a district to its next half bit, starting the next waveform at its end.
+ *
+ * @param shard The shard of the district, receives the statistics.
+ * @param d The district.
+ */
+static void advance_district(Shard *shard, District *d)
+{
+  RTIME edge = d->next_edge;
+
+  // The waveform of a UART district is a single step
+  if (!d->uart && ++d->half_bit < d->current->count)
+  {
+    d->high = !d->high;
+    d->next_edge += d->current->half_bits[d->half_bit];
+    return;
+  }
+
+  // The waveform is complete at this edge
+  if (d->idle)
+  {
+    shard->idle_time += count2nano(edge - d->waveform_start);
+    shard->idle_packets++;
+  }
+  else
+  {
+    shard->busy_time += count2nano(edge - d->waveform_start);
+    shard->packets++;
+    // Both ends are recorded now, the track task has no time to spare at the start of a packet
+    unsigned short packet = trace_packet_data(d->current->message);
+    trace_event_at(count2nano(d->waveform_start), TRACE_PACKET_START, packet, d - districts);
+    trace_event_at(count2nano(edge), TRACE_PACKET_END, packet, d - districts);
+    // The capture stream only carries DCC packets
+    if (capture_enabled && d->current->dcc)
+    {
+      capture_packet(d - districts, d->current, count2nano(d->waveform_start), count2nano(edge));
+    }
+  }
+
+  // An emergency cuts in between the repetitions, the rest of them follow the emergency
+  if (!d->idle && !d->in_emergency && d->repeat > 1 && d->emergency != NULL)
+  {
+    d->resume = d->current;
+    d->resume_repeat = d->repeat - 1;
+    start_waveform(d, edge);
+    return;
+  }
+
+  if (!d->idle && --d->repeat > 0)
+  {
+    d->half_bit = 0;
+    d->high = 1;
+    d->waveform_start = edge;
+    d->next_edge = edge + first_step(d);
+    return;
+  }
+  if (d->in_emergency)
+  {
+    d->in_emergency = 0;
+    rt_sem_signal(&d->emergency_done);
+  }
+  else if (!d->idle)
+  {
+    d->finished = count2nano(edge);
+    rt_sem_signal(&d->done);
+  }
+  start_waveform(d, edge);
+}
+
+void send_track_task(long s)
+{
+  Shard *shard = &shards[s];
+  District *first = &districts[shard->first_district];
+  District *last = first + shard->district_count;
+  RTIME now = rt_get_time();
+  unsigned char port = 0;
+  District *d;
+
+  if (shard->district_count == 0)
+  {
+    rt_printk("No district configured for shard %ld, its track stays unpowered\n", s);
+    return;
+  }
+
+  for (d = first; d < last; d++)
+  {
+    start_waveform(d, now);
+    port |= d->lines;
+  }
+  if (shard->lines != 0)
+  {
+    outb(port, shard->port);
+  }
+
+  while (1)
+  {
+    RTIME edge = first->next_edge;
+    for (d = first + 1; d < last; d++)
+    {
+      if (d->next_edge < edge)
+      {
+        edge = d->next_edge;
+      }
+    }
+
+    // Every district switching within the merge window shares this port write, each district
+    // keeps its own timeline so the merging never accumulates into its bit times
+    port = 0;
+    for (d = first; d < last; d++)
+    {
+      if (d->next_edge - edge <= merge_counts)
+      {
+        advance_district(shard, d);
+      }
+      if (d->high)
+      {
+        port |= d->lines;
+      }
+    }
+
+    rt_sleep_until(edge);
+    if (shard->lines != 0)
+    {
+      outb(port, shard->port);
+    }
+
+    // Every activation of the track task is an edge, its lateness is the jitter of the half bits
+    RTIME late = rt_get_time() - edge;
+    if (late > shard->edge_lateness_max)
+    {
+      shard->edge_lateness_max = late;
+    }
+    if (late > slack_counts)
+    {
+      shard->edges_late++;
+    }
+  }
+}
+
+EXPORT_SYMBOL(send_track_task);
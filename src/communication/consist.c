@@ -0,0 +1,186 @@
+#include "communication/consist.h"
+
+#include <rtai.h>
+
+#include "communication/railroad_communication.h"
+
+Consist consists[CONSIST_MAX];
+SEM consist_sem;
+
+Consist *find_consist(int address)
+{
+  int i;
+  for (i = 0; i < CONSIST_MAX; i++)
+  {
+    if (consists[i].used && consists[i].address == address)
+    {
+      return &consists[i];
+    }
+  }
+  return NULL;
+}
+
+int consist_members(const Consist *consist, int members[], int inverted[])
+{
+  int i, count;
+  rt_sem_wait(&consist_sem);
+  count = consist->used ? consist->member_count : 0;
+  for (i = 0; i < count; i++)
+  {
+    members[i] = consist->members[i];
+    inverted[i] = consist->inverted[i];
+  }
+  rt_sem_signal(&consist_sem);
+  return count;
+}
+
+/**
+ * @brief Hands the refresh of the members back to their own tasks and frees the entry.
+ *
+ * Called with consist_sem held.
+ *
+ * @param consist The consist.
+ */
+static void dissolve_consist(Consist *consist)
+{
+  int i;
+  for (i = 0; i < consist->member_count; i++)
+  {
+    LocomotiveSlot *slot = &locomotive_slots[consist->members[i]];
+    rt_sem_wait(&slot->sem);
+    slot->consist = 0;
+    rt_sem_signal(&slot->sem);
+  }
+  consist->used = 0;
+}
+
+int define_consist(int address, const unsigned short *members, int count)
+{
+  Consist *old = find_consist(address);
+  Consist *consist = old;
+  int i, j;
+
+  if (address <= 0 || address > 127 || count < 0 || count > CONSIST_MAX_MEMBERS)
+  {
+    return -1;
+  }
+  // The locomotive of a slot must stay reachable on its own address, consists use the addresses above
+  if (address <= LOC_MSQ_SIZE)
+  {
+    rt_printk("Traktion %d belegt die Adresse einer Lok\n", address);
+    return -1;
+  }
+
+  // The old consist stays as it is until the new definition is known to be valid
+  for (i = 0; i < count; i++)
+  {
+    int member = members[i] & 0x7F;
+    int in_use = member > 0 && member <= LOC_MSQ_SIZE && locomotive_slots[member - 1].consist != 0 &&
+                 (old == NULL || locomotive_slots[member - 1].consist != old - consists + 1);
+    if (member <= 0 || member > LOC_MSQ_SIZE || in_use)
+    {
+      rt_printk("Lok %d kann nicht in Traktion %d fahren\n", member, address);
+      return -1;
+    }
+    for (j = 0; j < i; j++)
+    {
+      if ((members[j] & 0x7F) == member)
+      {
+        return -1;
+      }
+    }
+  }
+  for (i = 0; i < CONSIST_MAX && consist == NULL && count > 0; i++)
+  {
+    if (!consists[i].used)
+    {
+      consist = &consists[i];
+    }
+  }
+  if (consist == NULL && count > 0)
+  {
+    rt_printk("Keine freie Traktion für %d\n", address);
+    return -1;
+  }
+
+  rt_sem_wait(&consist_sem);
+  if (old != NULL)
+  {
+    dissolve_consist(old);
+  }
+  if (count > 0)
+  {
+    consist->address = address;
+    consist->member_count = count;
+    for (i = 0; i < count; i++)
+    {
+      consist->members[i] = (members[i] & 0x7F) - 1;
+      consist->inverted[i] = (members[i] >> 7) & 1;
+    }
+    consist->used = 1;
+  }
+  rt_sem_signal(&consist_sem);
+
+  // A pass of the first member only sends while all members point to the consist
+  for (i = 0; i < count; i++)
+  {
+    LocomotiveSlot *slot = &locomotive_slots[consist->members[i]];
+    rt_sem_wait(&slot->sem);
+    slot->consist = consist - consists + 1;
+    rt_sem_signal(&slot->sem);
+  }
+  return 0;
+}
+
+void drive_consist(Consist *consist, LocomotiveData loco, int ramp, RTIME accel_time, RTIME decel_time)
+{
+  int members[CONSIST_MAX_MEMBERS], inverted[CONSIST_MAX_MEMBERS];
+  int count = consist_members(consist, members, inverted);
+  RTIME now = rt_get_time_ns();
+  int i, slot_index;
+
+  // Locked in slot order, so two passes over overlapping slots can't deadlock
+  for (slot_index = 0; slot_index < LOC_MSQ_SIZE; slot_index++)
+  {
+    for (i = 0; i < count; i++)
+    {
+      if (members[i] == slot_index)
+      {
+        rt_sem_wait(&locomotive_slots[slot_index].sem);
+      }
+    }
+  }
+
+  for (i = 0; i < count; i++)
+  {
+    LocomotiveSlot *slot = &locomotive_slots[members[i]];
+    LocomotiveData member = loco;
+    member.address = members[i] + 1;
+    member.direction = loco.direction ^ inverted[i];
+    if (ramp)
+    {
+      // A locomotive without a known state ramps up from standing
+      if (slot->data.type == 0)
+      {
+        slot->data = member;
+        slot->data.speed = 0;
+      }
+      slot->data.light = member.light;
+      slot->ramp_target = member;
+      slot->ramp_accel_time = accel_time;
+      slot->ramp_decel_time = decel_time;
+      slot->ramp_last_step = now;
+      slot->ramp_active = 1;
+    }
+    else
+    {
+      slot->data = member;
+      slot->ramp_active = 0;
+    }
+  }
+
+  for (i = 0; i < count; i++)
+  {
+    rt_sem_signal(&locomotive_slots[members[i]].sem);
+  }
+}
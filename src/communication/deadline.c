@@ -0,0 +1,72 @@
+#include "communication/deadline.h"
+
+volatile int deadline_degrade = 0;
+
+void deadline_make_periodic(Deadline *deadline, RT_TASK *task, RTIME start, RTIME period, int degradable)
+{
+  deadline->period = period;
+  deadline->degradable = degradable;
+  deadline->release = count2nano(start);
+  deadline->stretch = 1;
+  deadline->planned = 1;
+  deadline->phase = 0;
+  rt_task_make_periodic(task, start, nano2count(period));
+}
+
+int deadline_begin(Deadline *deadline)
+{
+  RTIME now = rt_get_time_ns();
+
+  // A skipped activation only keeps the releases in step, it costs no more than the wait
+  int every = deadline->stretch > deadline->planned ? deadline->stretch : deadline->planned;
+  if (deadline->phase + 1 < every)
+  {
+    deadline->phase++;
+    deadline->skipped++;
+    deadline->release += deadline->period;
+    return 0;
+  }
+  deadline->phase = 0;
+
+  deadline->begin = now;
+  if (now > deadline->release && now - deadline->release > deadline->lateness_max)
+  {
+    deadline->lateness_max = now - deadline->release;
+  }
+  deadline->activations++;
+  return 1;
+}
+
+void deadline_end(Deadline *deadline)
+{
+  RTIME now = rt_get_time_ns();
+  RTIME runtime = now - deadline->begin;
+
+  if (runtime > deadline->runtime_max)
+  {
+    deadline->runtime_max = runtime;
+  }
+  deadline->release += deadline->period;
+
+  if (now <= deadline->release)
+  {
+    deadline->overrun_streak = 0;
+    if (++deadline->on_time_streak >= DEADLINE_RECOVER_AFTER && deadline->stretch > 1)
+    {
+      deadline->stretch /= 2;
+      deadline->on_time_streak = 0;
+      rt_printk("Task hält die Periode wieder ein, arbeitet in jeder %d. Aktivierung\n", deadline->stretch);
+    }
+    return;
+  }
+
+  deadline->overruns++;
+  deadline->on_time_streak = 0;
+  if (++deadline->overrun_streak >= DEADLINE_DEGRADE_AFTER && deadline_degrade && deadline->degradable &&
+      deadline->stretch < DEADLINE_STRETCH_MAX)
+  {
+    deadline->stretch *= 2;
+    deadline->overrun_streak = 0;
+    rt_printk("Task überschreitet die Periode, arbeitet nur noch in jeder %d. Aktivierung\n", deadline->stretch);
+  }
+}
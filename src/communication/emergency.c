@@ -0,0 +1,226 @@
+#include "communication/emergency.h"
+
+#include "communication/railroad_communication.h"
+#include "communication/bitslice.h"
+#include "communication/consist.h"
+#include "communication/protocol.h"
+#include "communication/rtai_linux_communication.h"
+#include "telegram/reset.h"
+#include "telegram/system.h"
+#include "telegram/event.h"
+
+RT_TASK emergency_task;
+SEM emergency_sem;
+
+static Waveform emergency_stop_all; // Pre-encoded broadcast emergency stop
+static Waveform emergency_reset;    // Pre-encoded broadcast decoder reset
+
+/**
+ * @struct EmergencyRequest
+ * @brief An emergency waiting for the emergency task.
+ *
+ * A broadcast is one packet to all districts, the stop of a consist one packet per member.
+ */
+typedef struct
+{
+  int count;                                      // Number of packets.
+  const Waveform *waveforms[CONSIST_MAX_MEMBERS]; // Waveform of each packet, a pre-encoded one or one of stops.
+  int districts[CONSIST_MAX_MEMBERS];             // District of each packet, -1 for all districts.
+  RTIME requested;                                // Time of the request in nanoseconds.
+  Waveform stops[CONSIST_MAX_MEMBERS];            // Emergency stops of single locomotives, kept until the request is served.
+} EmergencyRequest;
+
+// Single producer (command_sem holder), single consumer (emergency task) ring of requested emergencies.
+// An entry is only reused after its packets were sent, so its waveforms are never encoded while on the rails.
+static EmergencyRequest emergency_queue[EMERGENCY_QUEUE_SIZE];
+static volatile unsigned int emergency_queue_head = 0; // Next request taken by the emergency task
+static volatile unsigned int emergency_queue_tail = 0; // Next free entry for the requests
+
+void init_emergency(void)
+{
+  // The broadcast address 0 with speed step 1 stops all locomotives immediately
+  LocomotiveData stop = {.address = 0, .direction = 1, .light = 0, .speed = 1};
+  encode_waveform(buildLocomotiveTelegram(stop), length, &emergency_stop_all);
+
+  ResetAllConverter converter;
+  converter.rt = buildResetAllTelegram();
+  encode_waveform(converter.ull, length, &emergency_reset);
+}
+
+/**
+ * @brief Adds the emergency stop of a single locomotive to a request.
+ *
+ * Encoding is done here, the fast path itself only emits.
+ *
+ * @param request The request.
+ * @param address The address of the locomotive.
+ */
+static void add_stop(EmergencyRequest *request, int address)
+{
+  LocomotiveData stop = {.address = address, .direction = 1, .light = 0, .speed = 1};
+  Waveform *waveform = &request->stops[request->count];
+  encode_locomotive(stop, waveform);
+  request->waveforms[request->count] = waveform;
+  request->districts[request->count] = district_of_locomotive(address);
+  request->count++;
+}
+
+int request_emergency(int kind, int address)
+{
+  EmergencyRequest *request = &emergency_queue[emergency_queue_tail % EMERGENCY_QUEUE_SIZE];
+  int members[CONSIST_MAX_MEMBERS], inverted[CONSIST_MAX_MEMBERS];
+  int member_count = 0;
+  Consist *consist;
+  int i, j;
+
+  if (address < 0 || address > 127)
+  {
+    return -1;
+  }
+  // A request is never overwritten before it was served
+  if (emergency_queue_tail - emergency_queue_head >= EMERGENCY_QUEUE_SIZE)
+  {
+    rt_printk("Notfallwarteschlange voll!\n");
+    statistics[STATISTIC_QUEUE_FULL]++;
+    return -1;
+  }
+
+  request->count = 0;
+  switch (kind)
+  {
+  case EMERGENCY_STOP:
+    if (address == 0)
+    {
+      request->waveforms[0] = &emergency_stop_all;
+      request->districts[0] = -1;
+      request->count = 1;
+      break;
+    }
+    // The members of a consist are stopped by their own addresses in their own districts
+    consist = find_consist(address);
+    if (consist != NULL)
+    {
+      member_count = consist_members(consist, members, inverted);
+    }
+    for (i = 0; i < member_count; i++)
+    {
+      add_stop(request, members[i] + 1);
+    }
+    if (member_count == 0)
+    {
+      add_stop(request, address);
+    }
+    break;
+  case EMERGENCY_RESET:
+    request->waveforms[0] = &emergency_reset;
+    request->districts[0] = -1;
+    request->count = 1;
+    break;
+  default:
+    return -1;
+  }
+
+  request->requested = rt_get_time_ns();
+  smp_wmb();
+  emergency_queue_tail++;
+  rt_sem_signal(&emergency_sem);
+
+  // Keep the refresh packets from restarting the locomotives
+  for (i = 0; i < LOC_MSQ_SIZE; i++)
+  {
+    int stopped = address == 0 || i + 1 == address;
+    for (j = 0; j < member_count; j++)
+    {
+      stopped = stopped || members[j] == i;
+    }
+    if (!stopped)
+    {
+      continue;
+    }
+    rt_sem_wait(&locomotive_slots[i].sem);
+    // After a reset the decoders are stopped, after an emergency stop they stay in it
+    locomotive_slots[i].data.speed = kind == EMERGENCY_RESET ? 0 : 1;
+    locomotive_slots[i].ramp_active = 0;
+    rt_sem_signal(&locomotive_slots[i].sem);
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Sends the packets of a request and waits until all of them are sent.
+ *
+ * Each district takes the emergency at its next packet boundary, also between the repetitions
+ * of a packet. All districts get their waveform before waiting for any of them to finish, a
+ * district with a second packet of the request takes it in the next round.
+ *
+ * @param request The request.
+ * @return RTIME The time from the request until the last packet started in nanoseconds.
+ */
+static RTIME send_request(const EmergencyRequest *request)
+{
+  int busy[DISTRICT_MAX * SHARD_MAX];
+  RTIME latency = 0;
+  int next = 0;
+  int i;
+
+  while (next < request->count)
+  {
+    for (i = 0; i < district_count; i++)
+    {
+      busy[i] = 0;
+    }
+    for (; next < request->count; next++)
+    {
+      int first = request->districts[next] < 0 ? 0 : request->districts[next];
+      int last = request->districts[next] < 0 ? district_count - 1 : request->districts[next];
+      for (i = first; i <= last && !busy[i]; i++)
+      {
+      }
+      if (i <= last)
+      {
+        break;
+      }
+      for (i = first; i <= last; i++)
+      {
+        busy[i] = 1;
+        hand_emergency_waveform(i, request->waveforms[next], EMERGENCY_REPEAT);
+      }
+    }
+
+    for (i = 0; i < district_count; i++)
+    {
+      if (!busy[i])
+      {
+        continue;
+      }
+      RTIME started = wait_emergency_waveform(i);
+      if (started - request->requested > latency)
+      {
+        latency = started - request->requested;
+      }
+    }
+  }
+  return latency;
+}
+
+void send_emergency_task(long arg)
+{
+  while (1)
+  {
+    rt_sem_wait(&emergency_sem);
+    smp_rmb();
+    RTIME latency = send_request(&emergency_queue[emergency_queue_head % EMERGENCY_QUEUE_SIZE]);
+
+    // The latency of an emergency is the time until the last district started sending it
+    statistics[STATISTIC_EMERGENCY_COUNT]++;
+    statistics[STATISTIC_EMERGENCY_LATENCY_LAST] = latency;
+    if (latency > statistics[STATISTIC_EMERGENCY_LATENCY_MAX])
+    {
+      statistics[STATISTIC_EMERGENCY_LATENCY_MAX] = latency;
+    }
+    emergency_queue_head++;
+  }
+}
+
+EXPORT_SYMBOL(send_emergency_task);
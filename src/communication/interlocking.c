@@ -0,0 +1,184 @@
+#include "communication/interlocking.h"
+
+#include <rtai.h>
+
+#include "communication/rtai_linux_communication.h"
+#include "telegram/event.h"
+
+/*
+ * The interlocking is only used while command_sem is held, which executes one command at a time,
+ * so it needs no semaphore of its own.
+ */
+
+/**
+ * @struct RouteLock
+ * @brief The elements locked by one route.
+ */
+typedef struct
+{
+    int used;             // The entry holds the locks of a route.
+    unsigned short route; // The route holding the locks.
+    ElementSet elements;  // The elements locked by the route.
+} RouteLock;
+
+static RouteLock route_locks[INTERLOCK_ROUTES];
+static ElementSet locked = {.first_word = INTERLOCK_WORDS, .last_word = -1}; // Union of all route locks
+
+void element_set_clear(ElementSet *set)
+{
+    int w;
+    for (w = set->first_word; w <= set->last_word; w++)
+    {
+        set->bits[w] = 0;
+    }
+    set->first_word = INTERLOCK_WORDS;
+    set->last_word = -1;
+}
+
+int element_set_add(ElementSet *set, int element)
+{
+    if (element < 0 || element >= INTERLOCK_ELEMENTS)
+    {
+        return -1;
+    }
+
+    int w = element / 64;
+    set->bits[w] |= 1ULL << (element % 64);
+    if (w < set->first_word)
+    {
+        set->first_word = w;
+    }
+    if (w > set->last_word)
+    {
+        set->last_word = w;
+    }
+    return 0;
+}
+
+/**
+ * @brief Widens the word range of a set to cover the range of another set.
+ *
+ * @param set The set to widen.
+ * @param other The set whose range is covered.
+ */
+static void element_set_cover(ElementSet *set, const ElementSet *other)
+{
+    if (other->first_word < set->first_word)
+    {
+        set->first_word = other->first_word;
+    }
+    if (other->last_word > set->last_word)
+    {
+        set->last_word = other->last_word;
+    }
+}
+
+static RouteLock *find_route_lock(unsigned short route)
+{
+    int i;
+    for (i = 0; i < INTERLOCK_ROUTES; i++)
+    {
+        if (route_locks[i].used && route_locks[i].route == route)
+        {
+            return &route_locks[i];
+        }
+    }
+    return NULL;
+}
+
+int interlock_route(unsigned short route, const ElementSet *elements)
+{
+    RouteLock *lock = NULL;
+    int i, w;
+
+    if (find_route_lock(route) != NULL)
+    {
+        rt_printk("Fahrstraße %d ist bereits verschlossen\n", route);
+        statistics[STATISTIC_INTERLOCK_CONFLICTS]++;
+        return -1;
+    }
+
+    // Only the words both sets occupy can overlap
+    int first = elements->first_word > locked.first_word ? elements->first_word : locked.first_word;
+    int last = elements->last_word < locked.last_word ? elements->last_word : locked.last_word;
+    for (w = first; w <= last; w++)
+    {
+        unsigned long long conflict = elements->bits[w] & locked.bits[w];
+        if (conflict)
+        {
+            rt_printk("Fahrstraße %d: Element %d ist verschlossen\n", route, w * 64 + __builtin_ctzll(conflict));
+            statistics[STATISTIC_INTERLOCK_CONFLICTS]++;
+            return -1;
+        }
+    }
+
+    for (i = 0; i < INTERLOCK_ROUTES && lock == NULL; i++)
+    {
+        if (!route_locks[i].used)
+        {
+            lock = &route_locks[i];
+        }
+    }
+    if (lock == NULL)
+    {
+        rt_printk("Keine freie Fahrstraße für %d\n", route);
+        return -1;
+    }
+
+    lock->used = 1;
+    lock->route = route;
+    lock->elements = *elements;
+    for (w = elements->first_word; w <= elements->last_word; w++)
+    {
+        locked.bits[w] |= elements->bits[w];
+    }
+    element_set_cover(&locked, elements);
+    return 0;
+}
+
+int interlock_release(unsigned short route, const ElementSet *elements)
+{
+    RouteLock *lock = find_route_lock(route);
+    int released = 0;
+    int w;
+
+    if (lock == NULL)
+    {
+        return -1;
+    }
+    if (elements == NULL)
+    {
+        elements = &lock->elements;
+    }
+
+    // The routes never share an element, so clearing the released bits keeps the union exact
+    int first = elements->first_word > lock->elements.first_word ? elements->first_word : lock->elements.first_word;
+    int last = elements->last_word < lock->elements.last_word ? elements->last_word : lock->elements.last_word;
+    int remaining = 0;
+    for (w = first; w <= last; w++)
+    {
+        unsigned long long release = elements->bits[w] & lock->elements.bits[w];
+        released += __builtin_popcountll(release);
+        lock->elements.bits[w] &= ~release;
+        locked.bits[w] &= ~release;
+    }
+    for (w = lock->elements.first_word; w <= lock->elements.last_word && !remaining; w++)
+    {
+        remaining = lock->elements.bits[w] != 0;
+    }
+    if (!remaining)
+    {
+        element_set_clear(&lock->elements);
+        lock->used = 0;
+    }
+    return released;
+}
+
+int interlock_is_locked(int element)
+{
+    if (element < 0 || element >= INTERLOCK_ELEMENTS)
+    {
+        return 0;
+    }
+    return (locked.bits[element / 64] >> (element % 64)) & 1;
+}
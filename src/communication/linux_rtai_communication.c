@@ -1,17 +1,170 @@
 #include "communication/linux_rtai_communication.h"
 
 #include <rtai_fifos.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <time.h>
+#include <sys/select.h>
+
+#include "communication/session_log.h"
+#include "telegram/system.h"
+#include "telegram/event.h"
+#include "telegram/magnetic.h"
 
 #define FIFO_CMD "/dev/rtf3"
 #define FIFO_ACK "/dev/rtf4"
+#define FIFO_EVENT "/dev/rtf5"
+#define FIFO_CAPTURE "/dev/rtf6"
+#define FIFO_TRACE "/dev/rtf7"
+#define FIFO_UART "/dev/rtf8"
 #define SIZE 1024
+#define STATISTICS_TIMEOUT 200000 /* Time to wait for the statistics in microseconds */
+#define TRANSMIT_TIMEOUT 2000000   /* Time to wait for a packet to reach the rails in microseconds */
+#define TRANSMIT_REPEAT_TIME 100000 /* Additional time to wait per repetition in microseconds */
+#define ROUTE_STEP_TIME 150000      /* Additional time to wait per accessory of a route in microseconds */
+#define ACK_TIMEOUT_INITIAL 50000   /* Retry timeout before the first round trip was measured in microseconds */
+#define ACK_TIMEOUT_MIN 1000        /* Lower bound of the retry timeout in microseconds */
+#define ACK_TIMEOUT_ONCE_MIN 500000 /* Lower bound of the retry timeout of commands which must not run twice */
+#define ACK_TIMEOUT_MAX 1000000     /* Upper bound of the retry timeout, also with backoff, in microseconds */
+#define ACK_CLOCK_GRANULARITY 100   /* Smallest variance term added to the smoothed round trip in microseconds */
 
-int send_with_ack(unsigned short data, int attempts)
+/**
+ * @brief Returns the path of a fifo, which can be replaced by an environment variable.
+ *
+ * DCC_FIFO_CMD, DCC_FIFO_ACK, DCC_FIFO_EVENT, DCC_FIFO_CAPTURE, DCC_FIFO_TRACE and DCC_FIFO_UART point the prompt
+ * and the tools to named pipes standing in for the module.
+ *
+ * @param variable The environment variable.
+ * @param path The path of the RTAI fifo.
+ * @return const char* The path to open.
+ */
+static const char *fifo_path(const char *variable, const char *path)
+{
+    const char *value = getenv(variable);
+    return value != NULL && value[0] != '\0' ? value : path;
+}
+
+/*
+ * Round trip estimation per command type, indexed by the type bits of the header word.
+ */
+static AckStatistics ack_statistics[4];
+
+/**
+ * @brief Returns the current monotonic time in microseconds.
+ */
+static long long now_us(void)
 {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Returns the retry timeout of a command type derived from its round trip estimation.
+ *
+ * @param stats The estimation of the command type.
+ * @return long The timeout in microseconds.
+ */
+static long ack_timeout(const AckStatistics *stats)
+{
+    if (stats->samples == 0)
+    {
+        return ACK_TIMEOUT_INITIAL;
+    }
+
+    long variance = 4 * stats->rttvar;
+    long timeout = stats->srtt + (variance > ACK_CLOCK_GRANULARITY ? variance : ACK_CLOCK_GRANULARITY);
+    if (timeout < ACK_TIMEOUT_MIN)
+    {
+        return ACK_TIMEOUT_MIN;
+    }
+    if (timeout > ACK_TIMEOUT_MAX)
+    {
+        return ACK_TIMEOUT_MAX;
+    }
+    return timeout;
+}
+
+/**
+ * @brief Tells whether a command must not be executed twice by a retransmission.
+ *
+ * Commands carry no sequence number, the module executes a retransmitted one again. An accessory
+ * activation would fire its solenoid twice, scheduled commands, transmissions and routes would be sent
+ * twice and a statistics reset would drop the worst values measured in between, so these are only
+ * retransmitted after ACK_TIMEOUT_ONCE_MIN. The module
+ * acknowledges within the write, an acknowledgement missing that long means it did not serve the command.
+ *
+ * @param command The command, starting with the header word.
+ * @param count The number of words of the command.
+ * @return int 1 if the command must not run twice, 0 otherwise.
+ */
+static int executes_once(const unsigned short *command, int count)
+{
+    SystemDataConverter converter = {.us = command[0]};
+
+    // A deactivation only switches the output off again
+    if (converter.sd.type == 0b10)
+    {
+        MagneticDataConverter magnetic = {.us = command[0]};
+        return magnetic.md.enable;
+    }
+    if (converter.sd.type != 0b11)
+    {
+        return 0;
+    }
+    switch (converter.sd.opcode)
+    {
+    case SYSTEM_TRANSMIT:
+    case SYSTEM_ROUTE:
+    case SYSTEM_SCHEDULE:
+        return 1;
+    case SYSTEM_STATISTICS:
+        return count > 1 && command[1] == STATISTICS_RESET;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Updates the round trip estimation of a command type with a new measurement.
+ *
+ * @param stats The estimation of the command type.
+ * @param rtt The measured round trip in microseconds.
+ */
+static void ack_sample(AckStatistics *stats, long rtt)
+{
+    if (stats->samples == 0)
+    {
+        stats->srtt = rtt;
+        stats->rttvar = rtt / 2;
+    }
+    else
+    {
+        long error = stats->srtt > rtt ? stats->srtt - rtt : rtt - stats->srtt;
+        stats->rttvar = (3 * stats->rttvar + error) / 4;
+        stats->srtt = (7 * stats->srtt + rtt) / 8;
+    }
+    stats->samples++;
+}
+
+/**
+ * @brief Writes a command buffer and waits for the acknowledgement of its first word.
+ *
+ * @param buffer The command, starting with the header word which gets acknowledged.
+ * @param size The size of the command in bytes.
+ * @param attempts The maximum number of transmission attempts.
+ * @return int Returns 0 on success, a negative value on failure.
+ */
+static int send_buffer_with_ack(const void *buffer, size_t size, int attempts)
+{
+    unsigned short data;
+    memcpy(&data, buffer, sizeof(data));
+
     // Open the command FIFO in write-only mode
-    int fd_cmd = open(FIFO_CMD, O_WRONLY);
+    int fd_cmd = open(fifo_path("DCC_FIFO_CMD", FIFO_CMD), O_WRONLY);
     if (fd_cmd < 0)
     {
         // If the command FIFO can't be opened, log the error
@@ -20,7 +173,7 @@ int send_with_ack(unsigned short data, int attempts)
     }
 
     // Open the acknowledgment FIFO in read-only, non-blocking mode
-    int fd_ack = open(FIFO_ACK, O_RDONLY | O_NONBLOCK);
+    int fd_ack = open(fifo_path("DCC_FIFO_ACK", FIFO_ACK), O_RDONLY | O_NONBLOCK);
     if (fd_ack < 0)
     {
         // If the acknowledgment FIFO can't be opened, log the error, close the command FIFO
@@ -29,38 +182,396 @@ int send_with_ack(unsigned short data, int attempts)
         return fd_ack;
     }
 
+    // Acknowledges which arrived after an earlier command gave up would be taken for this one
+    unsigned short stale;
+    while (read(fd_ack, &stale, sizeof(stale)) > 0)
+    {
+    }
+
+    AckStatistics *stats = &ack_statistics[(data >> 13) & 0x3];
+    long timeout = ack_timeout(stats);
+    if (executes_once(buffer, size / sizeof(unsigned short)) && timeout < ACK_TIMEOUT_ONCE_MIN)
+    {
+        timeout = ACK_TIMEOUT_ONCE_MIN;
+    }
+    stats->commands++;
+    session_log_write(buffer, size / sizeof(unsigned short));
+
     // Attempt to send the command multiple times (up to 'attempts')
     for (int attempt = 0; attempt < attempts; attempt++)
     {
-        // Write the command data to the command FIFO
-        write(fd_cmd, &data, sizeof(data));
+        if (attempt > 0)
+        {
+            stats->retries++;
+        }
 
-        // Pause briefly (50 milliseconds) to wait for an acknowledgment
-        usleep(50000);
+        // Write the command data to the command FIFO
+        long long sent = now_us();
+        write(fd_cmd, buffer, size);
 
-        unsigned short ack;
-        // Try reading the acknowledgment from the FIFO
-        if (read(fd_ack, &ack, sizeof(ack)) == sizeof(ack))
+        // Wait for the acknowledgment until the timeout of this attempt expires
+        long long deadline = sent + timeout;
+        long long now;
+        while ((now = now_us()) < deadline)
         {
+            fd_set fds;
+            FD_ZERO(&fds);
+            FD_SET(fd_ack, &fds);
+            struct timeval tv = {.tv_sec = (deadline - now) / 1000000, .tv_usec = (deadline - now) % 1000000};
+            if (select(fd_ack + 1, &fds, NULL, NULL, &tv) <= 0)
+            {
+                break;
+            }
+
+            unsigned short ack;
+            // Try reading the acknowledgment from the FIFO
+            if (read(fd_ack, &ack, sizeof(ack)) != sizeof(ack))
+            {
+                continue;
+            }
             // Check if the acknowledge received is from this command
-            if ((0x7FFF & data) == (0x7FFF & ack))
+            if ((0x7FFF & data) != (0x7FFF & ack))
+            {
+                continue;
+            }
+            // A cleared highest bit rejects the command, retrying would not change the answer
+            if ((0x8000 & ack) == 0)
+            {
+                stats->rejections++;
+                printf("Command rejected by the module!\n");
+                close(fd_cmd);
+                close(fd_ack);
+                return -2;
+            }
+
+            // A retransmitted command can't tell which attempt was acknowledged, only first attempts are measured
+            if (attempt == 0)
             {
-                // If the highest bit of ack is set, the command is acknowledged
-                if ((0x8000 & ack) == 0x8000)
-                {
-                    // Close FIFOs
-                    close(fd_cmd);
-                    close(fd_ack);
-                    return 0;
-                }
+                ack_sample(stats, now_us() - sent);
             }
+            // Close FIFOs
+            close(fd_cmd);
+            close(fd_ack);
+            return 0;
         }
+
+        // The module is late, back off until the timeout bound
+        timeout = timeout * 2 < ACK_TIMEOUT_MAX ? timeout * 2 : ACK_TIMEOUT_MAX;
     }
 
     // After all attempts, if no valid acknowledgment is received, log the failure
+    stats->failures++;
     printf("Failed to send command!\n");
     // Close FIFOs
     close(fd_cmd);
     close(fd_ack);
     return -1;
-}
\ No newline at end of file
+}
+
+int send_with_ack(unsigned short data, int attempts)
+{
+    return send_buffer_with_ack(&data, sizeof(data), attempts);
+}
+
+int send_raw_with_ack(const unsigned short *command, int count, int attempts)
+{
+    return send_buffer_with_ack(command, count * sizeof(unsigned short), attempts);
+}
+
+int send_system_with_ack(unsigned short opcode, const unsigned short *payload, int count, int attempts)
+{
+    unsigned short buffer[1 + SYSTEM_MAX_PAYLOAD];
+
+    if (count < 0 || count > SYSTEM_MAX_PAYLOAD)
+    {
+        printf("Invalid payload size %d for system command!\n", count);
+        return -1;
+    }
+
+    SystemDataConverter converter = {
+        .sd = {
+            .length = count,
+            .opcode = opcode,
+            .type = 0b11,
+            .ack = 0,
+        }};
+    buffer[0] = converter.us;
+    if (count > 0)
+    {
+        memcpy(&buffer[1], payload, count * sizeof(unsigned short));
+    }
+
+    return send_buffer_with_ack(buffer, (1 + count) * sizeof(unsigned short), attempts);
+}
+
+int send_scheduled_with_ack(int absolute, unsigned long long time, const unsigned short *command, int count, int attempts)
+{
+    unsigned short payload[5 + SCHEDULE_MAX_COMMAND];
+
+    if (count < 1 || count > SCHEDULE_MAX_COMMAND)
+    {
+        printf("Invalid size %d for scheduled command!\n", count);
+        return -1;
+    }
+
+    payload[0] = absolute ? SCHEDULE_AT : 0;
+    for (int i = 0; i < 4; i++)
+    {
+        payload[1 + i] = (time >> (16 * i)) & 0xFFFF;
+    }
+    memcpy(&payload[5], command, count * sizeof(unsigned short));
+
+    return send_system_with_ack(SYSTEM_SCHEDULE, payload, 5 + count, attempts);
+}
+
+int open_event_fifo(void)
+{
+    int fd_event = open(fifo_path("DCC_FIFO_EVENT", FIFO_EVENT), O_RDONLY | O_NONBLOCK);
+    if (fd_event < 0)
+    {
+        printf("Failed to open event fifo with %d!\n", fd_event);
+    }
+    return fd_event;
+}
+
+int open_capture_fifo(void)
+{
+    int fd_capture = open(fifo_path("DCC_FIFO_CAPTURE", FIFO_CAPTURE), O_RDONLY | O_NONBLOCK);
+    if (fd_capture < 0)
+    {
+        printf("Failed to open capture fifo with %d!\n", fd_capture);
+    }
+    return fd_capture;
+}
+
+int open_trace_fifo(void)
+{
+    int fd_trace = open(fifo_path("DCC_FIFO_TRACE", FIFO_TRACE), O_RDONLY | O_NONBLOCK);
+    if (fd_trace < 0)
+    {
+        printf("Failed to open trace fifo with %d!\n", fd_trace);
+    }
+    return fd_trace;
+}
+
+int open_uart_fifo(void)
+{
+    int fd_uart = open(fifo_path("DCC_FIFO_UART", FIFO_UART), O_RDONLY | O_NONBLOCK);
+    if (fd_uart < 0)
+    {
+        printf("Failed to open UART fifo with %d!\n", fd_uart);
+    }
+    return fd_uart;
+}
+
+/**
+ * @brief Reads one complete record from the event fifo.
+ *
+ * @param fd_event The file descriptor of the event fifo.
+ * @param event Receives the record.
+ * @param timeout The longest time to wait for each part of the record in microseconds.
+ * @return int Returns 0 on success, a negative value if no complete record arrived in time.
+ */
+static int read_event(int fd_event, EventData *event, long timeout)
+{
+    size_t buffered = 0;
+    while (buffered < sizeof(*event))
+    {
+        fd_set fds;
+        FD_ZERO(&fds);
+        FD_SET(fd_event, &fds);
+        struct timeval tv = {.tv_sec = timeout / 1000000, .tv_usec = timeout % 1000000};
+        if (select(fd_event + 1, &fds, NULL, NULL, &tv) <= 0)
+        {
+            return -1;
+        }
+
+        ssize_t r = read(fd_event, (char *)event + buffered, sizeof(*event) - buffered);
+        if (r > 0)
+        {
+            buffered += r;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Discards all records which are still in the event fifo.
+ *
+ * @param fd_event The file descriptor of the event fifo.
+ */
+static void drain_events(int fd_event)
+{
+    char stale[SIZE];
+    while (read(fd_event, stale, sizeof(stale)) > 0)
+    {
+    }
+}
+
+/**
+ * @brief Requests the statistics of the module and waits for the answer.
+ *
+ * @param values Receives the value of each statistic, indexed by statistic_id.
+ * @param reset Let the worst values of the module start over after the answer.
+ * @return int Returns 0 on success, a negative value if the module did not answer.
+ */
+static int receive_statistics(unsigned long long values[], int reset)
+{
+    int fd_event = open_event_fifo();
+    if (fd_event < 0)
+    {
+        return fd_event;
+    }
+
+    // Discard records which do not belong to the answer
+    drain_events(fd_event);
+
+    unsigned short payload = STATISTICS_RESET;
+    if (send_system_with_ack(SYSTEM_STATISTICS, &payload, reset ? 1 : 0, 3) != 0)
+    {
+        close(fd_event);
+        return -1;
+    }
+
+    int received = 0;
+    int expected = -1;
+    EventData event;
+    while (expected < 0 || received < expected)
+    {
+        if (read_event(fd_event, &event, STATISTICS_TIMEOUT) != 0)
+        {
+            printf("Module did not answer the statistics request!\n");
+            close(fd_event);
+            return -1;
+        }
+
+        if (event.kind == EVENT_STATISTIC && event.data < STATISTIC_COUNT)
+        {
+            values[event.data] = event.value;
+            expected = event.count;
+            received++;
+        }
+    }
+
+    close(fd_event);
+    return 0;
+}
+
+int request_statistics(unsigned long long values[])
+{
+    return receive_statistics(values, 0);
+}
+
+int request_statistics_reset(unsigned long long values[])
+{
+    return receive_statistics(values, 1);
+}
+
+/**
+ * @brief Sends a system command and waits for the completion record it requests.
+ *
+ * @param opcode The operation requested from the module.
+ * @param payload The payload words following the header.
+ * @param count The number of payload words.
+ * @param kind The kind of the completion record.
+ * @param data The data word the completion record refers to.
+ * @param timeout The longest time to wait for the completion in microseconds.
+ * @param completion Receives the completion record.
+ * @param attempts The maximum number of transmission attempts.
+ * @return int Returns 0 on success, -2 if the module rejected the command, -1 on other failures.
+ */
+static int send_system_and_wait(unsigned short opcode, const unsigned short *payload, int count, unsigned short kind,
+                                unsigned short data, long timeout, EventData *completion, int attempts)
+{
+    int fd_event = open_event_fifo();
+    if (fd_event < 0)
+    {
+        return fd_event;
+    }
+
+    // Discard records which do not belong to the answer
+    drain_events(fd_event);
+
+    int result = send_system_with_ack(opcode, payload, count, attempts);
+    if (result != 0)
+    {
+        close(fd_event);
+        return result;
+    }
+
+    while (read_event(fd_event, completion, timeout) == 0)
+    {
+        if (completion->kind == kind && completion->data == data)
+        {
+            close(fd_event);
+            return 0;
+        }
+    }
+
+    printf("Command was not transmitted in time!\n");
+    close(fd_event);
+    return -1;
+}
+
+int send_transmit_with_ack(unsigned short data, int repetitions, unsigned long long *first, unsigned long long *last, int attempts)
+{
+    unsigned short payload[] = {data, repetitions};
+    EventData event;
+
+    // The ack bit is never set in the reported word
+    if (send_system_and_wait(SYSTEM_TRANSMIT, payload, 2, EVENT_TRANSMITTED, data & 0x7FFF,
+                             TRANSMIT_TIMEOUT + repetitions * TRANSMIT_REPEAT_TIME, &event, attempts) != 0)
+    {
+        return -1;
+    }
+    *first = event.time;
+    *last = event.value;
+    return event.count;
+}
+
+int send_route_with_ack(unsigned short route, const unsigned short *steps, int count, const unsigned short *sections, int section_count,
+                        unsigned long long *first, unsigned long long *last, int attempts)
+{
+    unsigned short payload[2 + ROUTE_MAX_STEPS + ROUTE_MAX_SECTIONS];
+    EventData event;
+
+    if (count < 1 || count > ROUTE_MAX_STEPS || section_count < 0 || section_count > ROUTE_MAX_SECTIONS)
+    {
+        printf("Invalid route size %d with %d sections!\n", count, section_count);
+        return -1;
+    }
+    payload[0] = route;
+    payload[1] = count;
+    memcpy(&payload[2], steps, count * sizeof(unsigned short));
+    memcpy(&payload[2 + count], sections, section_count * sizeof(unsigned short));
+
+    int result = send_system_and_wait(SYSTEM_ROUTE, payload, 2 + count + section_count, EVENT_ROUTE, route,
+                                      TRANSMIT_TIMEOUT + count * ROUTE_STEP_TIME, &event, attempts);
+    if (result != 0)
+    {
+        return result;
+    }
+    *first = event.time;
+    *last = event.value;
+    return event.count;
+}
+
+int release_route(unsigned short route, const unsigned short *elements, int count, int attempts)
+{
+    unsigned short payload[1 + ROUTE_MAX_STEPS + ROUTE_MAX_SECTIONS];
+
+    if (count < 0 || count > ROUTE_MAX_STEPS + ROUTE_MAX_SECTIONS)
+    {
+        printf("Invalid number of elements %d!\n", count);
+        return -1;
+    }
+    payload[0] = route;
+    memcpy(&payload[1], elements, count * sizeof(unsigned short));
+    return send_system_with_ack(SYSTEM_RELEASE, payload, 1 + count, attempts);
+}
+
+void get_ack_statistics(unsigned short type, AckStatistics *stats)
+{
+    *stats = ack_statistics[type & 0x3];
+    stats->timeout = ack_timeout(&ack_statistics[type & 0x3]);
+}
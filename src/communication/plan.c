@@ -0,0 +1,182 @@
+#include "communication/plan.h"
+
+#include "communication/railroad_communication.h"
+#include "communication/rtai_linux_communication.h"
+#include "communication/bitslice.h"
+#include "communication/consist.h"
+#include "communication/protocol.h"
+#include "telegram/event.h"
+
+// The plan is computed in microseconds, so the module needs no 64-bit divisions
+#define PERIOD_LOC_US (PERIOD_LOC_TASK / 1000)
+#define RELEASED_MULTIPLE (PLAN_REFRESH_MAX / PERIOD_LOC_TASK) /* Refresh interval of a released slot */
+
+#define SLOT_UNPLANNED 0 /* The slot has no state to refresh */
+#define SLOT_PLANNED 1   /* The slot is refreshed at the planned interval of its district */
+#define SLOT_RELEASED 2  /* The slot is refreshed at the longest interval */
+
+static long packet_time;          // Duration of the longest packet in microseconds
+static int locomotive_percent;    // Share of a district left for locomotive packets
+static int planned[LOC_MSQ_SIZE]; // State of the slot in the plan (SLOT_UNPLANNED, SLOT_PLANNED, SLOT_RELEASED)
+
+void init_plan(void)
+{
+  // The accessory packets are DCC packets as long as those to a short address
+  int i;
+  packet_time = 0;
+  for (i = 0; i < district_count; i++)
+  {
+    long time = protocol_packet_time(PROTOCOL_DCC_SHORT, districts[i].uart);
+    packet_time = time > packet_time ? time : packet_time;
+  }
+
+  // A slot of another protocol may take longer, with all its repetitions
+  for (i = 0; i < LOC_MSQ_SIZE; i++)
+  {
+    long time = protocol_packet_time(locomotive_protocol(i + 1), districts[district_of_locomotive(i + 1)].uart);
+    packet_time = time > packet_time ? time : packet_time;
+  }
+
+  // Each accessory activation is followed by its deactivation
+  int accessory_percent = (int)(2 * packet_time * 100 / (PERIOD_MAG_TASK / 1000)) + 1;
+  locomotive_percent = 100 - accessory_percent - PLAN_EMERGENCY_PERCENT;
+  rt_printk("Paketdauer max. %ld us, %d %% jedes Bezirks für Loks\n", packet_time, locomotive_percent);
+}
+
+/**
+ * @brief Returns the refresh interval of a district as a multiple of PERIOD_LOC_TASK.
+ *
+ * @param count The number of planned slots in the district.
+ * @param released The number of released slots in the district.
+ * @return int The multiple, more than RELEASED_MULTIPLE if the slots don't fit.
+ */
+static int refresh_multiple(int count, int released)
+{
+  // The released slots take their packets at the longest interval first
+  long period = PERIOD_LOC_US - released * packet_time * 100 / locomotive_percent / RELEASED_MULTIPLE;
+  if (period <= 0)
+  {
+    return RELEASED_MULTIPLE + 1;
+  }
+
+  // count packets per interval must fit into what is left of the share of the locomotives
+  long needed = count * packet_time * 100 / locomotive_percent;
+  int multiple = (int)((needed + period - 1) / period);
+  return multiple < 1 ? 1 : multiple;
+}
+
+/**
+ * @brief Counts the planned and the released slots per district.
+ */
+static void count_districts(int counts[], int released[])
+{
+  int i;
+  for (i = 0; i < district_count; i++)
+  {
+    counts[i] = 0;
+    released[i] = 0;
+  }
+  for (i = 0; i < LOC_MSQ_SIZE; i++)
+  {
+    if (planned[i] == SLOT_PLANNED)
+    {
+      counts[district_of_locomotive(i + 1)]++;
+    }
+    else if (planned[i] == SLOT_RELEASED)
+    {
+      released[district_of_locomotive(i + 1)]++;
+    }
+  }
+}
+
+void plan_update(void)
+{
+  int counts[DISTRICT_MAX * SHARD_MAX], released[DISTRICT_MAX * SHARD_MAX];
+  int i, j;
+  unsigned long refresh_max = 0, load_max = 0;
+
+  count_districts(counts, released);
+  for (i = 0; i < LOC_MSQ_SIZE; i++)
+  {
+    int district = district_of_locomotive(i + 1);
+    locomotive_slots[i].deadline.planned =
+        planned[i] == SLOT_RELEASED ? RELEASED_MULTIPLE : refresh_multiple(counts[district], released[district]);
+  }
+  for (i = 0; i < CONSIST_MAX; i++)
+  {
+    if (!consists[i].used)
+    {
+      continue;
+    }
+    Deadline *first = &locomotive_slots[consists[i].members[0]].deadline;
+    for (j = 1; j < consists[i].member_count; j++)
+    {
+      int multiple = locomotive_slots[consists[i].members[j]].deadline.planned;
+      first->planned = multiple > first->planned ? multiple : first->planned;
+    }
+  }
+
+  for (i = 0; i < district_count; i++)
+  {
+    int multiple = refresh_multiple(counts[i], released[i]);
+    unsigned long load = counts[i] * packet_time * 100 / (multiple * PERIOD_LOC_US) +
+                         released[i] * packet_time * 100 / (RELEASED_MULTIPLE * PERIOD_LOC_US);
+    unsigned long refresh = counts[i] > 0 ? multiple * PERIOD_LOC_US : 0;
+    if (released[i] > 0 && refresh < PLAN_REFRESH_MAX / 1000)
+    {
+      refresh = PLAN_REFRESH_MAX / 1000;
+    }
+    refresh_max = refresh > refresh_max ? refresh : refresh_max;
+    load_max = load > load_max ? load : load_max;
+  }
+  statistics[STATISTIC_PLAN_REFRESH_MAX] = refresh_max * 1000ULL;
+  statistics[STATISTIC_PLAN_LOAD_MAX] = load_max + 100 - locomotive_percent - PLAN_EMERGENCY_PERCENT;
+}
+
+int plan_admit(int slot)
+{
+  int counts[DISTRICT_MAX * SHARD_MAX], released[DISTRICT_MAX * SHARD_MAX];
+
+  if (slot < 0 || slot >= LOC_MSQ_SIZE)
+  {
+    return -1;
+  }
+  if (planned[slot] == SLOT_PLANNED)
+  {
+    return 0;
+  }
+
+  // A released slot gives its share at the longest interval back when it is planned again
+  count_districts(counts, released);
+  int district = district_of_locomotive(slot + 1);
+  int multiple = refresh_multiple(counts[district] + 1, released[district] - (planned[slot] == SLOT_RELEASED));
+  if (multiple * PERIOD_LOC_US > PLAN_REFRESH_MAX / 1000)
+  {
+    statistics[STATISTIC_PLAN_REFUSED]++;
+    rt_printk("Lok %d abgewiesen, Bezirk %d ist ausgelastet\n", slot + 1, district);
+    return -1;
+  }
+  planned[slot] = SLOT_PLANNED;
+  plan_update();
+  return 0;
+}
+
+void plan_release(int slot)
+{
+  if (slot < 0 || slot >= LOC_MSQ_SIZE || planned[slot] != SLOT_PLANNED)
+  {
+    return;
+  }
+  planned[slot] = SLOT_RELEASED;
+  plan_update();
+}
+
+int plan_released(int slot)
+{
+  return slot >= 0 && slot < LOC_MSQ_SIZE && planned[slot] == SLOT_RELEASED;
+}
+
+RTIME plan_phase(int slot)
+{
+  return (RTIME)(slot * (PERIOD_LOC_US / LOC_MSQ_SIZE)) * 1000;
+}
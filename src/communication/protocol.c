@@ -0,0 +1,182 @@
+#include "communication/protocol.h"
+
+#include "communication/railroad_communication.h"
+#include "communication/protocol_config.h"
+#include "telegram/motorola.h"
+#include "telegram/uart.h"
+
+/*
+ * The policies of the protocols, POLICY(protocol, build, encode, signal, bits, ones, repeat, decoders):
+ * - build: Builds the telegram of a slot from the state of the locomotive.
+ * - encode: The encoder with the timing of the signal compiled in.
+ * - bits: Bits of a telegram, the first ones of them are always 1.
+ * - repeat: Number of times a telegram is sent back to back.
+ * - decoders: Highest address of a decoder.
+ */
+#define LOCOMOTIVE_PROTOCOLS(POLICY)                                                                                \
+  POLICY(PROTOCOL_DCC_SHORT, build_dcc_short, encode_waveform, DCC_SIGNAL, length, 15, 1, 127)                      \
+  POLICY(PROTOCOL_DCC_LONG, build_dcc_long, encode_waveform, DCC_SIGNAL, LONG_LOCOMOTIVE_LENGTH, 15, 1,             \
+         LONG_ADDRESS_MAX)                                                                                          \
+  POLICY(PROTOCOL_MOTOROLA, build_motorola, encode_motorola, MOTOROLA_SIGNAL, MOTOROLA_LENGTH, 0, 2,                \
+         MOTOROLA_ADDRESS_MAX)
+
+/*
+ * Longest time of a telegram on the rails in microseconds, every bit but the fixed ones takes the
+ * longer of both bits. Takes the signal expanded into its six values.
+ */
+#define SIGNAL_TIME(bits, ones, one_high, one_low, zero_high, zero_low, pause, dcc_packet)                         \
+  ((ones) * (((one_high) + (one_low)) / 1000) +                                                                     \
+   ((bits) - (ones)) * (((one_high) + (one_low) > (zero_high) + (zero_low) ? (one_high) + (one_low)                 \
+                                                                           : (zero_high) + (zero_low)) / 1000) +    \
+   (pause) / 1000)
+
+/*
+ * Whether a telegram of the signal can be sent by a UART backend. Takes the signal expanded into its six values.
+ */
+#define SIGNAL_DCC(one_high, one_low, zero_high, zero_low, pause, dcc_packet) (dcc_packet)
+
+/**
+ * @struct SlotProtocol
+ * @brief The decoder of a locomotive slot.
+ */
+typedef struct
+{
+  int protocol;  // Protocol of the decoder.
+  int decoder;   // Address of the decoder in its protocol.
+  int direction; // Direction a Motorola decoder drives in, it has no direction bit.
+} SlotProtocol;
+
+static SlotProtocol slot_protocols[LOC_MSQ_SIZE];
+
+DEFINE_WAVEFORM_ENCODER(encode_motorola, MOTOROLA_SIGNAL)
+
+static unsigned long long build_dcc_short(SlotProtocol *slot, LocomotiveData data)
+{
+  data.address = slot->decoder;
+  return buildLocomotiveTelegram(data);
+}
+
+static unsigned long long build_dcc_long(SlotProtocol *slot, LocomotiveData data)
+{
+  return buildLongLocomotiveTelegram(slot->decoder, data);
+}
+
+static unsigned long long build_motorola(SlotProtocol *slot, LocomotiveData data)
+{
+  // Speed code 1 turns the decoder around, the next refresh drives it again
+  if (data.direction != slot->direction && data.speed != 1)
+  {
+    slot->direction = data.direction;
+    return buildMotorolaTelegram(slot->decoder, data.light, 1);
+  }
+  // Speed step 1 is the emergency stop of DCC, a Motorola decoder only knows the stop
+  return buildMotorolaTelegram(slot->decoder, data.light, data.speed == 1 ? 0 : data.speed);
+}
+
+/**
+ * @brief Returns the longest time of a DCC telegram on a serial line.
+ *
+ * A serial line stretches the half 0-bits, a telegram of zeros after the preamble takes the most bytes.
+ *
+ * @param bits The bits of the telegram.
+ * @return long The time in microseconds, 0 if it can't be encoded.
+ */
+static long uart_time(int bits)
+{
+  unsigned char bytes[UART_MAX_BYTES];
+  unsigned long long zeros = ~0ULL << 50 | 1ULL << (63 - (bits - 1));
+  int count = encodeUartTelegram(zeros, bits, bytes, UART_MAX_BYTES);
+  return count < 0 ? 0 : count * UART_FRAME_BITS * (UART_BIT_TIME / 1000);
+}
+
+/**
+ * @brief Returns the highest decoder address of a protocol.
+ *
+ * @param protocol The protocol.
+ * @return int The address, 0 for an unknown protocol.
+ */
+static int decoder_max(int protocol)
+{
+  switch (protocol)
+  {
+#define DECODER_POLICY(protocol, build, encode, signal, bits, ones, repeat, decoders) \
+  case protocol:                                                                      \
+    return decoders;
+    LOCOMOTIVE_PROTOCOLS(DECODER_POLICY)
+#undef DECODER_POLICY
+  }
+  return 0;
+}
+
+void init_protocol(void)
+{
+  int i;
+
+  encode_motorola_init();
+  for (i = 0; i < LOC_MSQ_SIZE; i++)
+  {
+    slot_protocols[i].protocol = PROTOCOL_DCC_SHORT;
+    slot_protocols[i].decoder = i + 1;
+    slot_protocols[i].direction = 1;
+  }
+
+  for (i = 0; i < sizeof(locomotive_config) / sizeof(locomotive_config[0]); i++)
+  {
+    const LocomotiveConfig *config = &locomotive_config[i];
+    if (config->address < 1 || config->address > LOC_MSQ_SIZE || config->decoder < 1 ||
+        config->decoder > decoder_max(config->protocol))
+    {
+      rt_printk("Locomotive %d ignored, protocol %d or decoder %d is invalid\n", config->address, config->protocol,
+                config->decoder);
+      continue;
+    }
+    slot_protocols[config->address - 1].protocol = config->protocol;
+    slot_protocols[config->address - 1].decoder = config->decoder;
+  }
+}
+
+int encode_locomotive(LocomotiveData data, Waveform *waveform)
+{
+  // Locomotives without a slot take their address as a short address
+  SlotProtocol own = {.protocol = PROTOCOL_DCC_SHORT, .decoder = data.address, .direction = 1};
+  SlotProtocol *slot = data.address >= 1 && data.address <= LOC_MSQ_SIZE ? &slot_protocols[data.address - 1] : &own;
+
+  switch (slot->protocol)
+  {
+#define ENCODE_POLICY(protocol, build, encode, signal, bits, ones, repeat, decoders) \
+  case protocol:                                                                     \
+    encode(build(slot, data), bits, waveform);                                       \
+    return repeat;
+    LOCOMOTIVE_PROTOCOLS(ENCODE_POLICY)
+#undef ENCODE_POLICY
+  }
+
+  // Not reached, init_protocol() only keeps known protocols
+  encode_waveform(build_dcc_short(&own, data), length, waveform);
+  return 1;
+}
+
+int locomotive_protocol(int address)
+{
+  return address >= 1 && address <= LOC_MSQ_SIZE ? slot_protocols[address - 1].protocol : PROTOCOL_DCC_SHORT;
+}
+
+long protocol_packet_time(int protocol, int uart)
+{
+  long time;
+
+  switch (protocol)
+  {
+#define TIME_POLICY(protocol, build, encode, signal, bits, ones, repeat, decoders) \
+  case protocol:                                                                   \
+    time = SIGNAL_TIME(bits, ones, signal);                                        \
+    if (uart && SIGNAL_DCC(signal) && uart_time(bits) > time)                      \
+    {                                                                              \
+      time = uart_time(bits);                                                      \
+    }                                                                              \
+    return repeat * time;
+    LOCOMOTIVE_PROTOCOLS(TIME_POLICY)
+#undef TIME_POLICY
+  }
+  return 0;
+}
@@ -0,0 +1,137 @@
+#include "communication/pulse.h"
+
+#include "communication/railroad_communication.h"
+#include "communication/rtai_linux_communication.h"
+#include "communication/bitslice.h"
+#include "telegram/event.h"
+
+RT_TASK pulse_task;
+SEM pulse_sem;       // Signaled when the earliest deactivation changed
+SEM pulse_queue_sem; // Guards the queue
+
+/**
+ * @struct PulseOff
+ * @brief A pending deactivation packet.
+ */
+typedef struct
+{
+  RTIME due;         // Time the deactivation is sent in nanoseconds.
+  MagneticData data; // The deactivation packet.
+} PulseOff;
+
+// Binary min-heap of the pending deactivations ordered by their due time
+static PulseOff pulse_queue[PULSE_QUEUE_SIZE];
+static int pulse_count = 0;
+
+static Waveform pulse_waveform; // Waveform of the current deactivation packet
+
+static void pulse_swap(int a, int b)
+{
+  PulseOff tmp = pulse_queue[a];
+  pulse_queue[a] = pulse_queue[b];
+  pulse_queue[b] = tmp;
+}
+
+static void pulse_sift_up(int i)
+{
+  while (i > 0 && pulse_queue[(i - 1) / 2].due > pulse_queue[i].due)
+  {
+    pulse_swap(i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+static void pulse_sift_down(int i)
+{
+  while (1)
+  {
+    int smallest = i;
+    int left = 2 * i + 1, right = 2 * i + 2;
+    if (left < pulse_count && pulse_queue[left].due < pulse_queue[smallest].due)
+    {
+      smallest = left;
+    }
+    if (right < pulse_count && pulse_queue[right].due < pulse_queue[smallest].due)
+    {
+      smallest = right;
+    }
+    if (smallest == i)
+    {
+      return;
+    }
+    pulse_swap(i, smallest);
+    i = smallest;
+  }
+}
+
+int schedule_pulse_off(MagneticData mag, RTIME activated)
+{
+  int i;
+  mag.enable = 0;
+
+  rt_sem_wait(&pulse_queue_sem);
+  // A solenoid activated again keeps its pending deactivation, only later
+  for (i = 0; i < pulse_count; i++)
+  {
+    if (pulse_queue[i].data.address == mag.address && pulse_queue[i].data.device == mag.device)
+    {
+      pulse_queue[i].data = mag;
+      pulse_queue[i].due = activated + PULSE_TIME;
+      pulse_sift_down(i);
+      rt_sem_signal(&pulse_queue_sem);
+      return 0;
+    }
+  }
+  if (pulse_count >= PULSE_QUEUE_SIZE)
+  {
+    rt_sem_signal(&pulse_queue_sem);
+    return -1;
+  }
+  pulse_queue[pulse_count].data = mag;
+  pulse_queue[pulse_count].due = activated + PULSE_TIME;
+  pulse_sift_up(pulse_count++);
+  int earliest = pulse_queue[0].data.address == mag.address && pulse_queue[0].data.device == mag.device;
+  rt_sem_signal(&pulse_queue_sem);
+
+  // Wake the pulse task so it waits for the new earliest deactivation
+  if (earliest)
+  {
+    rt_sem_signal(&pulse_sem);
+  }
+  return 0;
+}
+
+void send_pulse_task(long arg)
+{
+  while (1)
+  {
+    rt_sem_wait(&pulse_queue_sem);
+    if (pulse_count == 0)
+    {
+      rt_sem_signal(&pulse_queue_sem);
+      rt_sem_wait(&pulse_sem);
+      continue;
+    }
+    RTIME due = pulse_queue[0].due;
+    if (due > rt_get_time_ns())
+    {
+      rt_sem_signal(&pulse_queue_sem);
+      // Returns early when an earlier deactivation was scheduled
+      rt_sem_wait_until(&pulse_sem, rt_get_time() + nano2count(due - rt_get_time_ns()));
+      continue;
+    }
+    MagneticDataConverter off = {.md = pulse_queue[0].data};
+    pulse_queue[0] = pulse_queue[--pulse_count];
+    pulse_sift_down(0);
+    rt_sem_signal(&pulse_queue_sem);
+
+    encode_waveform(buildMagneticTelegram(off.md), length, &pulse_waveform);
+    send_bit_task(district_of_magnetic(off.md.address), &pulse_waveform, 1, NULL, NULL);
+    if (event_subscribed)
+    {
+      publish_state_change(off.us);
+    }
+  }
+}
+
+EXPORT_SYMBOL(send_pulse_task);
@@ -1,67 +1,432 @@
 #include "communication/railroad_communication.h"
+#include "communication/rtai_linux_communication.h"
+#include "communication/bitslice.h"
+#include "communication/pulse.h"
+#include "communication/consist.h"
+#include "communication/protocol.h"
+#include "communication/plan.h"
+#include "telegram/event.h"
 
-void send_bit_task(unsigned long long message, int length)
+SEM magnetic_queue_sem;
+
+RT_TASK *msg_periodic_task;
+RT_TASK magnetic_task;
+Deadline magnetic_deadline;
+
+unsigned long long message = 0xFFFC066230C00000; // 0x5555555555555555;
+int length = 42;
+const int locomotive_count = 3;
+// A slot stays silent until a command or SYSTEM_LOAD gave it a state, unknown states are never sent
+LocomotiveSlot locomotive_slots[LOC_MSQ_SIZE];
+
+// Ring of pending accessory commands, guarded by magnetic_queue_sem
+static MagneticEntry magnetic_queue[MAG_MSQ_SIZE] ____cacheline_aligned;
+static int magnetic_queue_head = 0;
+static int magnetic_queue_count = 0;
+
+static unsigned int state_change_count = 0; // Number of state changes published
+static Waveform magnetic_waveform;          // Waveform of the current accessory packet
+
+void publish_all_locomotives(void)
 {
-  outb(0x00, LPT1);             // set start voltlevel
-  rt_sleep(nano2count(500000)); // wait 0.5ms
   int i;
-  rt_sem_wait(&bit_sem);
-  for (i = 0; i < length; i++)
+  for (i = 0; i < LOC_MSQ_SIZE; i++)
   {
-    if (((message >> (63 - i)) & 0x01) == 1) // 1-Bit
+    locomotive_slots[i].publish_pending = 1;
+  }
+}
+
+void publish_state_change(unsigned short data)
+{
+  publish_event(EVENT_STATE, data, ++state_change_count);
+}
+
+int queue_magnetic_msg(MagneticData mag, int report)
+{
+  int i;
+  rt_sem_wait(&magnetic_queue_sem);
+  for (i = 0; i < magnetic_queue_count; i++)
+  {
+    MagneticEntry *entry = &magnetic_queue[(magnetic_queue_head + i) % MAG_MSQ_SIZE];
+    if (entry->data.address == mag.address && entry->data.device == mag.device && entry->report == 0)
     {
-      outb(0x11, LPT1);
-      rt_sleep(nano2count(BIT_1_TIME));
-      outb(0x00, LPT1);
-      rt_sleep(nano2count(BIT_1_TIME));
+      // The superseded state never reaches the rails, the target keeps its place in the order
+      entry->data = mag;
+      entry->report = report;
+      statistics[STATISTIC_MAGNETIC_MERGED]++;
+      rt_sem_signal(&magnetic_queue_sem);
+      return MAGNETIC_MERGED;
     }
-    else // 0-Bit
+  }
+  if (magnetic_queue_count >= MAG_MSQ_SIZE)
+  {
+    rt_sem_signal(&magnetic_queue_sem);
+    return MAGNETIC_QUEUE_FULL;
+  }
+  MagneticEntry *entry = &magnetic_queue[(magnetic_queue_head + magnetic_queue_count) % MAG_MSQ_SIZE];
+  entry->data = mag;
+  entry->report = report;
+  magnetic_queue_count++;
+  rt_sem_signal(&magnetic_queue_sem);
+  return MAGNETIC_QUEUED;
+}
+
+/**
+ * @brief Removes the oldest command from the accessory queue.
+ *
+ * @param entry Receives the command.
+ * @return int 1 if a command was removed, 0 if the queue is empty.
+ */
+static int take_magnetic_msg(MagneticEntry *entry)
+{
+  int taken = 0;
+  rt_sem_wait(&magnetic_queue_sem);
+  if (magnetic_queue_count > 0)
+  {
+    *entry = magnetic_queue[magnetic_queue_head];
+    magnetic_queue_head = (magnetic_queue_head + 1) % MAG_MSQ_SIZE;
+    magnetic_queue_count--;
+    taken = 1;
+  }
+  rt_sem_signal(&magnetic_queue_sem);
+  return taken;
+}
+
+void collect_deadline_statistics(void)
+{
+  unsigned long long overruns = magnetic_deadline.overruns, skipped = magnetic_deadline.skipped;
+  RTIME lateness_max = 0, runtime_max = 0;
+  int i;
+  for (i = 0; i < LOC_MSQ_SIZE; i++)
+  {
+    const Deadline *deadline = &locomotive_slots[i].deadline;
+    overruns += deadline->overruns;
+    skipped += deadline->skipped;
+    lateness_max = deadline->lateness_max > lateness_max ? deadline->lateness_max : lateness_max;
+    runtime_max = deadline->runtime_max > runtime_max ? deadline->runtime_max : runtime_max;
+  }
+  statistics[STATISTIC_DEADLINE_OVERRUNS] = overruns;
+  statistics[STATISTIC_ACTIVATIONS_SKIPPED] = skipped;
+  statistics[STATISTIC_LOCO_LATENESS_MAX] = lateness_max;
+  statistics[STATISTIC_LOCO_RUNTIME_MAX] = runtime_max;
+  statistics[STATISTIC_MAGNETIC_LATENESS_MAX] = magnetic_deadline.lateness_max;
+  statistics[STATISTIC_MAGNETIC_RUNTIME_MAX] = magnetic_deadline.runtime_max;
+}
+
+void reset_deadline_statistics(void)
+{
+  int i;
+  for (i = 0; i < LOC_MSQ_SIZE; i++)
+  {
+    locomotive_slots[i].deadline.lateness_max = 0;
+    locomotive_slots[i].deadline.runtime_max = 0;
+  }
+  magnetic_deadline.lateness_max = 0;
+  magnetic_deadline.runtime_max = 0;
+}
+
+void send_magnetic_msg_task(long arg)
+{
+  MagneticEntry entry;
+
+  while (1)
+  {
+    // The accessory task never skips an activation, its queue would only fill up
+    deadline_begin(&magnetic_deadline);
+    if (take_magnetic_msg(&entry))
     {
-      outb(0x11, LPT1);
-      rt_sleep(nano2count(BIT_0_TIME));
-      outb(0x00, LPT1);
-      rt_sleep(nano2count(BIT_0_TIME));
+      MagneticDataConverter sent = {.md = entry.data};
+      unsigned long long telegram = buildMagneticTelegram(entry.data);
+      int report = entry.report;
+      encode_waveform(telegram, length, &magnetic_waveform);
+      RTIME first, last;
+      send_bit_task(district_of_magnetic(sent.md.address), &magnetic_waveform, report > 0 ? report : 1, &first, &last);
+
+      // The module switches the solenoid off itself, the sender only activates it
+      if (sent.md.enable && schedule_pulse_off(sent.md, last) != 0)
+      {
+        rt_printk("Abschaltung von Magnetic Addr %d Device %d nicht möglich\n", sent.md.address, sent.md.device);
+      }
+      if (report > 0)
+      {
+        publish_completion(EVENT_TRANSMITTED, sent.us, report, first, last);
+      }
+
+      // Every accessory packet changes the state of its output, publish it after it is on the rails
+      if (event_subscribed)
+      {
+        publish_state_change(sent.us);
+      }
     }
+    deadline_end(&magnetic_deadline);
+
+    rt_task_wait_period();
   }
-  rt_sem_signal(&bit_sem);
-  outb(0x11, LPT1);
 }
 
-void send_magnetic_msg_task(long arg)
+/**
+ * @brief Returns the position of a speed value on the ramp, the emergency stop counts as standing.
+ *
+ * @param speed The speed value of the data word.
+ * @return int 0 when standing, the speed value otherwise.
+ */
+static int ramp_level(int speed)
+{
+  return speed <= 1 ? 0 : speed;
+}
+
+/**
+ * @brief Moves the speed of a slot one step towards its ramp target once the step time passed.
+ *
+ * Called with the semaphore of the slot held. The speed value 1 is the emergency stop and
+ * is skipped, a ramp goes from 0 directly to 2 and back.
+ *
+ * @param slot The slot of the locomotive.
+ * @param now The current time in nanoseconds.
+ */
+static void ramp_step(LocomotiveSlot *slot, RTIME now)
+{
+  LocomotiveData *data = &slot->data;
+  int turning = data->direction != slot->ramp_target.direction;
+  int goal = turning ? 0 : ramp_level(slot->ramp_target.speed);
+  int level = ramp_level(data->speed);
+
+  if (level == goal)
+  {
+    data->speed = goal;
+    if (!turning)
+    {
+      slot->ramp_active = 0;
+      return;
+    }
+    // Standing, the direction may change and the ramp continues towards the target
+    data->direction = slot->ramp_target.direction;
+    goal = ramp_level(slot->ramp_target.speed);
+    if (goal == 0)
+    {
+      slot->ramp_active = 0;
+      return;
+    }
+  }
+
+  int accelerating = goal > level;
+  if (now - slot->ramp_last_step < (accelerating ? slot->ramp_accel_time : slot->ramp_decel_time))
+  {
+    return;
+  }
+  if (accelerating)
+  {
+    data->speed = level == 0 ? 2 : level + 1;
+  }
+  else
+  {
+    data->speed = level <= 2 ? 0 : level - 1;
+  }
+  slot->ramp_last_step = now;
+}
+
+/**
+ * @brief Takes the state of a slot for its next packet.
+ *
+ * Called with the semaphore of the slot held.
+ *
+ * @param slot The slot of the locomotive.
+ * @param now The current time in nanoseconds.
+ * @param requested Receives the repetitions of a newly requested transmit report, 0 for none.
+ * @return LocomotiveDataConverter The state to send.
+ */
+static LocomotiveDataConverter take_locomotive(LocomotiveSlot *slot, RTIME now, int *requested)
+{
+  // The ramp advances with the refresh, so a speed step is never shorter than the task period
+  if (slot->ramp_active)
+  {
+    ramp_step(slot, now);
+  }
+  LocomotiveDataConverter sent = {.ld = slot->data};
+  *requested = slot->report_requested;
+  slot->report_requested = 0;
+  return sent;
+}
+
+/**
+ * @brief Sends the packet of a slot and publishes what was transmitted.
+ *
+ * @param slot The slot of the locomotive.
+ * @param sent The state taken with take_locomotive().
+ * @param requested The repetitions of a newly requested transmit report, 0 for none.
+ * @param waveform The buffer the packet is encoded into.
+ */
+static void send_locomotive(LocomotiveSlot *slot, LocomotiveDataConverter sent, int requested, Waveform *waveform)
+{
+  // A newer request or state replaces the packet being reported, report what was sent of it
+  if (slot->report_remaining > 0 && (requested > 0 || sent.us != slot->report_data))
+  {
+    slot->report_remaining = 0;
+    publish_completion(EVENT_TRANSMITTED, slot->report_data, slot->report_sent, slot->report_first, slot->report_last);
+  }
+  if (requested > 0)
+  {
+    slot->report_remaining = requested;
+    slot->report_sent = 0;
+    slot->report_data = sent.us;
+  }
+
+  // A Motorola frame is sent twice back to back, the decoder only takes matching frames
+  int repeat = encode_locomotive(sent.ld, waveform);
+  RTIME first, last;
+  send_bit_task(district_of_locomotive(sent.ld.address), waveform, repeat, &first, &last);
+
+  // Every refresh is a repetition of the packet
+  if (slot->report_remaining > 0)
+  {
+    if (slot->report_sent++ == 0)
+    {
+      slot->report_first = first;
+    }
+    slot->report_last = last;
+    if (--slot->report_remaining == 0)
+    {
+      publish_completion(EVENT_TRANSMITTED, slot->report_data, slot->report_sent, slot->report_first, slot->report_last);
+    }
+  }
+
+  // Only publish what was actually transmitted and differs from the last published state
+  if (event_subscribed && (slot->publish_pending || sent.us != slot->published))
+  {
+    slot->published = sent.us;
+    slot->publish_pending = 0;
+    publish_state_change(sent.us);
+  }
+}
+
+/**
+ * @brief Refreshes all members of a consist back to back.
+ *
+ * The states of all members are taken while all their semaphores are held, so one pass never
+ * mixes the old state of one member with the new state of another. The members are copied
+ * first, a consist redefined in the meantime is skipped until the next pass.
+ *
+ * @param first The slot of the task, the first member of the consist.
+ * @param index The index of the consist.
+ */
+static void send_consist(LocomotiveSlot *first, int index)
 {
+  int members[CONSIST_MAX_MEMBERS], inverted[CONSIST_MAX_MEMBERS];
+  LocomotiveDataConverter sent[CONSIST_MAX_MEMBERS];
+  int requested[CONSIST_MAX_MEMBERS];
+  RTIME now = rt_get_time_ns();
+  int count = consist_members(&consists[index], members, inverted);
+  int i, slot_index, current = 1;
 
-  if (magnetic_msg_count > 0)
+  if (count == 0 || &locomotive_slots[members[0]] != first)
   {
-    rt_sem_wait(&mag_sem[0]);
-    unsigned long long telegram = buildMagneticTelegram(magnetic_msg_queue[0]);
-    rt_sem_signal(&mag_sem[0]);
-    send_bit_task(telegram, length);
+    return;
+  }
 
-    // Nachrücken
-    int i;
-    for (i = 1; i < magnetic_msg_count; i++)
+  // Locked in slot order like drive_consist()
+  for (slot_index = 0; slot_index < LOC_MSQ_SIZE; slot_index++)
+  {
+    for (i = 0; i < count; i++)
     {
-      magnetic_msg_queue[i - 1] = magnetic_msg_queue[i];
+      if (members[i] == slot_index)
+      {
+        rt_sem_wait(&locomotive_slots[slot_index].sem);
+      }
     }
-    magnetic_msg_count--;
   }
+  for (i = 0; i < count; i++)
+  {
+    current = current && locomotive_slots[members[i]].consist == index + 1;
+  }
+  for (i = 0; i < count && current; i++)
+  {
+    sent[i] = take_locomotive(&locomotive_slots[members[i]], now, &requested[i]);
+  }
+  for (i = 0; i < count; i++)
+  {
+    rt_sem_signal(&locomotive_slots[members[i]].sem);
+  }
+  if (!current)
+  {
+    return;
+  }
+
+  for (i = 0; i < count; i++)
+  {
+    if (sent[i].ld.type == 0)
+    {
+      continue;
+    }
+    send_locomotive(&locomotive_slots[members[i]], sent[i], requested[i], &first->consist_waveforms[i]);
+  }
+}
+
+/**
+ * @brief Releases the slot of a standing locomotive to the longest refresh interval.
+ *
+ * After PLAN_IDLE_RELEASE refreshes of the same state at speed 0 the slot is released, if command_sem is
+ * free. A locomotive in emergency stop keeps its planned refresh. The task never waits for a command,
+ * a command executed in the meantime changes the state, which is checked again under command_sem.
+ *
+ * @param slot The slot of the task.
+ * @param index The index of the slot.
+ * @param sent The state sent by this refresh.
+ */
+static void release_idle(LocomotiveSlot *slot, int index, LocomotiveDataConverter sent)
+{
+  if (sent.ld.speed != 0 || sent.us != slot->idle_data || plan_released(index))
+  {
+    slot->idle_data = sent.us;
+    slot->idle_refreshes = 0;
+    return;
+  }
+  if (++slot->idle_refreshes < PLAN_IDLE_RELEASE || rt_sem_wait_if(&command_sem) <= 0)
+  {
+    return;
+  }
+
+  rt_sem_wait(&slot->sem);
+  LocomotiveDataConverter current = {.ld = slot->data};
+  int unchanged = current.us == sent.us && !slot->ramp_active && slot->report_requested == 0;
+  rt_sem_signal(&slot->sem);
+  if (unchanged && slot->report_remaining == 0)
+  {
+    plan_release(index);
+  }
+  rt_sem_signal(&command_sem);
+  slot->idle_refreshes = 0;
 }
 
 void send_loco_msg_task(long i)
 {
   while (1)
   {
-    outb(0x00, LPT1);
-
-    if (i >= 0 && i < locomotive_count)
+    // A skipped activation leaves the rails to the other tasks while the track can't keep up
+    if (i >= 0 && i < locomotive_count && deadline_begin(&locomotive_slots[i].deadline))
     {
-      rt_sem_wait(&loc_sem[i]);
-      unsigned long long telegram = buildLocomotiveTelegram(locomotive_msg_queue[i]);
-      rt_sem_signal(&loc_sem[i]);
-      send_bit_task(telegram, length);
+      LocomotiveSlot *slot = &locomotive_slots[i];
+      int consist = slot->consist;
+
+      if (consist == 0)
+      {
+        int requested;
+        rt_sem_wait(&slot->sem);
+        LocomotiveDataConverter sent = take_locomotive(slot, rt_get_time_ns(), &requested);
+        rt_sem_signal(&slot->sem);
+        if (sent.ld.type != 0)
+        {
+          send_locomotive(slot, sent, requested, &slot->waveform);
+          release_idle(slot, i, sent);
+        }
+      }
+      else
+      {
+        // The first member refreshes the whole consist, the others stay silent
+        send_consist(slot, consist - 1);
+      }
+      deadline_end(&slot->deadline);
     }
 
-    outb(0x11, LPT1);
     rt_task_wait_period();
   }
 }
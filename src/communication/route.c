@@ -0,0 +1,126 @@
+#include "communication/route.h"
+
+#include "communication/railroad_communication.h"
+#include "communication/rtai_linux_communication.h"
+#include "communication/bitslice.h"
+#include "communication/pulse.h"
+#include "telegram/system.h"
+#include "telegram/event.h"
+
+RT_TASK route_task;
+SEM route_sem;
+
+/**
+ * @struct RouteRequest
+ * @brief A route waiting for the route task.
+ */
+typedef struct
+{
+  unsigned short route;                  // The route, echoed in EVENT_ROUTE.
+  int count;                             // Number of accessory data words.
+  unsigned short steps[ROUTE_MAX_STEPS]; // Accessory data words in the order they are sent.
+} RouteRequest;
+
+// Single producer (fifo handler), single consumer (route task) ring of requested routes
+static RouteRequest route_queue[ROUTE_QUEUE_SIZE];
+static volatile unsigned int route_queue_head = 0; // Next request taken by the route task
+static volatile unsigned int route_queue_tail = 0; // Next free entry for the fifo handler
+
+static Waveform route_waveform; // Waveform of the current route packet
+
+int request_route(unsigned short route, const unsigned short *steps, int count)
+{
+  int i;
+
+  if (route_queue_tail - route_queue_head >= ROUTE_QUEUE_SIZE || count < 1 || count > ROUTE_MAX_STEPS)
+  {
+    return -1;
+  }
+  for (i = 0; i < count; i++)
+  {
+    if (((steps[i] >> 13) & 0x3) != 0x2)
+    {
+      return -1;
+    }
+  }
+
+  RouteRequest *request = &route_queue[route_queue_tail % ROUTE_QUEUE_SIZE];
+  memcpy(request->steps, steps, count * sizeof(unsigned short));
+  request->count = count;
+  request->route = route;
+  smp_wmb();
+  route_queue_tail++;
+  rt_sem_signal(&route_sem);
+  return 0;
+}
+
+/**
+ * @brief Sleeps until an RT time given in nanoseconds, returns at once if it passed.
+ *
+ * @param time The time to wake up in nanoseconds.
+ */
+static void sleep_until_ns(RTIME time)
+{
+  RTIME now = rt_get_time_ns();
+  if (time > now)
+  {
+    rt_sleep(nano2count(time - now));
+  }
+}
+
+void send_route_task(long arg)
+{
+  // Start of the last activations, used as a ring. It is kept across routes, solenoids of the
+  // previous route may still draw current when the next one starts.
+  RTIME fired[ROUTE_ACTIVE_MAX];
+  unsigned int activations = 0;
+  RTIME first = 0, last = 0;
+
+  while (1)
+  {
+    rt_sem_wait(&route_sem);
+    smp_rmb();
+    RouteRequest *request = &route_queue[route_queue_head % ROUTE_QUEUE_SIZE];
+
+    RTIME next = 0;
+    int i;
+    for (i = 0; i < request->count; i++)
+    {
+      MagneticDataConverter step = {.us = request->steps[i]};
+
+      // Only activations fire a solenoid, the oldest one in the ring must have finished its pulse
+      RTIME start = next;
+      if (step.md.enable && activations >= ROUTE_ACTIVE_MAX)
+      {
+        RTIME free = fired[activations % ROUTE_ACTIVE_MAX] + ROUTE_FIRING_TIME;
+        start = free > start ? free : start;
+      }
+      sleep_until_ns(start);
+
+      RTIME step_first, step_last;
+      encode_waveform(buildMagneticTelegram(step.md), length, &route_waveform);
+      send_bit_task(district_of_magnetic(step.md.address), &route_waveform, 1, &step_first, &step_last);
+      if (step.md.enable)
+      {
+        fired[activations++ % ROUTE_ACTIVE_MAX] = step_first;
+        schedule_pulse_off(step.md, step_last);
+      }
+      if (i == 0)
+      {
+        first = step_first;
+      }
+      last = step_last;
+      next = step_first + ROUTE_SPACING;
+
+      if (event_subscribed)
+      {
+        publish_state_change(step.us);
+      }
+    }
+
+    publish_completion(EVENT_ROUTE, request->route, request->count, first, last);
+    route_queue_head++;
+  }
+}
+
+EXPORT_SYMBOL(send_route_task);
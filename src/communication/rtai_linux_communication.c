@@ -3,69 +3,603 @@
 #include <rtai_fifos.h>
 
 #include "communication/railroad_communication.h"
+#include "communication/emergency.h"
+#include "communication/route.h"
+#include "communication/interlocking.h"
+#include "communication/consist.h"
+#include "communication/bitslice.h"
+#include "communication/schedule.h"
+#include "communication/deadline.h"
+#include "communication/plan.h"
+#include "communication/trace.h"
+#include "telegram/system.h"
+#include "telegram/capture.h"
+#include "telegram/uart.h"
 
 #define STACK_SIZE 4096
 
+int event_subscribed = 0;
+unsigned long long statistics[STATISTIC_COUNT];
+SEM command_sem;
+volatile int capture_enabled = 0;
+
+/**
+ * @brief Publishes an executed locomotive or accessory command on the capture fifo.
+ *
+ * @param data The data word of the command.
+ */
+static void capture_command(unsigned short data)
+{
+    RTIME now = rt_get_time_ns();
+    CaptureData record = {
+        .kind = CAPTURE_COMMAND,
+        .data = data & 0x7FFF,
+        .length = 0,
+        .message = 0,
+        .start = now,
+        .end = now,
+    };
+    if (rtf_put(FIFO_CAPTURE, &record, sizeof(record)) != sizeof(record))
+    {
+        statistics[STATISTIC_CAPTURE_DROPPED]++;
+    }
+}
+
+/**
+ * @brief Admits all members of a consist to the bandwidth plan.
+ *
+ * @param consist The consist.
+ * @return int 0 if all members are refreshed, -1 if the district of a member is full.
+ */
+static int admit_consist(const Consist *consist)
+{
+    int i;
+    for (i = 0; i < consist->member_count; i++)
+    {
+        if (plan_admit(consist->members[i]) != 0)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Puts a locomotive command into the slot of the locomotive.
+ *
+ * @param loco The command.
+ * @param report Repetitions after which EVENT_TRANSMITTED is published, 0 for none.
+ * @return int 0 on success, -1 if the address has no slot, -2 if the district of the locomotive is full.
+ */
+static int queue_locomotive(LocomotiveData loco, int report)
+{
+    Consist *consist = find_consist(loco.address);
+    if (consist != NULL)
+    {
+        // The members are refreshed in one pass of the consist, reports are kept per locomotive
+        if (report > 0)
+        {
+            rt_printk("Traktion %d meldet keine Übertragung\n", loco.address);
+            return -1;
+        }
+        if (admit_consist(consist) != 0)
+        {
+            return -2;
+        }
+        drive_consist(consist, loco, 0, 0, 0);
+        return 0;
+    }
+
+    if (loco.address > LOC_MSQ_SIZE || loco.address <= 0)
+    {
+        rt_printk("Ungültige Lok-Adresse: %d\n", loco.address);
+        return -1;
+    }
+    // A refused locomotive is never sent, the refresh of the others in its district stays intact
+    if (plan_admit(loco.address - 1) != 0)
+    {
+        return -2;
+    }
+
+    LocomotiveSlot *slot = &locomotive_slots[loco.address - 1];
+    rt_sem_wait(&slot->sem);
+    slot->data = loco;
+    slot->ramp_active = 0;
+    if (report > 0)
+    {
+        slot->report_requested = report;
+    }
+    rt_sem_signal(&slot->sem);
+    return 0;
+}
+
+/**
+ * @brief Starts a speed ramp of a locomotive towards the state of a data word.
+ *
+ * @param loco The target state, light is applied at once.
+ * @param accel_ms Milliseconds per speed step accelerating.
+ * @param decel_ms Milliseconds per speed step decelerating.
+ * @return int 0 on success, -1 if the address has no slot or the target is the emergency stop,
+ *             -2 if the district of the locomotive is full.
+ */
+static int ramp_locomotive(LocomotiveData loco, unsigned short accel_ms, unsigned short decel_ms)
+{
+    Consist *consist = find_consist(loco.address);
+    if (consist != NULL && loco.speed != 1)
+    {
+        if (admit_consist(consist) != 0)
+        {
+            return -2;
+        }
+        drive_consist(consist, loco, 1, (RTIME)accel_ms * 1000000, (RTIME)decel_ms * 1000000);
+        return 0;
+    }
+
+    if (loco.address > LOC_MSQ_SIZE || loco.address <= 0 || loco.speed == 1)
+    {
+        rt_printk("Ungültiges Rampenziel: Adresse %d, Speed %d\n", loco.address, loco.speed);
+        return -1;
+    }
+    if (plan_admit(loco.address - 1) != 0)
+    {
+        return -2;
+    }
+
+    LocomotiveSlot *slot = &locomotive_slots[loco.address - 1];
+    rt_sem_wait(&slot->sem);
+    // A locomotive without a known state ramps up from standing
+    if (slot->data.type == 0)
+    {
+        slot->data = loco;
+        slot->data.speed = 0;
+    }
+    slot->data.light = loco.light;
+    slot->ramp_target = loco;
+    slot->ramp_accel_time = (RTIME)accel_ms * 1000000;
+    slot->ramp_decel_time = (RTIME)decel_ms * 1000000;
+    slot->ramp_last_step = rt_get_time_ns();
+    slot->ramp_active = 1;
+    rt_sem_signal(&slot->sem);
+    return 0;
+}
+
+/**
+ * @brief Puts an accessory command into the accessory queue.
+ *
+ * @param mag The command.
+ * @param report Repetitions after which EVENT_TRANSMITTED is published, 0 for none.
+ * @return int 0 on success, -1 if the queue is full, -2 if the accessory is locked by a route.
+ */
+static int queue_magnetic(MagneticData mag, int report)
+{
+    if (interlock_is_locked(mag.address * 4 + mag.device))
+    {
+        rt_printk("Magnetic Addr %d Device %d ist durch eine Fahrstraße verschlossen\n", mag.address, mag.device);
+        statistics[STATISTIC_INTERLOCK_CONFLICTS]++;
+        return -2;
+    }
+
+    int result = queue_magnetic_msg(mag, report);
+    if (result == MAGNETIC_QUEUE_FULL)
+    {
+        rt_printk("Magnetic queue voll!\n");
+        statistics[STATISTIC_QUEUE_FULL]++;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Queues the data word of a SYSTEM_TRANSMIT with a completion report.
+ *
+ * @param data The locomotive or accessory data word.
+ * @param repetitions Repetitions after which EVENT_TRANSMITTED is published.
+ * @return int 0 on success, -1 if the command was rejected, -2 if the accessory is locked by a route or the
+ *             district of the locomotive is full.
+ */
+static int handle_transmit(unsigned short data, unsigned short repetitions)
+{
+    unsigned short type = (data >> 13) & 0x3;
+
+    if (repetitions < 1 || repetitions > TRANSMIT_REPEAT_MAX)
+    {
+        rt_printk("Ungültige Wiederholungen: %d\n", repetitions);
+        return -1;
+    }
+    if (type == 0x1)
+    {
+        return queue_locomotive(*(LocomotiveData *)&data, repetitions);
+    }
+    if (type == 0x2)
+    {
+        return queue_magnetic(*(MagneticData *)&data, repetitions);
+    }
+    rt_printk("Nachrichtentyp %d kann nicht gesendet werden\n", type);
+    return -1;
+}
+
+/**
+ * @brief Locks the elements of a SYSTEM_ROUTE in the interlocking and queues its accessory packets.
+ *
+ * @param payload The payload of the command.
+ * @param length The number of payload words.
+ * @return int 0 on success, -1 if the command is invalid or the route queue is full,
+ *             -2 if an element is locked by another route.
+ */
+static int handle_route(const unsigned short *payload, int length)
+{
+    static ElementSet elements; // Only used under command_sem, too large for the stack
+    int i;
+
+    if (length < 2 || payload[1] < 1 || payload[1] > ROUTE_MAX_STEPS || 2 + payload[1] > length ||
+        length - 2 - payload[1] > ROUTE_MAX_SECTIONS)
+    {
+        return -1;
+    }
+    unsigned short route = payload[0];
+    int count = payload[1];
+    const unsigned short *steps = &payload[2];
+
+    element_set_clear(&elements);
+    for (i = 0; i < count; i++)
+    {
+        MagneticData step = *(MagneticData *)&steps[i];
+        element_set_add(&elements, step.address * 4 + step.device);
+    }
+    for (i = 2 + count; i < length; i++)
+    {
+        if (payload[i] < INTERLOCK_TURNOUTS || element_set_add(&elements, payload[i]) != 0)
+        {
+            return -1;
+        }
+    }
+
+    if (interlock_route(route, &elements) != 0)
+    {
+        return -2;
+    }
+    if (request_route(route, steps, count) != 0)
+    {
+        interlock_release(route, NULL);
+        return -1;
+    }
+    rt_printk("Fahrstraße %d mit %d Weichen und %d Abschnitten\n", route, count, length - 2 - count);
+    return 0;
+}
+
+/**
+ * @brief Releases the elements of a SYSTEM_RELEASE.
+ *
+ * @param payload The payload of the command.
+ * @param length The number of payload words.
+ * @return int The number of released elements, -1 if the route holds no locks.
+ */
+static int handle_release(const unsigned short *payload, int length)
+{
+    static ElementSet elements; // Only used under command_sem, too large for the stack
+    int i;
+
+    if (length == 1)
+    {
+        return interlock_release(payload[0], NULL);
+    }
+    element_set_clear(&elements);
+    for (i = 1; i < length; i++)
+    {
+        element_set_add(&elements, payload[i]);
+    }
+    return interlock_release(payload[0], &elements);
+}
+
+/**
+ * @brief Restores the states of a SYSTEM_LOAD into the locomotive slots.
+ *
+ * The states replace the states of the slots without ramps, they are published like new states.
+ *
+ * @param payload The locomotive data words.
+ * @param length The number of data words.
+ * @return int The number of restored locomotives.
+ */
+static int handle_load(const unsigned short *payload, int length)
+{
+    int i, loaded = 0;
+
+    for (i = 0; i < length; i++)
+    {
+        LocomotiveData loco = *(LocomotiveData *)&payload[i];
+        if (((payload[i] >> 13) & 0x3) != 0x1 || loco.address > LOC_MSQ_SIZE || loco.address <= 0 ||
+            plan_admit(loco.address - 1) != 0)
+        {
+            continue;
+        }
+        LocomotiveSlot *slot = &locomotive_slots[loco.address - 1];
+        rt_sem_wait(&slot->sem);
+        slot->data = loco;
+        slot->ramp_active = 0;
+        slot->publish_pending = 1;
+        rt_sem_signal(&slot->sem);
+        loaded++;
+    }
+    return loaded;
+}
+
+/**
+ * @brief Holds the command of a SYSTEM_SCHEDULE in the timer wheel.
+ *
+ * @param payload The payload of the command.
+ * @param length The number of payload words.
+ * @return int 0 on success, -1 if the command is invalid or the timer wheel is full.
+ */
+static int handle_schedule(const unsigned short *payload, int length)
+{
+    if (length < 6 || length - 5 > SCHEDULE_MAX_COMMAND)
+    {
+        return -1;
+    }
+    const unsigned short *command = &payload[5];
+    int count = length - 5;
+    unsigned short type = (command[0] >> 13) & 0x3;
+    SystemData sys = *(SystemData *)&command[0];
+
+    // Only complete commands are held, a scheduled command can't schedule again
+    if (type == 0 || (type != 0x3 && count != 1) ||
+        (type == 0x3 && (sys.opcode == SYSTEM_SCHEDULE || 1 + sys.length != count)))
+    {
+        return -1;
+    }
+
+    RTIME time = (RTIME)payload[1] | (RTIME)payload[2] << 16 | (RTIME)payload[3] << 32 | (RTIME)payload[4] << 48;
+    RTIME due = payload[0] & SCHEDULE_AT ? time : rt_get_time_ns() + time;
+    if (request_schedule(due, command, count) != 0)
+    {
+        rt_printk("Zeitplan voll!\n");
+        statistics[STATISTIC_QUEUE_FULL]++;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Executes a system command.
+ *
+ * @param raw The header word of the command.
+ * @param payload The payload words of the command.
+ * @return int 0 if the command was served, -1 if it is invalid or can't be served now,
+ *             -2 if it is rejected.
+ */
+static int handle_system(unsigned short raw, const unsigned short *payload)
+{
+    SystemData sys = *(SystemData *)&raw;
+    int result;
+
+    switch (sys.opcode)
+    {
+    case SYSTEM_WATCH:
+        if (sys.length < 1)
+        {
+            rt_printk("Watch ohne Parameter\n");
+            return -1;
+        }
+        // A new subscriber needs the full state once, afterwards only the changes are sent
+        if (payload[0] && !event_subscribed)
+        {
+            publish_all_locomotives();
+        }
+        event_subscribed = payload[0] ? 1 : 0;
+        rt_printk("State stream %s\n", event_subscribed ? "subscribed" : "unsubscribed");
+        return 0;
+
+    case SYSTEM_EMERGENCY:
+        if (sys.length < 2 || request_emergency(payload[0], payload[1]) != 0)
+        {
+            rt_printk("Ungültiger Notfallbefehl\n");
+            return -1;
+        }
+        // Stopping all locomotives also drops the choreography which would start them again
+        if (payload[0] == EMERGENCY_STOP && payload[1] == 0)
+        {
+            result = cancel_schedule();
+            if (result > 0)
+            {
+                rt_printk("%d geplante Befehle verworfen\n", result);
+            }
+        }
+        return 0;
+
+    case SYSTEM_STATISTICS:
+        publish_statistics();
+        if (sys.length >= 1 && payload[0] == STATISTICS_RESET)
+        {
+            reset_statistics();
+        }
+        return 0;
+
+    case SYSTEM_TRANSMIT:
+        result = sys.length < 2 ? -1 : handle_transmit(payload[0], payload[1]);
+        if (result == -1)
+        {
+            rt_printk("Ungültiger Sendeauftrag\n");
+        }
+        return result;
+
+    case SYSTEM_RAMP:
+        if (sys.length < 3 || ((payload[0] >> 13) & 0x3) != 0x1)
+        {
+            rt_printk("Ungültiger Rampenbefehl\n");
+            return -1;
+        }
+        result = ramp_locomotive(*(LocomotiveData *)&payload[0], payload[1], payload[2]);
+        if (result != 0)
+        {
+            rt_printk("Ungültiger Rampenbefehl\n");
+        }
+        return result;
+
+    case SYSTEM_ROUTE:
+        result = handle_route(payload, sys.length);
+        if (result == -1)
+        {
+            rt_printk("Ungültige Fahrstraße\n");
+        }
+        return result;
+
+    case SYSTEM_RELEASE:
+        if (sys.length < 1 || handle_release(payload, sys.length) < 0)
+        {
+            return -2;
+        }
+        return 0;
+
+    case SYSTEM_CONSIST:
+        if (sys.length < 1 || define_consist(payload[0], &payload[1], sys.length - 1) != 0)
+        {
+            rt_printk("Ungültige Traktion\n");
+            return -2;
+        }
+        // The first member refreshes the consist, it takes the longest interval of the members
+        plan_update();
+        rt_printk("Traktion %d mit %d Loks\n", payload[0], sys.length - 1);
+        return 0;
+
+    case SYSTEM_LOAD:
+        result = handle_load(payload, sys.length);
+        rt_printk("%d von %d Loks wiederhergestellt\n", result, sys.length);
+        return 0;
+
+    case SYSTEM_DEGRADE:
+        if (sys.length < 1)
+        {
+            return -1;
+        }
+        deadline_degrade = payload[0] ? 1 : 0;
+        rt_printk("Verlangsamte Auffrischung bei Überlast %s\n", deadline_degrade ? "an" : "aus");
+        return 0;
+
+    case SYSTEM_CAPTURE:
+        if (sys.length < 1)
+        {
+            return -1;
+        }
+        capture_enabled = payload[0] ? 1 : 0;
+        rt_printk("Mitschnitt %s\n", capture_enabled ? "an" : "aus");
+        return 0;
+
+    case SYSTEM_TRACE:
+        if (sys.length < 1)
+        {
+            return -1;
+        }
+        trace_streaming = payload[0] ? 1 : 0;
+        rt_printk("Ablaufverfolgung %s\n", trace_streaming ? "an" : "aus");
+        return 0;
+
+    case SYSTEM_SCHEDULE:
+        result = handle_schedule(payload, sys.length);
+        if (result != 0)
+        {
+            rt_printk("Ungültiger Zeitplan\n");
+        }
+        return result;
+
+    default:
+        rt_printk("Unbekannter Systembefehl: %d\n", sys.opcode);
+        return -1;
+    }
+}
+
+int execute_command(const unsigned short *command, int count, RTIME *executed)
+{
+    unsigned short type = (command[0] >> 13) & 0x3;
+    int result;
+    RTIME wait = rt_get_time_ns();
+
+    rt_sem_wait(&command_sem);
+    RTIME now = rt_get_time_ns();
+    if (executed != NULL)
+    {
+        *executed = now;
+    }
+    trace_event_at(wait, TRACE_SEM_WAIT, TRACE_SEM_COMMAND, (unsigned int)(now - wait));
+    trace_event_at(now, TRACE_COMMAND, command[0], count);
+    if (capture_enabled && (type == 0x1 || type == 0x2))
+    {
+        capture_command(command[0]);
+    }
+    if (type == 0x1)
+    { // Locomotive
+        result = queue_locomotive(*(LocomotiveData *)&command[0], 0);
+    }
+    else if (type == 0x2)
+    { // Magnetic
+        result = queue_magnetic(*(MagneticData *)&command[0], 0);
+    }
+    else if (type == 0x3)
+    { // System
+        result = handle_system(command[0], &command[1]);
+    }
+    else
+    {
+        rt_printk("Unbekannter Nachrichtentyp: %d\n", type);
+        result = -1;
+    }
+    rt_sem_signal(&command_sem);
+    return result;
+}
 
 int fifo_handler(unsigned int fifo)
 {
     char command[1024];
     int r;
+    int offset = 0;
     unsigned short raw;
 
     r = rtf_get(FIFO_CMD, command, sizeof(command) - 1);
-    if (r >= sizeof(unsigned short))
+    // rtf_get returns a negative error, which would compare as a large size against sizeof
+    if (r < (int)sizeof(unsigned short))
+    {
+        rt_printk("Ungültige FIFO-Daten (nur %d Byte)\n", r);
+        return 0;
+    }
+
+    // The fifo may hold several commands written in one go, handle all of them
+    while (r - offset >= (int)sizeof(unsigned short))
     {
-        memcpy(&raw, command, sizeof(unsigned short));
+        unsigned short words[1 + SYSTEM_MAX_PAYLOAD];
+        int count = 1;
+
+        memcpy(&raw, command + offset, sizeof(unsigned short));
+        offset += sizeof(unsigned short);
+        words[0] = raw;
 
         // Typ prüfen (bitweise: Bit 13-14)
         unsigned short type = (raw >> 13) & 0x3;
 
-        if (type == 0x1)
-        { // Locomotive
-            LocomotiveData loco = *(LocomotiveData *)&raw;
+        if (type == 0x3)
+        { // System
+            SystemData sys = *(SystemData *)&raw;
+            int size = sys.length * sizeof(unsigned short);
 
-            if (loco.address < 4 && loco.address >= 0)
-            {
-                rt_sem_wait(&loc_sem[loco.address - 1]);
-                locomotive_msg_queue[loco.address - 1] = loco;
-                rt_sem_signal(&loc_sem[loco.address - 1]);
-                printk("Locomotive Addr %d: Speed=%d Dir=%d Light=%d\n", loco.address, loco.speed, loco.direction, loco.light);
-                send_ack(raw);
-            }
-            else
+            if (r - offset < size)
             {
-                printk("Ungültige Lok-Adresse: %d\n", loco.address);
+                rt_printk("Unvollständiger Systembefehl (%d von %d Byte)\n", r - offset, size);
+                break;
             }
+            memcpy(&words[1], command + offset, size);
+            offset += size;
+            count += sys.length;
         }
-        else if (type == 0x2)
-        { // Magnetic
-            MagneticData mag = *(MagneticData *)&raw;
 
-            if (magnetic_msg_count < 4)
-            //TODO: override existing
-            {
-                rt_sem_wait(&mag_sem[magnetic_msg_count]);
-                magnetic_msg_queue[magnetic_msg_count] = mag;
-                rt_sem_signal(&mag_sem[magnetic_msg_count]);
-                magnetic_msg_count++;
-                printk("Magnetic Addr %d: Device=%d Enable=%d Ctrl=%d\n", mag.address, mag.device, mag.enable, mag.control);
-                send_ack(raw); 
-            }
-            else
-            {
-                printk("Magnetic queue voll!\n");
-            }
+        // Invalid commands stay unacknowledged, the sender retries them
+        int result = execute_command(words, count, NULL);
+        if (result == 0)
+        {
+            send_ack(raw);
         }
-        else
+        else if (result == -2)
         {
-            printk("Unbekannter Nachrichtentyp: %d\n", type);
+            send_nack(raw);
         }
     }
-    else
-    {
-        printk("Ungültige FIFO-Daten (nur %d Byte)\n", r);
-    }
 
     return 0;
 }
@@ -74,13 +608,116 @@ void send_ack(unsigned short raw)
 {
     // Setze Bit 15 (ACK-Bit)
     raw |= (1 << 15);
+    trace_event(TRACE_ACK, raw, 0);
 
     int result = rtf_put(FIFO_ACK, &raw, sizeof(raw));
 
     if (result != sizeof(raw))
     {
-        printk("ACK konnte nicht gesendet werden.\n");
+        rt_printk("ACK konnte nicht gesendet werden.\n");
+    }
+}
+
+void send_nack(unsigned short raw)
+{
+    // Ein gelöschtes Bit 15 lehnt den Befehl ab
+    raw &= ~(1 << 15);
+    trace_event(TRACE_ACK, raw, 1);
+
+    if (rtf_put(FIFO_ACK, &raw, sizeof(raw)) != sizeof(raw))
+    {
+        rt_printk("NACK konnte nicht gesendet werden.\n");
     }
 }
 
+void publish_event(unsigned short kind, unsigned short data, unsigned int count)
+{
+    EventData event = {
+        .kind = kind,
+        .data = data,
+        .count = count,
+        .time = rt_get_time_ns(),
+        .value = 0,
+    };
+
+    // A full fifo means the subscriber is too slow, drop instead of blocking the RT task
+    rtf_put(FIFO_EVENT, &event, sizeof(event));
+}
+
+void publish_completion(unsigned short kind, unsigned short data, unsigned int count, unsigned long long first, unsigned long long last)
+{
+    EventData event = {
+        .kind = kind,
+        .data = data,
+        .count = count,
+        .time = first,
+        .value = last,
+    };
+
+    rtf_put(FIFO_EVENT, &event, sizeof(event));
+}
+
+void capture_packet(int district, const Waveform *waveform, RTIME start, RTIME end)
+{
+    CaptureData record = {
+        .kind = CAPTURE_PACKET,
+        .data = district,
+        .length = waveform->length,
+        .message = waveform->message,
+        .start = start,
+        .end = end,
+    };
+    // The track task never waits, a full fifo loses the record
+    if (rtf_put(FIFO_CAPTURE, &record, sizeof(record)) != sizeof(record))
+    {
+        statistics[STATISTIC_CAPTURE_DROPPED]++;
+    }
+}
+
+int uart_packet(int district, const Waveform *waveform)
+{
+    UartData record;
+    // The UART backend only knows the levels of DCC bits
+    int count = waveform->dcc ? encodeUartTelegram(waveform->message, waveform->length, record.bytes, UART_MAX_BYTES) : -1;
+    if (count < 0)
+    {
+        statistics[STATISTIC_UART_DROPPED]++;
+        return -1;
+    }
+    record.district = district;
+    record.length = count;
+    if (rtf_put(FIFO_UART, &record, sizeof(record)) != sizeof(record))
+    {
+        statistics[STATISTIC_UART_DROPPED]++;
+    }
+    return count;
+}
+
+void publish_statistics(void)
+{
+    RTIME now = rt_get_time_ns();
+    collect_track_statistics();
+    collect_deadline_statistics();
+    int id;
+    for (id = 1; id < STATISTIC_COUNT; id++)
+    {
+        EventData event = {
+            .kind = EVENT_STATISTIC,
+            .data = id,
+            .count = STATISTIC_COUNT - 1,
+            .time = now,
+            .value = statistics[id],
+        };
+        rtf_put(FIFO_EVENT, &event, sizeof(event));
+    }
+}
+
+void reset_statistics(void)
+{
+    reset_track_statistics();
+    reset_deadline_statistics();
+    statistics[STATISTIC_EMERGENCY_LATENCY_MAX] = 0;
+    statistics[STATISTIC_SCHEDULE_LATENESS_MAX] = 0;
+}
+
 EXPORT_SYMBOL(fifo_handler);
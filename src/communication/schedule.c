@@ -0,0 +1,191 @@
+#include "communication/schedule.h"
+
+#include "communication/rtai_linux_communication.h"
+#include "telegram/event.h"
+
+RT_TASK schedule_task;
+SEM schedule_sem;       // Signaled when a command was scheduled
+SEM schedule_queue_sem; // Guards the timer wheel
+
+/**
+ * @struct ScheduledCommand
+ * @brief A command waiting in the timer wheel.
+ */
+typedef struct
+{
+  RTIME due;                                    // Time the command is executed in nanoseconds.
+  unsigned long long tick;                      // Tick the command is due in, due >> SCHEDULE_TICK_SHIFT.
+  int next;                                     // Next command of the same slot or free command, -1 for none.
+  int count;                                    // Number of command words.
+  unsigned short command[SCHEDULE_MAX_COMMAND]; // Header word of the command followed by its payload.
+} ScheduledCommand;
+
+// Each slot of the wheel lists the commands whose tick falls on it, in any order
+static ScheduledCommand schedule_pool[SCHEDULE_SIZE];
+static int schedule_wheel[SCHEDULE_SLOTS];
+static int schedule_free;                // First unused command of the pool
+static unsigned long long schedule_tick; // No command is due before this tick
+
+void init_schedule(void)
+{
+  int i;
+  for (i = 0; i < SCHEDULE_SLOTS; i++)
+  {
+    schedule_wheel[i] = -1;
+  }
+  for (i = 0; i < SCHEDULE_SIZE; i++)
+  {
+    schedule_pool[i].next = i + 1 < SCHEDULE_SIZE ? i + 1 : -1;
+  }
+  schedule_free = 0;
+  schedule_tick = rt_get_time_ns() >> SCHEDULE_TICK_SHIFT;
+}
+
+int request_schedule(RTIME due, const unsigned short *command, int count)
+{
+  if (count < 1 || count > SCHEDULE_MAX_COMMAND)
+  {
+    return -1;
+  }
+
+  rt_sem_wait(&schedule_queue_sem);
+  if (schedule_free < 0)
+  {
+    rt_sem_signal(&schedule_queue_sem);
+    return -1;
+  }
+  int i = schedule_free;
+  ScheduledCommand *entry = &schedule_pool[i];
+  schedule_free = entry->next;
+
+  entry->due = due;
+  // A command which is already late goes into the slot looked at next
+  entry->tick = due >> SCHEDULE_TICK_SHIFT;
+  if (entry->tick < schedule_tick)
+  {
+    entry->tick = schedule_tick;
+  }
+  entry->count = count;
+  memcpy(entry->command, command, count * sizeof(unsigned short));
+  entry->next = schedule_wheel[entry->tick & (SCHEDULE_SLOTS - 1)];
+  schedule_wheel[entry->tick & (SCHEDULE_SLOTS - 1)] = i;
+  rt_sem_signal(&schedule_queue_sem);
+
+  // Wake the schedule task so it waits for the new command if it is the earliest
+  rt_sem_signal(&schedule_sem);
+  return 0;
+}
+
+int cancel_schedule(void)
+{
+  int slot, dropped = 0;
+
+  rt_sem_wait(&schedule_queue_sem);
+  for (slot = 0; slot < SCHEDULE_SLOTS; slot++)
+  {
+    while (schedule_wheel[slot] >= 0)
+    {
+      int i = schedule_wheel[slot];
+      schedule_wheel[slot] = schedule_pool[i].next;
+      schedule_pool[i].next = schedule_free;
+      schedule_free = i;
+      dropped++;
+    }
+  }
+  rt_sem_signal(&schedule_queue_sem);
+  return dropped;
+}
+
+/**
+ * @brief Finds the earliest command within one turn of the wheel.
+ *
+ * Called with schedule_queue_sem held. The slots are looked at tick by tick, so only the commands
+ * of the first occupied slot are compared by their exact time. Commands of later turns share the
+ * slot but are skipped by their tick.
+ *
+ * @return int* The link pointing to the earliest command, NULL if no command is due within one turn.
+ */
+static int *schedule_earliest(void)
+{
+  unsigned long long tick = schedule_tick;
+  int n;
+
+  for (n = 0; n < SCHEDULE_SLOTS; n++, tick++)
+  {
+    int *link, *earliest = NULL;
+    for (link = &schedule_wheel[tick & (SCHEDULE_SLOTS - 1)]; *link >= 0; link = &schedule_pool[*link].next)
+    {
+      ScheduledCommand *entry = &schedule_pool[*link];
+      if (entry->tick <= tick && (earliest == NULL || entry->due < schedule_pool[*earliest].due))
+      {
+        earliest = link;
+      }
+    }
+    if (earliest != NULL)
+    {
+      // The slots before held nothing due, they are not looked at again
+      schedule_tick = tick;
+      return earliest;
+    }
+  }
+  return NULL;
+}
+
+void send_schedule_task(long arg)
+{
+  unsigned short command[SCHEDULE_MAX_COMMAND];
+
+  while (1)
+  {
+    rt_sem_wait(&schedule_queue_sem);
+    int *earliest = schedule_earliest();
+    RTIME now = rt_get_time_ns();
+    if (earliest == NULL)
+    {
+      // Nothing due within one turn, look again when the wheel turned once
+      RTIME turn = (schedule_tick + SCHEDULE_SLOTS) << SCHEDULE_TICK_SHIFT;
+      rt_sem_signal(&schedule_queue_sem);
+      rt_sem_wait_until(&schedule_sem, rt_get_time() + nano2count(turn - now));
+
+      rt_sem_wait(&schedule_queue_sem);
+      if (rt_get_time_ns() >= turn)
+      {
+        schedule_tick += SCHEDULE_SLOTS;
+      }
+      rt_sem_signal(&schedule_queue_sem);
+      continue;
+    }
+
+    int i = *earliest;
+    ScheduledCommand *entry = &schedule_pool[i];
+    RTIME due = entry->due;
+    if (due > now)
+    {
+      rt_sem_signal(&schedule_queue_sem);
+      // Returns early when another command was scheduled, it may be earlier
+      rt_sem_wait_until(&schedule_sem, rt_get_time() + nano2count(due - now));
+      continue;
+    }
+    int count = entry->count;
+    memcpy(command, entry->command, count * sizeof(unsigned short));
+    *earliest = entry->next;
+    entry->next = schedule_free;
+    schedule_free = i;
+    rt_sem_signal(&schedule_queue_sem);
+
+    // The handlers only log with rt_printk, so they may run in this task as well as in the fifo handler.
+    // The fifo handler may hold command_sem in Linux context, the lateness is measured when the
+    // command actually ran, including that wait.
+    RTIME executed;
+    int result = execute_command(command, count, &executed);
+
+    statistics[STATISTIC_SCHEDULED_COMMANDS]++;
+    if (executed - due > statistics[STATISTIC_SCHEDULE_LATENESS_MAX])
+    {
+      statistics[STATISTIC_SCHEDULE_LATENESS_MAX] = executed - due;
+    }
+    publish_completion(EVENT_SCHEDULED, command[0], result == 0 ? 1 : 0, executed, due);
+  }
+}
+
+EXPORT_SYMBOL(send_schedule_task);
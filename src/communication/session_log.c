@@ -0,0 +1,115 @@
+#include "communication/session_log.h"
+
+#include <string.h>
+#include <time.h>
+
+static FILE *session_log = NULL;
+static long long session_log_started;
+static int session_log_count;
+
+/**
+ * @brief Returns the current monotonic time in nanoseconds.
+ */
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int session_log_start(const char *path)
+{
+    session_log_stop();
+
+    FILE *log = fopen(path, "wb");
+    if (log == NULL)
+    {
+        perror("Failed to create the session log");
+        return -1;
+    }
+
+    SessionLogHeader header = {
+        .magic = SESSION_LOG_MAGIC,
+        .version = SESSION_LOG_VERSION,
+        .reserved = 0,
+    };
+    if (fwrite(&header, sizeof(header), 1, log) != 1)
+    {
+        perror("Failed to write the session log");
+        fclose(log);
+        return -1;
+    }
+
+    session_log = log;
+    session_log_started = now_ns();
+    session_log_count = 0;
+    return 0;
+}
+
+int session_log_stop(void)
+{
+    if (session_log == NULL)
+    {
+        return -1;
+    }
+    fclose(session_log);
+    session_log = NULL;
+    return session_log_count;
+}
+
+void session_log_write(const unsigned short *command, int count)
+{
+    if (session_log == NULL || count < 1 || count > SESSION_LOG_MAX_WORDS)
+    {
+        return;
+    }
+
+    SessionLogRecord record = {
+        .time = now_ns() - session_log_started,
+        .count = count,
+        .reserved = 0,
+        .padding = 0,
+    };
+    // Flushed per command, so the log stays usable if the prompt is killed
+    if (fwrite(&record, sizeof(record), 1, session_log) != 1 ||
+        fwrite(command, sizeof(unsigned short), count, session_log) != count ||
+        fflush(session_log) != 0)
+    {
+        perror("Failed to write the session log");
+        return;
+    }
+    session_log_count++;
+}
+
+FILE *session_log_open(const char *path)
+{
+    FILE *log = fopen(path, "rb");
+    if (log == NULL)
+    {
+        perror("Failed to open the session log");
+        return NULL;
+    }
+
+    SessionLogHeader header;
+    if (fread(&header, sizeof(header), 1, log) != 1 || header.magic != SESSION_LOG_MAGIC || header.version != SESSION_LOG_VERSION)
+    {
+        printf("'%s' is no session log\n", path);
+        fclose(log);
+        return NULL;
+    }
+    return log;
+}
+
+int session_log_read(FILE *log, SessionLogRecord *record, unsigned short *command)
+{
+    if (fread(record, sizeof(*record), 1, log) != 1)
+    {
+        return feof(log) ? 0 : -1;
+    }
+    if (record->count < 1 || record->count > SESSION_LOG_MAX_WORDS ||
+        fread(command, sizeof(unsigned short), record->count, log) != record->count)
+    {
+        return -1;
+    }
+    return 1;
+}
@@ -0,0 +1,147 @@
+#include "communication/trace.h"
+
+#include <rtai_fifos.h>
+
+#include "communication/rtai_linux_communication.h"
+#include "telegram/event.h"
+
+RT_TASK trace_task;
+volatile int trace_streaming = 0;
+
+/**
+ * @struct TraceSlot
+ * @brief A record in a ring with the sequence it was written with.
+ */
+typedef struct
+{
+  volatile unsigned int sequence; // Sequence + 1 of the record, 0 while it is written.
+  TraceData data;                 // The record.
+} TraceSlot;
+
+/**
+ * @struct TraceRing
+ * @brief The records of one CPU.
+ *
+ * Writers reserve a sequence with one atomic increment and publish the record by writing the
+ * sequence last. A writer preempted by another one on the same CPU only delays the drain of its
+ * own record, it never blocks the other.
+ */
+typedef struct
+{
+  atomic_t head;                     // Sequence the next writer reserves.
+  unsigned int tail;                 // Sequence of the next record moved to the fifo, trace task only.
+  TraceSlot slots[TRACE_RING_SIZE]; // The records, indexed by their sequence.
+} ____cacheline_aligned TraceRing;
+
+static TraceRing trace_rings[RTAI_NR_CPUS];
+
+void trace_event_at(RTIME time, unsigned char kind, unsigned short data, unsigned int arg)
+{
+  int cpu = rtai_cpuid();
+  TraceRing *ring = &trace_rings[cpu];
+  unsigned int sequence = (unsigned int)atomic_inc_return(&ring->head) - 1;
+  TraceSlot *slot = &ring->slots[sequence & (TRACE_RING_SIZE - 1)];
+
+  slot->sequence = 0;
+  smp_wmb();
+  slot->data.time = time;
+  slot->data.kind = kind;
+  slot->data.cpu = cpu;
+  slot->data.data = data;
+  slot->data.arg = arg;
+  smp_wmb();
+  slot->sequence = sequence + 1;
+}
+
+void trace_event(unsigned char kind, unsigned short data, unsigned int arg)
+{
+  trace_event_at(rt_get_time_ns(), kind, data, arg);
+}
+
+/**
+ * @brief Moves the published records of a ring to the trace fifo.
+ *
+ * @param ring The ring.
+ * @return unsigned long The number of records the writers overwrote before they were moved.
+ */
+static unsigned long drain_ring(TraceRing *ring)
+{
+  unsigned long lost = 0;
+
+  while (1)
+  {
+    unsigned int head = (unsigned int)atomic_read(&ring->head);
+    if (ring->tail == head)
+    {
+      break;
+    }
+    // The writers lapped the trace task, the oldest records are gone
+    if (head - ring->tail > TRACE_RING_SIZE)
+    {
+      lost += head - TRACE_RING_SIZE - ring->tail;
+      ring->tail = head - TRACE_RING_SIZE;
+    }
+
+    TraceSlot *slot = &ring->slots[ring->tail & (TRACE_RING_SIZE - 1)];
+    unsigned int sequence = slot->sequence;
+    smp_rmb();
+    if (sequence != ring->tail + 1)
+    {
+      if (sequence != 0 && (int)(sequence - (ring->tail + 1)) > 0)
+      {
+        // Overwritten by a newer record
+        lost++;
+        ring->tail++;
+        continue;
+      }
+      // Still being written, the next pass takes it
+      break;
+    }
+    TraceData data = slot->data;
+    smp_rmb();
+    if (slot->sequence != sequence)
+    {
+      lost++;
+      ring->tail++;
+      continue;
+    }
+    // A full fifo keeps the record in the ring until the reader caught up
+    if (rtf_put(FIFO_TRACE, &data, sizeof(data)) != sizeof(data))
+    {
+      break;
+    }
+    ring->tail++;
+  }
+  return lost;
+}
+
+void send_trace_task(long arg)
+{
+  int cpu;
+
+  while (1)
+  {
+    if (trace_streaming)
+    {
+      for (cpu = 0; cpu < RTAI_NR_CPUS; cpu++)
+      {
+        statistics[STATISTIC_TRACE_LOST] += drain_ring(&trace_rings[cpu]);
+      }
+    }
+    else
+    {
+      // Without a reader the rings keep the latest records, the stream starts with them
+      for (cpu = 0; cpu < RTAI_NR_CPUS; cpu++)
+      {
+        unsigned int head = (unsigned int)atomic_read(&trace_rings[cpu].head);
+        if (head - trace_rings[cpu].tail > TRACE_RING_SIZE)
+        {
+          trace_rings[cpu].tail = head - TRACE_RING_SIZE;
+        }
+      }
+    }
+    rt_task_wait_period();
+  }
+}
+
+EXPORT_SYMBOL(send_trace_task);
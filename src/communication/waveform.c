@@ -0,0 +1,10 @@
+#include "communication/waveform.h"
+
+#include "communication/railroad_communication.h"
+
+DEFINE_WAVEFORM_ENCODER(encode_waveform, DCC_SIGNAL)
+
+void init_waveform(void)
+{
+  encode_waveform_init();
+}
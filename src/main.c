@@ -6,10 +6,23 @@
 #include "telegram/locomotive.h"
 #include "command.h"
 
-int main()
+int main(int argc, char *argv[])
 {
     int exit;
 
+    // Every argument is a command line run before the prompt, e.g. "snapshot --load" after a reload
+    for (int i = 1; i < argc; i++)
+    {
+        char *line = strdup(argv[i]);
+        char *command = strtok(line, " ");
+        char *args = strtok(NULL, "\0");
+        if (command != NULL)
+        {
+            handle_command(command, args);
+        }
+        free(line);
+    }
+
     do
     {
         char *command = NULL;
@@ -6,46 +6,105 @@
 #include <rtai_fifos.h>
 #include "communication/railroad_communication.h"
 #include "communication/rtai_linux_communication.h"
+#include "communication/emergency.h"
+#include "communication/bitslice.h"
+#include "communication/route.h"
+#include "communication/pulse.h"
+#include "communication/schedule.h"
+#include "communication/plan.h"
+#include "communication/protocol.h"
+#include "communication/consist.h"
+#include "communication/trace.h"
 #define STACK_SIZE 4096
 #define FIFO_SIZE 1024
+#define FIFO_CAPTURE_SIZE 65536 /* About 1.5 s of packets of eight busy districts */
+#define FIFO_TRACE_SIZE 131072  /* 8192 records, the rings of four CPUs */
+#define PERIOD_TRACE_TASK 20000000
+#define FIFO_UART_SIZE 16384    /* About 4 s of packets of a busy UART district */
 #define PERIOD_TIMER 20000000
-#define PERIOD_MAG_TASK 70000000
-#define PERIOD_LOC_TASK 60000000
+#define START_DELAY 10000000 /* 10 ms until the first refresh, slots without a state stay silent */
+#define CPU_EMERGENCY_TASK 0 /* CPU of the emergency task */
+#define CPU_MAGNETIC_TASK 0  /* CPU of the accessory and route tasks */
 
 static __init int send_init(void)
 {
   rt_mount_rtai();
 
-  rt_sem_init(&bit_sem, 1);
+  rt_sem_init(&emergency_sem, 0);
+  rt_sem_init(&route_sem, 0);
+  rt_sem_init(&pulse_sem, 0);
+  rt_sem_init(&pulse_queue_sem, 1);
+  rt_sem_init(&schedule_sem, 0);
+  rt_sem_init(&schedule_queue_sem, 1);
+  rt_sem_init(&command_sem, 1);
+  rt_sem_init(&consist_sem, 1);
   int i;
   for (i = 0; i < LOC_MSQ_SIZE; i++)
   {
-    rt_sem_init(&loc_sem[i], 1);
-  }
-  for (i = 0; i < MAG_MSQ_SIZE; i++)
-  {
-    rt_sem_init(&mag_sem[i], 1);
+    rt_sem_init(&locomotive_slots[i].sem, 1);
   }
+  rt_sem_init(&magnetic_queue_sem, 1);
 
   rtf_create(FIFO_CMD, FIFO_SIZE);
   rtf_create_handler(FIFO_CMD, &fifo_handler);
   rtf_create(FIFO_ACK, FIFO_SIZE);
+  rtf_create(FIFO_EVENT, FIFO_SIZE);
+  rtf_create(FIFO_CAPTURE, FIFO_CAPTURE_SIZE);
+  rtf_create(FIFO_TRACE, FIFO_TRACE_SIZE);
+  rtf_create(FIFO_UART, FIFO_UART_SIZE);
+
+  // Half bits of 58 us can't be timed with a periodic tick, the waveforms need the one-shot timer
+  rt_set_oneshot_mode();
+  start_rt_timer(nano2count(PERIOD_TIMER));
 
-  rt_task_init(magnetic_task, send_magnetic_msg_task, 0, STACK_SIZE, 2, 0, 0);
+  // The shards must be known before the tasks are placed on their CPUs
+  init_waveform();
+  init_track();
+  init_protocol();
+  init_plan();
+  init_emergency();
+  init_schedule();
+
+  // Each track task owns the port of its shard and must never wait, the emergency task comes before all others.
+  // A locomotive task runs on the CPU of the shard driving the locomotive, so its hand-off stays local.
+  for (i = 0; i < shard_count; i++)
+  {
+    rt_task_init_cpuid(&shards[i].track_task, send_track_task, i, STACK_SIZE, 0, 0, 0, shards[i].cpu);
+  }
+  rt_task_init_cpuid(&emergency_task, send_emergency_task, 0, STACK_SIZE, 1, 0, 0, CPU_EMERGENCY_TASK);
+  rt_task_init_cpuid(&magnetic_task, send_magnetic_msg_task, 0, STACK_SIZE, 3, 0, 0, CPU_MAGNETIC_TASK);
+  rt_task_init_cpuid(&route_task, send_route_task, 0, STACK_SIZE, 3, 0, 0, CPU_MAGNETIC_TASK);
+  // The pulse width must not depend on the accessory queue, so deactivations come before it
+  rt_task_init_cpuid(&pulse_task, send_pulse_task, 0, STACK_SIZE, 2, 0, 0, CPU_MAGNETIC_TASK);
+  // Scheduled commands only queue their packets, so they are released before the packets are sent
+  rt_task_init_cpuid(&schedule_task, send_schedule_task, 0, STACK_SIZE, 1, 0, 0, CPU_MAGNETIC_TASK);
   for (i = 0; i < LOC_MSQ_SIZE; i++)
   {
-    rt_task_init(&loco_tasks[i], send_loco_msg_task, i, STACK_SIZE, 1, 0, 0);
+    rt_task_init_cpuid(&locomotive_slots[i].task, send_loco_msg_task, i, STACK_SIZE, 2, 0, 0,
+                       cpu_of_locomotive(i + 1));
   }
+  // The trace only runs when nothing else is due, it must never delay a packet
+  rt_task_init_cpuid(&trace_task, send_trace_task, 0, STACK_SIZE, 4, 0, 0, CPU_MAGNETIC_TASK);
 
-  rt_set_periodic_mode();
-  start_rt_timer(nano2count(PERIOD_TIMER));
-
-  rt_task_make_periodic(magnetic_task, rt_get_time() + nano2count(1000000000), nano2count(PERIOD_MAG_TASK));
+  for (i = 0; i < shard_count; i++)
+  {
+    rt_task_resume(&shards[i].track_task);
+  }
+  rt_task_resume(&emergency_task);
+  rt_task_resume(&route_task);
+  rt_task_resume(&pulse_task);
+  rt_task_resume(&schedule_task);
+  // Only the refresh of the locomotives may be degraded, the accessory queue has to keep draining
+  deadline_make_periodic(&magnetic_deadline, &magnetic_task, rt_get_time() + nano2count(START_DELAY), PERIOD_MAG_TASK, 0);
   for (i = 0; i < LOC_MSQ_SIZE; i++)
   {
-    rt_task_make_periodic(&loco_tasks[i], rt_get_time() + nano2count(1000000000), nano2count(PERIOD_LOC_TASK + i));
+    // The slots share one period, their phases keep them from handing their packets at the same time
+    deadline_make_periodic(&locomotive_slots[i].deadline, &locomotive_slots[i].task,
+                           rt_get_time() + nano2count(START_DELAY + plan_phase(i)), PERIOD_LOC_TASK, 1);
   }
 
+  rt_task_make_periodic(&trace_task, rt_get_time() + nano2count(START_DELAY), nano2count(PERIOD_TRACE_TASK));
+
   rt_printk("Module loaded\n");
 
   return 0;
@@ -55,25 +114,43 @@ static __exit void send_exit(void)
 {
   stop_rt_timer();
 
-  rt_task_delete(magnetic_task);
   int i;
+  for (i = 0; i < shard_count; i++)
+  {
+    rt_task_delete(&shards[i].track_task);
+  }
+  rt_task_delete(&emergency_task);
+  rt_task_delete(&magnetic_task);
+  rt_task_delete(&route_task);
+  rt_task_delete(&pulse_task);
+  rt_task_delete(&schedule_task);
   for (i = 0; i < LOC_MSQ_SIZE; i++)
   {
-    rt_task_delete(&loco_tasks[i]);
+    rt_task_delete(&locomotive_slots[i].task);
   }
+  rt_task_delete(&trace_task);
 
     rtf_destroy(FIFO_CMD);
   rtf_destroy(FIFO_ACK);
+  rtf_destroy(FIFO_EVENT);
+  rtf_destroy(FIFO_CAPTURE);
+  rtf_destroy(FIFO_TRACE);
+  rtf_destroy(FIFO_UART);
 
-  rt_sem_delete(&bit_sem);
+  cleanup_track();
+  rt_sem_delete(&emergency_sem);
+  rt_sem_delete(&route_sem);
+  rt_sem_delete(&pulse_sem);
+  rt_sem_delete(&pulse_queue_sem);
+  rt_sem_delete(&schedule_sem);
+  rt_sem_delete(&schedule_queue_sem);
+  rt_sem_delete(&command_sem);
+  rt_sem_delete(&consist_sem);
   for (i = 0; i < LOC_MSQ_SIZE; i++)
   {
-    rt_sem_delete(&loc_sem[i]);
-  }
-  for (i = 0; i < MAG_MSQ_SIZE; i++)
-  {
-    rt_sem_delete(&mag_sem[i]);
+    rt_sem_delete(&locomotive_slots[i].sem);
   }
+  rt_sem_delete(&magnetic_queue_sem);
 
   rt_umount_rtai();
   rt_printk("Unloading module\n");
@@ -0,0 +1,148 @@
+#include "snapshot.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "telegram/locomotive.h"
+#include "telegram/magnetic.h"
+
+#define SNAPSHOT_SIZE (sizeof(SnapshotHeader) + (SNAPSHOT_LOCOMOTIVES + SNAPSHOT_MAGNETICS) * sizeof(unsigned short))
+
+static int snapshot_fd = -1;
+
+/**
+ * @brief Writes an empty snapshot with a valid header.
+ *
+ * @param fd The file descriptor of the snapshot.
+ * @return int Returns 0 on success, -1 on failure.
+ */
+static int snapshot_init(int fd)
+{
+    static const unsigned short empty[SNAPSHOT_LOCOMOTIVES + SNAPSHOT_MAGNETICS];
+    SnapshotHeader header = {
+        .magic = SNAPSHOT_MAGIC,
+        .version = SNAPSHOT_VERSION,
+        .reserved = 0,
+    };
+
+    if (ftruncate(fd, 0) != 0 ||
+        pwrite(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        pwrite(fd, empty, sizeof(empty), sizeof(header)) != sizeof(empty))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Opens the snapshot, creating it if it is missing or invalid.
+ *
+ * @return int The file descriptor of the snapshot or -1 on failure.
+ */
+static int snapshot_open(void)
+{
+    if (snapshot_fd >= 0)
+    {
+        return snapshot_fd;
+    }
+
+    int fd = open(SNAPSHOT_FILE, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+    {
+        perror("Failed to open the snapshot");
+        return -1;
+    }
+
+    SnapshotHeader header;
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header) || header.magic != SNAPSHOT_MAGIC ||
+        header.version != SNAPSHOT_VERSION || lseek(fd, 0, SEEK_END) != SNAPSHOT_SIZE)
+    {
+        if (snapshot_init(fd) != 0)
+        {
+            perror("Failed to create the snapshot");
+            close(fd);
+            return -1;
+        }
+    }
+
+    snapshot_fd = fd;
+    return fd;
+}
+
+void snapshot_record(unsigned short data)
+{
+    unsigned short type = (data >> 13) & 0x3;
+    off_t index;
+
+    if (type == 0x1)
+    {
+        LocomotiveDataConverter converter = {.us = data};
+        index = converter.ld.address;
+    }
+    else if (type == 0x2)
+    {
+        MagneticDataConverter converter = {.us = data};
+        if (!converter.md.enable)
+        {
+            return;
+        }
+        index = SNAPSHOT_LOCOMOTIVES + converter.md.address * 4 + converter.md.device;
+    }
+    else
+    {
+        return;
+    }
+
+    int fd = snapshot_open();
+    if (fd < 0)
+    {
+        return;
+    }
+
+    // Only the word of the decoder is rewritten, the rest of the snapshot stays untouched
+    data &= 0x7FFF;
+    if (pwrite(fd, &data, sizeof(data), sizeof(SnapshotHeader) + index * sizeof(unsigned short)) != sizeof(data))
+    {
+        perror("Failed to update the snapshot");
+    }
+}
+
+int snapshot_read(unsigned short *locomotives, unsigned short *magnetics)
+{
+    int fd = open(SNAPSHOT_FILE, O_RDONLY);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    SnapshotHeader header;
+    int valid = pread(fd, &header, sizeof(header), 0) == sizeof(header) && header.magic == SNAPSHOT_MAGIC &&
+                header.version == SNAPSHOT_VERSION;
+    off_t offset = sizeof(header);
+    if (valid)
+    {
+        size_t size = SNAPSHOT_LOCOMOTIVES * sizeof(unsigned short);
+        valid = pread(fd, locomotives, size, offset) == size;
+        offset += size;
+    }
+    if (valid)
+    {
+        size_t size = SNAPSHOT_MAGNETICS * sizeof(unsigned short);
+        valid = pread(fd, magnetics, size, offset) == size;
+    }
+
+    close(fd);
+    return valid ? 0 : -1;
+}
+
+int snapshot_clear(void)
+{
+    int fd = snapshot_open();
+    if (fd < 0)
+    {
+        return -1;
+    }
+    return snapshot_init(fd);
+}
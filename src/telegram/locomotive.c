@@ -35,4 +35,39 @@ unsigned long long buildLocomotiveTelegram(LocomotiveData data)
     converter.lt = telegram;
     
     return converter.ull;
-}
\ No newline at end of file
+}
+
+unsigned long long buildLongLocomotiveTelegram(int address, LocomotiveData data)
+{
+    // The first address byte starts with 0b11, the low byte follows
+    char address_high = 0b11000000 | ((address >> 8) & 0x3F);
+    char address_low = address & 0xFF;
+
+    // The command byte is the same as the one to a short address
+    char command = 0b01000000 | (data.direction << 5) | (data.light << 4) | data.speed;
+
+    // The checksum covers both address bytes
+    char checksum = address_high ^ address_low ^ command;
+
+    LongLocomotiveTelegram telegram = {
+        .preamble = 0b11111111111111, // Preamble for synchronization. Fixed 14-bit value: 0b11111111111111 (0x3FFF).
+        .start_bit_address = 0,       // Start bit for the address section
+        .long_bits = 0b11,            // Marks the long address
+        .address_high = address >> 8, // High bits of the address
+        .start_bit_low = 0,           // Start bit for the low address byte
+        .address_low = address_low,   // Low byte of the address
+        .start_bit_cmd = 0,           // Start bit for the command section
+        .cmd_bits_7_6 = 0b01,         // Fixed command bits
+        .direction = data.direction,  // Direction of the locomotive
+        .light = data.light,          // Light status (on/off)
+        .speed = data.speed,          // Speed of the locomotive
+        .start_bit_cs = 0,            // Start bit for the checksum section
+        .checksum = checksum,         // Calculated checksum value.
+        .stop_bit = 1,                // Stop bit
+        .reserved = 0,                // Reserved field
+    };
+    LongLocomotiveConverter converter;
+    converter.lt = telegram;
+
+    return converter.ull;
+}
@@ -0,0 +1,35 @@
+#include "telegram/motorola.h"
+
+unsigned long long buildMotorolaTelegram(int address, int function, int speed)
+{
+    // Bit pairs of the trits 0, 1 and 2
+    static const unsigned char trit_bits[3] = {0b00, 0b11, 0b10};
+    unsigned char address_bits = 0;
+    unsigned char speed_bits = 0;
+    int i;
+
+    // Address 80 is sent as 0000, the least significant trit comes first
+    address %= MOTOROLA_ADDRESS_MAX;
+    for (i = 0; i < 4; i++)
+    {
+        address_bits |= trit_bits[address % 3] << (6 - 2 * i);
+        address /= 3;
+    }
+
+    // The least significant speed bit comes first, every bit is doubled
+    for (i = 0; i < 4; i++)
+    {
+        speed_bits |= (((speed >> i) & 0x01) ? 0b11 : 0b00) << (6 - 2 * i);
+    }
+
+    MotorolaTelegram telegram = {
+        .address = address_bits,              // Address trits
+        .function = function ? 0b11 : 0b00,   // Function (light)
+        .speed = speed_bits,                  // Doubled speed bits
+        .reserved = 0,                        // Reserved field
+    };
+    MotorolaConverter converter;
+    converter.mt = telegram;
+
+    return converter.ull;
+}
@@ -0,0 +1,121 @@
+#include "telegram/uart.h"
+
+#define UART_UNITS (UART_FRAME_BITS / 2) /* A byte holds five 1-bits */
+#define UART_MAX_BITS 64
+#define UART_UNREACHED 0xFFFF
+
+/**
+ * @brief Sets the level of a UART bit in the encoded bytes, the start and stop bits are implied.
+ */
+static void set_level(unsigned char *bytes, int slot, int level)
+{
+    int position = slot % UART_FRAME_BITS;
+    if (level && position >= 1 && position <= 8)
+    {
+        bytes[slot / UART_FRAME_BITS] |= 1 << (position - 1);
+    }
+}
+
+int encodeUartTelegram(unsigned long long message, int length, unsigned char *bytes, int size)
+{
+    // A 1-bit takes one unit of two UART bits, a 0-bit of k UART bits per half takes k units.
+    // cost[u] is the fewest units for the bits so far ending with u units of the current byte,
+    // width[i][u] the units of bit i on that packing. Only the widths are kept for all bits, the
+    // encoder runs on the stack of the track task.
+    unsigned short cost[UART_UNITS], next_cost[UART_UNITS];
+    unsigned char width[UART_MAX_BITS][UART_UNITS];
+    int i, u, k;
+
+    if (length <= 0 || length > UART_MAX_BITS)
+    {
+        return -1;
+    }
+    // Leading one bits fill the first byte up to the preamble
+    for (u = 0; u < UART_UNITS; u++)
+    {
+        cost[u] = u;
+    }
+    for (i = 0; i < length; i++)
+    {
+        int bit = (message >> (63 - i)) & 0x1;
+        int first = bit ? 1 : 2;
+        int last = bit ? 1 : UART_ZERO_MAX;
+
+        for (u = 0; u < UART_UNITS; u++)
+        {
+            next_cost[u] = UART_UNREACHED;
+        }
+        for (u = 0; u < UART_UNITS; u++)
+        {
+            if (cost[u] == UART_UNREACHED)
+            {
+                continue;
+            }
+            // The stop bit ends a DCC bit, so no bit spans two bytes
+            for (k = first; k <= last && u + k <= UART_UNITS; k++)
+            {
+                int next = (u + k) % UART_UNITS;
+                if (cost[u] + k < next_cost[next])
+                {
+                    next_cost[next] = cost[u] + k;
+                    width[i][next] = k;
+                }
+            }
+        }
+        for (u = 0; u < UART_UNITS; u++)
+        {
+            cost[u] = next_cost[u];
+        }
+    }
+
+    // Trailing one bits fill the last byte, they lengthen the preamble of the next packet
+    int end = -1;
+    int units = 0;
+    for (u = 0; u < UART_UNITS; u++)
+    {
+        int total = cost[u] + (UART_UNITS - u) % UART_UNITS;
+        if (cost[u] != UART_UNREACHED && (end < 0 || total < units))
+        {
+            end = u;
+            units = total;
+        }
+    }
+    int count = units / UART_UNITS;
+    if (end < 0 || count > size)
+    {
+        return -1;
+    }
+
+    // Walk the packing backwards from the end of the line, the low half of every bit comes first
+    for (i = 0; i < count; i++)
+    {
+        bytes[i] = 0;
+    }
+    int slot = count * UART_FRAME_BITS;
+    for (k = 0; k < (UART_UNITS - end) % UART_UNITS; k++)
+    {
+        set_level(bytes, --slot, 1);
+        set_level(bytes, --slot, 0);
+    }
+    u = end;
+    for (i = length - 1; i >= 0; i--)
+    {
+        int j;
+        k = width[i][u];
+        for (j = 0; j < k; j++)
+        {
+            set_level(bytes, --slot, 1);
+        }
+        for (j = 0; j < k; j++)
+        {
+            set_level(bytes, --slot, 0);
+        }
+        u = (u - k + UART_UNITS) % UART_UNITS;
+    }
+    while (slot > 0)
+    {
+        set_level(bytes, --slot, 1);
+        set_level(bytes, --slot, 0);
+    }
+    return count;
+}
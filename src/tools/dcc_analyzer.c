@@ -0,0 +1,599 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "tools/dcc_decoder.h"
+
+// Timing windows of NMRA S-9.1 in nanoseconds, for the command station and for a decoder
+#define TX_1_HALF_MIN 55000     /* Shortest half 1-Bit a command station may send */
+#define TX_1_HALF_MAX 61000     /* Longest half 1-Bit a command station may send */
+#define TX_1_SKEW_MAX 3000      /* Largest difference between both halves of a 1-Bit */
+#define TX_0_HALF_MIN 95000     /* Shortest half 0-Bit a command station may send */
+#define TX_0_HALF_MAX 9900000   /* Longest half 0-Bit a command station may send */
+#define TX_0_BIT_MAX 12000000   /* Longest 0-Bit a command station may send */
+#define RX_1_HALF_MIN 52000     /* Shortest half bit a decoder accepts as 1 */
+#define RX_1_HALF_MAX 64000     /* Longest half bit a decoder accepts as 1 */
+#define RX_0_HALF_MIN 90000     /* Shortest half bit a decoder accepts as 0 */
+#define RX_0_HALF_MAX 10000000  /* Longest half bit a decoder accepts as 0 */
+#define TX_PREAMBLE_MIN 14      /* One bits a command station sends before a packet */
+#define CSV_LINE_MAX 1024
+
+/**
+ * @enum violation
+ * @brief Kinds of timing and framing violations.
+ */
+enum violation
+{
+    VIOLATION_1_HALF = 0,      // A half 1-Bit outside the window of the command station.
+    VIOLATION_1_SKEW = 1,      // The halves of a 1-Bit differ too much.
+    VIOLATION_0_HALF = 2,      // A half 0-Bit outside the window of the command station.
+    VIOLATION_0_BIT = 3,       // A stretched 0-Bit is too long.
+    VIOLATION_UNDECODABLE = 4, // A half bit a decoder accepts neither as 1 nor as 0.
+    VIOLATION_ALIGNMENT = 5,   // The halves of a bit inside a packet are of different kinds.
+    VIOLATION_PREAMBLE = 6,    // A packet follows less than TX_PREAMBLE_MIN one bits.
+    VIOLATION_FRAMING = 7,     // A packet is too long or shorter than three bytes.
+    VIOLATION_CHECKSUM = 8,    // The error detection byte of a packet does not match.
+    VIOLATION_COUNT = 9,
+};
+
+static const char *violation_names[VIOLATION_COUNT] = {
+    "half 1-bit out of 55-61 us",
+    "1-bit halves differ > 3 us",
+    "half 0-bit out of 95-9900 us",
+    "0-bit longer than 12 ms",
+    "undecodable half bit",
+    "bit halves misaligned",
+    "preamble < 14 bits",
+    "packet framing",
+    "error detection byte",
+};
+
+// Unit of the value printed with each kind of violation
+static const char *violation_units[VIOLATION_COUNT] = {"ns", "ns", "ns", "ns", "ns", "ns", "bits", "ns", "xor"};
+
+/**
+ * @struct HalfBitStatistics
+ * @brief Distribution of the measured half bits of one kind in nanoseconds.
+ */
+typedef struct
+{
+    unsigned long count; // Number of half bits.
+    long long min;                             // Shortest half bit.
+    long long max;                             // Longest half bit.
+    double sum;                                // Sum of all half bits.
+    double sum_squares;                        // Sum of the squares of all half bits.
+} HalfBitStatistics;
+
+/**
+ * @struct Analyzer
+ * @brief State of the streaming reconstruction and its results.
+ */
+typedef struct
+{
+    // Edges and half bits
+    unsigned long long edges;                  // Edges read.
+    long long first_edge;                      // Time of the first edge.
+    long long last_edge;                       // Time of the last edge.
+    int has_half;                              // A half bit waits for the second half of its bit.
+    long long half;                            // Duration of the waiting half bit.
+    int half_kind;                             // Kind of the waiting half bit, 1 or 0.
+    long long half_start;                      // Start of the waiting half bit.
+
+    // Packet reconstruction
+    int ones;                                  // One bits since the last zero bit, the preamble.
+    int in_packet;                             // The start bit of the first byte was seen.
+    int synchronized;                          // A packet ended, the preamble of the next one is complete.
+    int bit_in_byte;                           // Bits of the current byte, -1 while waiting for a start or end bit.
+    unsigned char byte;                        // The current byte.
+    DccPacket packet;                          // Bytes of the current packet.
+    int too_long;                              // The packet has more bytes than DCC_MAX_BYTES.
+    long long preamble_start;                  // Start of the first one bit of the preamble.
+    long long packet_start;                    // Start of the preamble of the current packet.
+
+    // Results
+    DccFleet fleet;                            // Emulated decoders, classify the packets.
+    unsigned long kinds[DCC_UNKNOWN + 1];      // Packets per kind.
+    unsigned long long busy_time;              // Time of all packets other than idle packets.
+    unsigned long long packet_time;            // Time of all packets including their preambles.
+    HalfBitStatistics halves[2];               // Measured half 0-Bits and half 1-Bits.
+    unsigned long violations[VIOLATION_COUNT]; // Violations per kind.
+    int reported;                              // Violations printed.
+    int report_max;                            // Most violations to print.
+} Analyzer;
+
+static void add_half(HalfBitStatistics *stats, long long duration)
+{
+    if (stats->count == 0 || duration < stats->min)
+    {
+        stats->min = duration;
+    }
+    if (stats->count == 0 || duration > stats->max)
+    {
+        stats->max = duration;
+    }
+    stats->count++;
+    stats->sum += duration;
+    stats->sum_squares += (double)duration * duration;
+}
+
+/**
+ * @brief Counts a violation and prints the first ones with their time in the trace.
+ */
+static void violation(Analyzer *a, int kind, long long time, long long value)
+{
+    a->violations[kind]++;
+    if (a->reported < a->report_max)
+    {
+        a->reported++;
+        printf("%14.6f s  %-28s %lld %s\n", (time - a->first_edge) / 1e9, violation_names[kind], value,
+               violation_units[kind]);
+    }
+}
+
+/**
+ * @brief Ends the current packet and accounts it.
+ *
+ * @param a The analyzer.
+ * @param end The end of the packet end bit.
+ */
+static void finish_packet(Analyzer *a, long long end)
+{
+    a->packet_time += end - a->packet_start;
+
+    if (a->too_long || a->packet.count < 3)
+    {
+        violation(a, VIOLATION_FRAMING, a->packet_start, end - a->packet_start);
+        return;
+    }
+    unsigned char check = 0;
+    for (int i = 0; i < a->packet.count; i++)
+    {
+        check ^= a->packet.bytes[i];
+    }
+    if (check != 0)
+    {
+        violation(a, VIOLATION_CHECKSUM, a->packet_start, check);
+        return;
+    }
+
+    int decoder;
+    int kind = dcc_apply(&a->fleet, &a->packet, &decoder);
+    a->kinds[kind]++;
+    if (kind != DCC_IDLE)
+    {
+        a->busy_time += end - a->packet_start;
+    }
+}
+
+/**
+ * @brief Feeds a complete bit into the packet reconstruction.
+ *
+ * @param a The analyzer.
+ * @param bit The value of the bit.
+ * @param start The start of the bit.
+ * @param end The end of the bit.
+ */
+static void add_bit(Analyzer *a, int bit, long long start, long long end)
+{
+    if (!a->in_packet)
+    {
+        if (bit == 1)
+        {
+            if (a->ones++ == 0)
+            {
+                a->preamble_start = start;
+            }
+            return;
+        }
+        // A zero after a preamble a decoder accepts is the start bit of the first byte
+        if (a->ones >= DCC_PREAMBLE_MIN)
+        {
+            // The trace may start within the preamble of its first packet
+            if (a->ones < TX_PREAMBLE_MIN && a->synchronized)
+            {
+                violation(a, VIOLATION_PREAMBLE, a->preamble_start, a->ones);
+            }
+            a->in_packet = 1;
+            a->bit_in_byte = 0;
+            a->byte = 0;
+            a->packet.count = 0;
+            a->too_long = 0;
+            a->packet_start = a->preamble_start;
+        }
+        a->ones = 0;
+        return;
+    }
+
+    if (a->bit_in_byte >= 0)
+    {
+        a->byte = (a->byte << 1) | bit;
+        if (++a->bit_in_byte == 8)
+        {
+            if (a->packet.count < DCC_MAX_BYTES)
+            {
+                a->packet.bytes[a->packet.count++] = a->byte;
+            }
+            else
+            {
+                a->too_long = 1;
+            }
+            a->bit_in_byte = -1;
+        }
+        return;
+    }
+
+    if (bit == 0)
+    {
+        // Start bit of the next byte
+        a->bit_in_byte = 0;
+        a->byte = 0;
+        return;
+    }
+
+    // The packet end bit may be the first bit of the next preamble, its time belongs to this packet
+    finish_packet(a, end);
+    a->synchronized = 1;
+    a->in_packet = 0;
+    a->ones = 1;
+    a->preamble_start = end;
+}
+
+/**
+ * @brief Pairs a half bit with the previous one and checks the timing of the bit.
+ *
+ * @param a The analyzer.
+ * @param start The start of the half bit.
+ * @param duration The duration of the half bit.
+ */
+static void add_half_bit(Analyzer *a, long long start, long long duration)
+{
+    int kind;
+    if (duration >= RX_1_HALF_MIN && duration <= RX_1_HALF_MAX)
+    {
+        kind = 1;
+    }
+    else if (duration >= RX_0_HALF_MIN && duration <= RX_0_HALF_MAX)
+    {
+        kind = 0;
+    }
+    else
+    {
+        // A decoder loses the packet, it waits for the next preamble
+        violation(a, VIOLATION_UNDECODABLE, start, duration);
+        a->has_half = 0;
+        a->in_packet = 0;
+        a->ones = 0;
+        return;
+    }
+    add_half(&a->halves[kind], duration);
+
+    if (!a->has_half)
+    {
+        a->has_half = 1;
+        a->half = duration;
+        a->half_kind = kind;
+        a->half_start = start;
+        return;
+    }
+    if (kind != a->half_kind)
+    {
+        // In the preamble the pairing starts anywhere and aligns itself at the start bit
+        if (a->in_packet)
+        {
+            violation(a, VIOLATION_ALIGNMENT, a->half_start, a->half);
+            a->in_packet = 0;
+            a->ones = 0;
+        }
+        a->half = duration;
+        a->half_kind = kind;
+        a->half_start = start;
+        return;
+    }
+    a->has_half = 0;
+
+    long long first = a->half;
+    if (kind == 1)
+    {
+        if (first < TX_1_HALF_MIN || first > TX_1_HALF_MAX)
+        {
+            violation(a, VIOLATION_1_HALF, a->half_start, first);
+        }
+        if (duration < TX_1_HALF_MIN || duration > TX_1_HALF_MAX)
+        {
+            violation(a, VIOLATION_1_HALF, start, duration);
+        }
+        if (llabs(first - duration) > TX_1_SKEW_MAX)
+        {
+            violation(a, VIOLATION_1_SKEW, a->half_start, first - duration);
+        }
+    }
+    else
+    {
+        if (first < TX_0_HALF_MIN || first > TX_0_HALF_MAX)
+        {
+            violation(a, VIOLATION_0_HALF, a->half_start, first);
+        }
+        if (duration < TX_0_HALF_MIN || duration > TX_0_HALF_MAX)
+        {
+            violation(a, VIOLATION_0_HALF, start, duration);
+        }
+        if (first + duration > TX_0_BIT_MAX)
+        {
+            violation(a, VIOLATION_0_BIT, a->half_start, first + duration);
+        }
+    }
+    add_bit(a, kind, a->half_start, start + duration);
+}
+
+/**
+ * @brief Feeds the next edge of the trace.
+ *
+ * @param a The analyzer.
+ * @param time The time of the edge in nanoseconds.
+ */
+static void add_edge(Analyzer *a, long long time)
+{
+    if (a->edges++ == 0)
+    {
+        a->first_edge = time;
+    }
+    else
+    {
+        add_half_bit(a, a->last_edge, time - a->last_edge);
+    }
+    a->last_edge = time;
+}
+
+/**
+ * @brief Reads a trace of edge times as raw 64-bit nanoseconds.
+ *
+ * @return int 0 on success, -1 if the edges are not in order.
+ */
+static int read_binary(FILE *file, Analyzer *a)
+{
+    unsigned long long times[4096];
+    size_t n;
+    while ((n = fread(times, sizeof(times[0]), 4096, file)) > 0)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            if (a->edges > 0 && (long long)times[i] < a->last_edge)
+            {
+                printf("Edge %llu goes back in time\n", a->edges);
+                return -1;
+            }
+            add_edge(a, times[i]);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads a CSV export of a logic analyzer.
+ *
+ * The first column is the time, lines which do not start with a number are skipped. With a level
+ * column every change of the level is an edge, without one every line is an edge.
+ *
+ * @param file The CSV file.
+ * @param a The analyzer.
+ * @param scale Nanoseconds per unit of the time column.
+ * @param column The column of the level, 0 if every line is an edge.
+ * @return int 0 on success, -1 if the edges are not in order.
+ */
+static int read_csv(FILE *file, Analyzer *a, double scale, int column)
+{
+    char line[CSV_LINE_MAX];
+    int level = -1;
+    unsigned long number = 0;
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        number++;
+        char *p = line;
+        while (isspace((unsigned char)*p))
+        {
+            p++;
+        }
+        if (!(isdigit((unsigned char)*p) || *p == '-' || *p == '+' || *p == '.'))
+        {
+            continue;
+        }
+
+        char *end;
+        double value = strtod(p, &end);
+        if (end == p)
+        {
+            continue;
+        }
+        long long time = (long long)(value * scale + (value < 0 ? -0.5 : 0.5));
+
+        if (column > 0)
+        {
+            p = end;
+            for (int c = 0; c < column && p != NULL; c++)
+            {
+                p = strpbrk(p, ",;\t");
+                p = p != NULL ? p + 1 : NULL;
+            }
+            if (p == NULL)
+            {
+                printf("Line %lu has no column %d\n", number, column);
+                return -1;
+            }
+            int current = strtol(p, NULL, 10) != 0;
+            // The first line only gives the initial level
+            if (current == level || level < 0)
+            {
+                level = current;
+                continue;
+            }
+            level = current;
+        }
+
+        if (a->edges > 0 && time < a->last_edge)
+        {
+            printf("Line %lu goes back in time\n", number);
+            return -1;
+        }
+        add_edge(a, time);
+    }
+    return 0;
+}
+
+static void print_halves(const char *name, const HalfBitStatistics *stats)
+{
+    if (stats->count == 0)
+    {
+        printf("\t%-28s none\n", name);
+        return;
+    }
+    double mean = stats->sum / stats->count;
+    double variance = stats->sum_squares / stats->count - mean * mean;
+    double deviation = 0;
+    // Newton steps, the tool needs no libm for one square root
+    if (variance > 0)
+    {
+        deviation = variance;
+        for (int i = 0; i < 64; i++)
+        {
+            deviation = (deviation + variance / deviation) / 2;
+        }
+    }
+    printf("\t%-28s %lu, min %.3f us, mean %.3f us, max %.3f us, deviation %.3f us\n", name, stats->count,
+           stats->min / 1e3, mean / 1e3, stats->max / 1e3, deviation / 1e3);
+}
+
+static void print_report(const Analyzer *a)
+{
+    double span = a->edges > 1 ? (a->last_edge - a->first_edge) / 1e9 : 0;
+    unsigned long packets = 0;
+    for (int k = 0; k <= DCC_UNKNOWN; k++)
+    {
+        packets += a->kinds[k];
+    }
+    unsigned long violations = 0;
+    for (int v = 0; v < VIOLATION_COUNT; v++)
+    {
+        violations += a->violations[v];
+    }
+
+    printf("trace\n");
+    printf("\t%-28s %llu\n", "edges", a->edges);
+    printf("\t%-28s %.6f s\n", "duration", span);
+    printf("half bits\n");
+    print_halves("1", &a->halves[1]);
+    print_halves("0", &a->halves[0]);
+    printf("packets\n");
+    printf("\t%-28s %lu\n", "decoded", packets);
+    printf("\t%-28s %lu\n", "idle", a->kinds[DCC_IDLE]);
+    printf("\t%-28s %lu\n", "locomotive", a->kinds[DCC_LOCOMOTIVE]);
+    printf("\t%-28s %lu\n", "accessory", a->kinds[DCC_ACCESSORY]);
+    printf("\t%-28s %lu\n", "broadcast and reset", a->kinds[DCC_BROADCAST] + a->kinds[DCC_RESET]);
+    printf("\t%-28s %lu\n", "other", a->kinds[DCC_UNKNOWN]);
+    if (span > 0)
+    {
+        printf("\t%-28s %.1f packets/s\n", "rate", packets / span);
+        printf("\t%-28s %.1f packets/s\n", "rate without idle", (packets - a->kinds[DCC_IDLE]) / span);
+        // Utilization counts the time of the packets other than idle packets, preambles included
+        printf("\t%-28s %.1f %%\n", "line utilization", 100.0 * a->busy_time / (a->last_edge - a->first_edge));
+        printf("\t%-28s %.1f %%\n", "time in packets", 100.0 * a->packet_time / (a->last_edge - a->first_edge));
+    }
+    printf("violations\n");
+    for (int v = 0; v < VIOLATION_COUNT; v++)
+    {
+        printf("\t%-28s %lu\n", violation_names[v], a->violations[v]);
+    }
+    printf("%s\n", violations == 0 ? "The trace conforms to NMRA S-9.1" : "The trace violates NMRA S-9.1");
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [OPTION]... <trace>\n", name);
+    printf("\nDescription: Reconstructs the packets of a trace of the edges on the rails, checks every half bit against the timing of NMRA S-9.1 and reports the packet rate, the line utilization and all violations. Exits with 1 on violations.\n");
+    printf("\nOptions:\n");
+    printf("  --binary                 The trace holds the edge times as raw 64-bit nanoseconds instead of CSV.\n");
+    printf("  --column <n>             CSV column of the signal level, 0 if every line is an edge. Defaults to 1.\n");
+    printf("  --report <count>         Print the first count violations with their time. Defaults to 20.\n");
+    printf("  --unit <s|ms|us|ns>      Unit of the CSV time column. Defaults to s.\n");
+    printf("\nThe trace - is read from the standard input.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = NULL;
+    int binary = 0;
+    int column = 1;
+    double scale = 1e9;
+    static Analyzer analyzer = {.report_max = 20};
+
+    for (int i = 1; i < argc; i++)
+    {
+        int valid = 1;
+        if (strcmp(argv[i], "--binary") == 0)
+        {
+            binary = 1;
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--column") == 0)
+        {
+            valid = sscanf(argv[++i], "%d", &column) == 1 && column >= 0;
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--report") == 0)
+        {
+            valid = sscanf(argv[++i], "%d", &analyzer.report_max) == 1 && analyzer.report_max >= 0;
+        }
+        else if (i + 1 < argc && strcmp(argv[i], "--unit") == 0)
+        {
+            const char *unit = argv[++i];
+            scale = strcmp(unit, "s") == 0 ? 1e9 : strcmp(unit, "ms") == 0 ? 1e6 : strcmp(unit, "us") == 0 ? 1e3
+                                                                                 : strcmp(unit, "ns") == 0 ? 1
+                                                                                                           : 0;
+            valid = scale > 0;
+        }
+        else if (path == NULL && (argv[i][0] != '-' || strcmp(argv[i], "-") == 0))
+        {
+            path = argv[i];
+        }
+        else
+        {
+            valid = 0;
+        }
+
+        if (!valid)
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (path == NULL)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, binary ? "rb" : "r");
+    if (file == NULL)
+    {
+        perror("Failed to open the trace");
+        return EXIT_FAILURE;
+    }
+    int result = binary ? read_binary(file, &analyzer) : read_csv(file, &analyzer, scale, column);
+    if (file != stdin)
+    {
+        fclose(file);
+    }
+    if (result != 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    print_report(&analyzer);
+    for (int v = 0; v < VIOLATION_COUNT; v++)
+    {
+        if (analyzer.violations[v] > 0)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,126 @@
+#include "tools/dcc_decoder.h"
+
+#include <string.h>
+
+/**
+ * @brief Returns a bit of a message, most significant bit first.
+ */
+static int bit_at(unsigned long long message, int i)
+{
+    return (message >> (63 - i)) & 0x1;
+}
+
+int dcc_decode(unsigned long long message, int length, DccPacket *packet)
+{
+    int i = 0;
+
+    // The preamble ends with the first zero bit, which is the start bit of the first byte
+    while (i < length && bit_at(message, i) == 1)
+    {
+        i++;
+    }
+    if (i < DCC_PREAMBLE_MIN)
+    {
+        return DCC_NO_PREAMBLE;
+    }
+
+    packet->count = 0;
+    unsigned char check = 0;
+    while (1)
+    {
+        // Start bit (0) of the next byte or packet end bit (1)
+        if (i >= length)
+        {
+            return DCC_FRAMING;
+        }
+        if (bit_at(message, i++) == 1)
+        {
+            break;
+        }
+        if (i + 8 > length || packet->count >= DCC_MAX_BYTES)
+        {
+            return DCC_FRAMING;
+        }
+
+        unsigned char byte = 0;
+        for (int b = 0; b < 8; b++)
+        {
+            byte = (byte << 1) | bit_at(message, i++);
+        }
+        packet->bytes[packet->count++] = byte;
+        check ^= byte;
+    }
+
+    // The error detection byte makes the XOR of all bytes zero
+    if (packet->count < 3)
+    {
+        return DCC_FRAMING;
+    }
+    return check == 0 ? DCC_DECODED : DCC_CHECKSUM;
+}
+
+/**
+ * @brief Applies the speed byte of a baseline speed packet to a locomotive decoder.
+ */
+static void apply_speed(DccLocomotiveDecoder *decoder, unsigned char instruction)
+{
+    decoder->known = 1;
+    decoder->direction = (instruction >> 5) & 0x1;
+    decoder->light = (instruction >> 4) & 0x1;
+    decoder->speed = instruction & 0xF;
+}
+
+int dcc_apply(DccFleet *fleet, const DccPacket *packet, int *decoder)
+{
+    unsigned char address = packet->bytes[0];
+    unsigned char instruction = packet->bytes[1];
+
+    fleet->packets++;
+    *decoder = -1;
+
+    if (address == 0xFF)
+    {
+        return DCC_IDLE;
+    }
+    if (address == 0x00)
+    {
+        if (instruction == 0x00)
+        {
+            // All decoders stop after a reset
+            for (int i = 0; i < DCC_LOCOMOTIVES; i++)
+            {
+                fleet->locomotives[i].speed = 0;
+            }
+            return DCC_RESET;
+        }
+        if ((instruction & 0xC0) == 0x40)
+        {
+            for (int i = 1; i < DCC_LOCOMOTIVES; i++)
+            {
+                apply_speed(&fleet->locomotives[i], instruction);
+            }
+            return DCC_BROADCAST;
+        }
+        return DCC_UNKNOWN;
+    }
+    if ((address & 0x80) == 0 && (instruction & 0xC0) == 0x40)
+    {
+        *decoder = address;
+        apply_speed(&fleet->locomotives[address], instruction);
+        return DCC_LOCOMOTIVE;
+    }
+    if ((address & 0xC0) == 0x80 && (instruction & 0x80) == 0x80)
+    {
+        // The high address bits are sent inverted in the second byte
+        int accessory = ((~instruction >> 4) & 0x7) << 6 | (address & 0x3F);
+        int output = accessory * 4 + ((instruction >> 1) & 0x3);
+        *decoder = DCC_LOCOMOTIVES + output;
+        if (instruction & 0x1)
+        {
+            fleet->outputs[output].known = 1;
+            fleet->outputs[output].control = (instruction >> 3) & 0x1;
+        }
+        return DCC_ACCESSORY;
+    }
+    return DCC_UNKNOWN;
+}
@@ -0,0 +1,589 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/select.h>
+
+#include "communication/linux_rtai_communication.h"
+#include "telegram/locomotive.h"
+#include "telegram/magnetic.h"
+#include "telegram/system.h"
+#include "telegram/event.h"
+#include "telegram/capture.h"
+#include "tools/dcc_decoder.h"
+
+#define FLEET_DECODERS (DCC_LOCOMOTIVES + DCC_OUTPUTS) /* Emulated decoders, locomotives first */
+#define FLEET_MAX_PHASES 16                            /* Most active decoder counts measured in one run */
+#define FLEET_MAX_SAMPLES 1000000                      /* Most staleness samples kept per phase */
+#define FLEET_LOCOMOTIVE_SLOTS 3                       /* Locomotive slots of the module (LOC_MSQ_SIZE) */
+
+/**
+ * @struct PendingCommand
+ * @brief A command which has not reached its decoder yet.
+ *
+ * This structure contains the following fields:
+ * - active: The command waits for its decoder.
+ * - data: The data word of the command.
+ * - time: RT time the module executed the command in nanoseconds.
+ */
+typedef struct
+{
+    int active;              // The command waits for its decoder.
+    unsigned short data;     // The data word of the command.
+    unsigned long long time; // RT time the module executed the command in nanoseconds.
+} PendingCommand;
+
+/**
+ * @struct PhaseStatistics
+ * @brief The outcome of the commands of one number of active decoders.
+ *
+ * This structure contains the following fields:
+ * - active: Number of decoders the commands were spread over.
+ * - commands: Number of commands executed by the module.
+ * - rejected: Number of commands rejected by the module.
+ * - reflected: Number of commands whose state was decoded from the rails.
+ * - superseded: Number of commands replaced by a newer command before they were decoded.
+ * - lost: Number of commands which were never decoded.
+ * - errors: Number of packets the decoders dropped.
+ * - dropped: Number of capture records the module dropped.
+ * - staleness: Time from executing each reflected command until its packet ended in microseconds.
+ */
+typedef struct
+{
+    int active;           // Number of decoders the commands were spread over.
+    long commands;        // Number of commands executed by the module.
+    long rejected;        // Number of commands rejected by the module.
+    long reflected;       // Number of commands whose state was decoded from the rails.
+    long superseded;      // Number of commands replaced by a newer command before they were decoded.
+    long lost;            // Number of commands which were never decoded.
+    unsigned long errors; // Number of packets the decoders dropped.
+    long long dropped;    // Number of capture records the module dropped, -1 if unknown.
+    long *staleness;      // Time until each reflected command was decoded in microseconds.
+} PhaseStatistics;
+
+static DccFleet fleet;
+static PendingCommand pending[FLEET_DECODERS];
+static unsigned short rejected[FLEET_DECODERS]; // Data word of a rejected command per decoder, 0 for none
+static FILE *save_file = NULL;
+
+/**
+ * @brief Returns the current monotonic time in microseconds.
+ */
+static long long now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int compare_long(const void *a, const void *b)
+{
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Returns the emulated decoder a locomotive or accessory command is addressed to.
+ *
+ * @param data The data word of the command.
+ * @return int The index of the decoder, -1 for other commands.
+ */
+static int decoder_of_command(unsigned short data)
+{
+    unsigned short type = (data >> 13) & 0x3;
+    if (type == 0b01)
+    {
+        LocomotiveDataConverter converter = {.us = data};
+        return converter.ld.address;
+    }
+    if (type == 0b10)
+    {
+        MagneticDataConverter converter = {.us = data};
+        return DCC_LOCOMOTIVES + converter.md.address * 4 + converter.md.device;
+    }
+    return -1;
+}
+
+/**
+ * @brief Tells whether an emulated decoder is in the state a command asked for.
+ *
+ * @param decoder The index of the decoder.
+ * @param data The data word of the command.
+ * @return int 1 if the state matches.
+ */
+static int decoder_reflects(int decoder, unsigned short data)
+{
+    if (decoder < DCC_LOCOMOTIVES)
+    {
+        LocomotiveDataConverter converter = {.us = data};
+        const DccLocomotiveDecoder *loco = &fleet.locomotives[decoder];
+        return loco->known && loco->speed == converter.ld.speed && loco->direction == converter.ld.direction &&
+               loco->light == converter.ld.light;
+    }
+    MagneticDataConverter converter = {.us = data};
+    const DccOutput *output = &fleet.outputs[decoder - DCC_LOCOMOTIVES];
+    return output->known && output->control == converter.md.control;
+}
+
+/**
+ * @brief Applies a capture record to the emulated decoders and the statistics of a phase.
+ *
+ * @param record The record.
+ * @param phase The statistics of the current phase.
+ */
+static void process_record(const CaptureData *record, PhaseStatistics *phase)
+{
+    if (save_file != NULL)
+    {
+        fwrite(record, sizeof(*record), 1, save_file);
+    }
+
+    if (record->kind == CAPTURE_COMMAND)
+    {
+        int decoder = decoder_of_command(record->data);
+        if (decoder < 0)
+        {
+            return;
+        }
+        // The module captures a command before it knows whether it can execute it
+        if (rejected[decoder] == record->data)
+        {
+            rejected[decoder] = 0;
+            return;
+        }
+        // Deactivations only switch a solenoid off, they never change the state of an output
+        MagneticDataConverter converter = {.us = record->data};
+        if (decoder >= DCC_LOCOMOTIVES && converter.md.enable == 0)
+        {
+            return;
+        }
+        if (pending[decoder].active)
+        {
+            phase->superseded++;
+        }
+        phase->commands++;
+        pending[decoder].active = 1;
+        pending[decoder].data = record->data;
+        pending[decoder].time = record->start;
+        return;
+    }
+
+    if (record->kind != CAPTURE_PACKET)
+    {
+        return;
+    }
+    DccPacket packet;
+    if (dcc_decode(record->message, record->length, &packet) != DCC_DECODED)
+    {
+        fleet.errors++;
+        phase->errors++;
+        return;
+    }
+    int decoder;
+    int kind = dcc_apply(&fleet, &packet, &decoder);
+
+    // A broadcast or reset may stop a locomotive, which only reflects commands asking for it
+    int first = decoder, last = decoder;
+    if (kind == DCC_BROADCAST || kind == DCC_RESET)
+    {
+        first = 1;
+        last = DCC_LOCOMOTIVES - 1;
+    }
+    else if (decoder < 0)
+    {
+        return;
+    }
+    for (int i = first; i <= last; i++)
+    {
+        if (pending[i].active && decoder_reflects(i, pending[i].data))
+        {
+            if (phase->reflected < FLEET_MAX_SAMPLES)
+            {
+                long staleness = record->end > pending[i].time ? (long)((record->end - pending[i].time) / 1000) : 0;
+                phase->staleness[phase->reflected] = staleness;
+            }
+            phase->reflected++;
+            pending[i].active = 0;
+        }
+    }
+}
+
+/**
+ * @brief Reads the records available on the capture fifo.
+ *
+ * @param fd_capture The file descriptor of the capture fifo.
+ * @param timeout The longest time to wait for the first record in microseconds.
+ * @param phase The statistics of the current phase.
+ */
+static void read_capture(int fd_capture, long long timeout, PhaseStatistics *phase)
+{
+    static unsigned char buffer[64 * sizeof(CaptureData)];
+    static size_t buffered = 0;
+
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(fd_capture, &fds);
+    struct timeval tv = {.tv_sec = timeout / 1000000, .tv_usec = timeout % 1000000};
+    if (select(fd_capture + 1, &fds, NULL, NULL, timeout >= 0 ? &tv : NULL) <= 0)
+    {
+        return;
+    }
+
+    ssize_t r;
+    while ((r = read(fd_capture, buffer + buffered, sizeof(buffer) - buffered)) > 0)
+    {
+        buffered += r;
+        size_t offset = 0;
+        while (buffered - offset >= sizeof(CaptureData))
+        {
+            CaptureData record;
+            memcpy(&record, buffer + offset, sizeof(record));
+            process_record(&record, phase);
+            offset += sizeof(record);
+        }
+        memmove(buffer, buffer + offset, buffered - offset);
+        buffered -= offset;
+    }
+}
+
+/**
+ * @brief Returns the next command for an emulated decoder, which always changes its state.
+ *
+ * @param decoder The index of the decoder.
+ * @return unsigned short The data word.
+ */
+static unsigned short next_command(int decoder)
+{
+    static unsigned char last[FLEET_DECODERS];
+
+    if (decoder < DCC_LOCOMOTIVES)
+    {
+        // Speed 1 is the emergency stop, the fleet cycles through the speeds 2 to 15
+        last[decoder] = last[decoder] < 2 || last[decoder] >= 15 ? 2 : last[decoder] + 1;
+        LocomotiveDataConverter converter = {.ld = {
+                                                 .address = decoder,
+                                                 .direction = 0,
+                                                 .light = 1,
+                                                 .speed = last[decoder],
+                                                 .type = 0b01,
+                                                 .ack = 0,
+                                             }};
+        return converter.us;
+    }
+
+    int output = decoder - DCC_LOCOMOTIVES;
+    last[decoder] = !last[decoder];
+    MagneticDataConverter converter = {.md = {
+                                           .address = output / 4,
+                                           .device = output % 4,
+                                           .control = last[decoder],
+                                           .enable = 1,
+                                           .type = 0b10,
+                                           .ack = 0,
+                                       }};
+    return converter.us;
+}
+
+/**
+ * @brief Returns the decoder the n-th of the active decoders refers to.
+ *
+ * The first locos decoders are the locomotives 1 to locos, the others are the outputs of the
+ * accessories from address 1 on.
+ */
+static int active_decoder(int n, int locos)
+{
+    return n < locos ? 1 + n : DCC_LOCOMOTIVES + 4 + (n - locos);
+}
+
+/**
+ * @brief Counts the commands still waiting for their decoder as lost.
+ */
+static void finish_phase(PhaseStatistics *phase)
+{
+    for (int i = 0; i < FLEET_DECODERS; i++)
+    {
+        if (pending[i].active)
+        {
+            phase->lost++;
+            pending[i].active = 0;
+        }
+    }
+}
+
+/**
+ * @brief Prints the staleness of one phase as a row of the report.
+ */
+static void print_phase(PhaseStatistics *phase)
+{
+    long samples = phase->reflected < FLEET_MAX_SAMPLES ? phase->reflected : FLEET_MAX_SAMPLES;
+    long p50 = 0, p90 = 0, p99 = 0, max = 0;
+    if (samples > 0)
+    {
+        qsort(phase->staleness, samples, sizeof(long), compare_long);
+        p50 = phase->staleness[samples / 2];
+        p90 = phase->staleness[samples * 90 / 100];
+        p99 = phase->staleness[samples * 99 / 100];
+        max = phase->staleness[samples - 1];
+    }
+    printf("%8d %9ld %9ld %9ld %10ld %6ld %8lu %9ld %9ld %9ld %9ld", phase->active, phase->commands, phase->rejected,
+           phase->reflected, phase->superseded, phase->lost, phase->errors, p50, p90, p99, max);
+    // A saved capture does not know the records the module dropped
+    if (phase->dropped >= 0)
+    {
+        printf(" %8lld\n", phase->dropped);
+    }
+    else
+    {
+        printf(" %8s\n", "-");
+    }
+}
+
+static void print_header(void)
+{
+    printf("%8s %9s %9s %9s %10s %6s %8s %9s %9s %9s %9s %8s\n", "active", "commands", "rejected", "reflected",
+           "superseded", "lost", "errors", "p50 us", "p90 us", "p99 us", "max us", "dropped");
+}
+
+/**
+ * @brief Analyses a saved capture as one phase.
+ *
+ * @param path The path of the capture.
+ * @return int EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int analyse_file(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        perror("Failed to open the capture");
+        return EXIT_FAILURE;
+    }
+
+    PhaseStatistics phase = {.dropped = -1};
+    phase.staleness = malloc(FLEET_MAX_SAMPLES * sizeof(long));
+    if (phase.staleness == NULL)
+    {
+        perror("Allocation error");
+        fclose(file);
+        return EXIT_FAILURE;
+    }
+
+    static char commanded[FLEET_DECODERS];
+    CaptureData record;
+    while (fread(&record, sizeof(record), 1, file) == 1)
+    {
+        if (record.kind == CAPTURE_COMMAND)
+        {
+            int decoder = decoder_of_command(record.data);
+            if (decoder >= 0 && !commanded[decoder])
+            {
+                commanded[decoder] = 1;
+                phase.active++;
+            }
+        }
+        process_record(&record, &phase);
+    }
+    fclose(file);
+    finish_phase(&phase);
+
+    print_header();
+    print_phase(&phase);
+    free(phase.staleness);
+    return EXIT_SUCCESS;
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [OPTION]...\n", name);
+    printf("\nDescription: Emulates a decoder on every address from the packet capture of the module and reports how long commands take to reach their decoders while the number of active decoders grows.\n");
+    printf("\nOptions:\n");
+    printf("  --active <n>[,<n>]...    Numbers of active decoders, one phase each. Defaults to 1,3,16,64,256.\n");
+    printf("  --duration <s>           Length of each phase in seconds. Defaults to 10.\n");
+    printf("  --input <file>           Analyse a capture saved with --save instead of the module.\n");
+    printf("  --locos <count>          The first count active decoders are the locomotives 1 to count, the others accessory outputs. At most 3, the slots of the module. Defaults to 3.\n");
+    printf("  --rate <commands/s>      Rate of commands in each phase. Defaults to 20.\n");
+    printf("  --save <file>            Save the capture for a later analysis.\n");
+    printf("  --settle <s>             Time after each phase for the last commands to reach their decoders. Defaults to 2.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int active[FLEET_MAX_PHASES] = {1, 3, 16, 64, 256};
+    int phases = 5;
+    double duration = 10;
+    double rate = 20;
+    double settle = 2;
+    int locos = 3;
+    const char *input = NULL;
+    const char *save = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        int valid = i + 1 < argc;
+        if (valid && strcmp(argv[i], "--active") == 0)
+        {
+            char *list = argv[++i];
+            phases = 0;
+            for (char *item = strtok(list, ","); valid && item != NULL; item = strtok(NULL, ","))
+            {
+                valid = phases < FLEET_MAX_PHASES && sscanf(item, "%d", &active[phases]) == 1 && active[phases] >= 1;
+                phases++;
+            }
+            valid = valid && phases > 0;
+        }
+        else if (valid && strcmp(argv[i], "--duration") == 0)
+        {
+            valid = sscanf(argv[++i], "%lf", &duration) == 1 && duration > 0;
+        }
+        else if (valid && strcmp(argv[i], "--rate") == 0)
+        {
+            valid = sscanf(argv[++i], "%lf", &rate) == 1 && rate > 0;
+        }
+        else if (valid && strcmp(argv[i], "--settle") == 0)
+        {
+            valid = sscanf(argv[++i], "%lf", &settle) == 1 && settle >= 0;
+        }
+        else if (valid && strcmp(argv[i], "--locos") == 0)
+        {
+            valid = sscanf(argv[++i], "%d", &locos) == 1 && locos >= 0 && locos <= DCC_LOCOMOTIVES - 1;
+            // The decoders emulate every address, the module only refreshes the addresses of its slots
+            if (valid && locos > FLEET_LOCOMOTIVE_SLOTS)
+            {
+                printf("The module has only %d locomotive slots\n", FLEET_LOCOMOTIVE_SLOTS);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (valid && strcmp(argv[i], "--input") == 0)
+        {
+            input = argv[++i];
+        }
+        else if (valid && strcmp(argv[i], "--save") == 0)
+        {
+            save = argv[++i];
+        }
+        else
+        {
+            valid = 0;
+        }
+
+        if (!valid)
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (input != NULL)
+    {
+        return analyse_file(input);
+    }
+
+    // Outputs of the accessories 1 to 511 follow the locomotives
+    for (int p = 0; p < phases; p++)
+    {
+        if (active[p] > locos + (DCC_OUTPUTS - 4))
+        {
+            printf("At most %d active decoders\n", locos + (DCC_OUTPUTS - 4));
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (save != NULL && (save_file = fopen(save, "wb")) == NULL)
+    {
+        perror("Failed to create the capture file");
+        return EXIT_FAILURE;
+    }
+    int fd_capture = open_capture_fifo();
+    if (fd_capture < 0)
+    {
+        return EXIT_FAILURE;
+    }
+    unsigned short enable = 1;
+    if (send_system_with_ack(SYSTEM_CAPTURE, &enable, 1, 3) != 0)
+    {
+        printf("The module did not enable the capture\n");
+        close(fd_capture);
+        return EXIT_FAILURE;
+    }
+
+    PhaseStatistics results[FLEET_MAX_PHASES] = {{0}};
+    for (int p = 0; p < phases; p++)
+    {
+        PhaseStatistics *phase = &results[p];
+        phase->active = active[p];
+        phase->staleness = malloc(FLEET_MAX_SAMPLES * sizeof(long));
+        if (phase->staleness == NULL)
+        {
+            perror("Allocation error");
+            return EXIT_FAILURE;
+        }
+
+        unsigned long long before[STATISTIC_COUNT] = {0}, after[STATISTIC_COUNT] = {0};
+        int module_statistics = request_statistics(before) == 0;
+
+        // Commands go round robin over the active decoders, the capture is read while waiting for the next one
+        long long period = (long long)(1000000 / rate);
+        long long started = now_us();
+        long long end = started + (long long)(duration * 1000000);
+        for (long n = 0;; n++)
+        {
+            long long due = started + n * period;
+            if (due >= end)
+            {
+                break;
+            }
+            long long now;
+            while ((now = now_us()) < due)
+            {
+                read_capture(fd_capture, due - now, phase);
+            }
+
+            int decoder = active_decoder(n % phase->active, locos);
+            unsigned short data = next_command(decoder);
+            if (send_with_ack(data, 3) == -2)
+            {
+                rejected[decoder] = data;
+                phase->rejected++;
+            }
+        }
+
+        long long settled = now_us() + (long long)(settle * 1000000);
+        long long now;
+        while ((now = now_us()) < settled)
+        {
+            read_capture(fd_capture, settled - now, phase);
+        }
+        finish_phase(phase);
+
+        if (module_statistics && request_statistics(after) == 0)
+        {
+            phase->dropped = after[STATISTIC_CAPTURE_DROPPED] - before[STATISTIC_CAPTURE_DROPPED];
+        }
+        else
+        {
+            phase->dropped = -1;
+        }
+    }
+
+    unsigned short disable = 0;
+    send_system_with_ack(SYSTEM_CAPTURE, &disable, 1, 3);
+    close(fd_capture);
+    if (save_file != NULL)
+    {
+        fclose(save_file);
+    }
+
+    print_header();
+    for (int p = 0; p < phases; p++)
+    {
+        print_phase(&results[p]);
+        free(results[p].staleness);
+    }
+    if (fleet.errors > 0)
+    {
+        printf("%lu of %lu packets were dropped by the decoders\n", fleet.errors, fleet.packets + fleet.errors);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "communication/linux_rtai_communication.h"
+#include "telegram/locomotive.h"
+#include "telegram/magnetic.h"
+#include "telegram/system.h"
+#include "telegram/event.h"
+
+#define LOADGEN_MAX_SAMPLES 1000000 /* Most latencies kept per command type for the percentiles */
+
+/**
+ * @struct LoadStatistics
+ * @brief The outcome of the commands of one type.
+ *
+ * This structure contains the following fields:
+ * - sent: Number of commands sent.
+ * - acknowledged: Number of commands acknowledged by the module.
+ * - rejected: Number of commands rejected by the module.
+ * - dropped: Number of commands which were never acknowledged.
+ * - latencies: Time from writing each acknowledged command until its acknowledgement in microseconds.
+ */
+typedef struct
+{
+    long sent;         // Number of commands sent.
+    long acknowledged; // Number of commands acknowledged by the module.
+    long rejected;     // Number of commands rejected by the module.
+    long dropped;      // Number of commands which were never acknowledged.
+    long *latencies;   // Time until the acknowledgement of each acknowledged command in microseconds.
+} LoadStatistics;
+
+/**
+ * @brief Returns the current monotonic time in microseconds.
+ */
+static long long now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Sleeps until a monotonic time in microseconds, returns at once if it passed.
+ */
+static void sleep_until_us(long long time)
+{
+    struct timespec ts = {.tv_sec = time / 1000000, .tv_nsec = (time % 1000000) * 1000};
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+static int compare_long(const void *a, const void *b)
+{
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Acts as the module on named pipes, acknowledging every command at once.
+ *
+ * Statistics requests are answered with zeros, so the generator measures the command path alone.
+ *
+ * @param cmd The path of the command pipe.
+ * @param ack The path of the acknowledge pipe.
+ * @param event The path of the event pipe.
+ */
+static void stand_in(const char *cmd, const char *ack, const char *event)
+{
+    // Opened for reading and writing, so the pipes stay usable while the generator reopens them
+    int fd_cmd = open(cmd, O_RDWR);
+    int fd_ack = open(ack, O_RDWR);
+    int fd_event = open(event, O_RDWR);
+    if (fd_cmd < 0 || fd_ack < 0 || fd_event < 0)
+    {
+        perror("Failed to open the stand-in pipes");
+        _exit(EXIT_FAILURE);
+    }
+
+    unsigned char buffer[4096];
+    size_t buffered = 0;
+    while (1)
+    {
+        ssize_t r = read(fd_cmd, buffer + buffered, sizeof(buffer) - buffered);
+        if (r <= 0)
+        {
+            _exit(EXIT_SUCCESS);
+        }
+        buffered += r;
+
+        size_t offset = 0;
+        while (buffered - offset >= sizeof(unsigned short))
+        {
+            unsigned short raw;
+            memcpy(&raw, buffer + offset, sizeof(raw));
+            SystemDataConverter header = {.us = raw};
+            size_t size = sizeof(raw) + (header.sd.type == 0b11 ? header.sd.length * sizeof(raw) : 0);
+            if (buffered - offset < size)
+            {
+                break;
+            }
+            offset += size;
+
+            if (header.sd.type == 0b11 && header.sd.opcode == SYSTEM_STATISTICS)
+            {
+                for (unsigned short id = 1; id < STATISTIC_COUNT; id++)
+                {
+                    EventData record = {.kind = EVENT_STATISTIC, .data = id, .count = STATISTIC_COUNT - 1, .time = 0, .value = 0};
+                    write(fd_event, &record, sizeof(record));
+                }
+            }
+            raw |= 0x8000;
+            write(fd_ack, &raw, sizeof(raw));
+        }
+        memmove(buffer, buffer + offset, buffered - offset);
+        buffered -= offset;
+    }
+}
+
+/**
+ * @brief Creates the named pipes of a stand-in module in a directory and starts it.
+ *
+ * The fifo paths of this process are pointed to the pipes.
+ *
+ * @param directory The directory of the pipes, created if missing.
+ * @return pid_t The process of the stand-in, -1 on failure.
+ */
+static pid_t start_stand_in(const char *directory)
+{
+    static char cmd[512], ack[512], event[512];
+    snprintf(cmd, sizeof(cmd), "%s/cmd", directory);
+    snprintf(ack, sizeof(ack), "%s/ack", directory);
+    snprintf(event, sizeof(event), "%s/event", directory);
+
+    mkdir(directory, 0755);
+    unlink(cmd);
+    unlink(ack);
+    unlink(event);
+    if (mkfifo(cmd, 0600) != 0 || mkfifo(ack, 0600) != 0 || mkfifo(event, 0600) != 0)
+    {
+        perror("Failed to create the stand-in pipes");
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        stand_in(cmd, ack, event);
+    }
+    setenv("DCC_FIFO_CMD", cmd, 1);
+    setenv("DCC_FIFO_ACK", ack, 1);
+    setenv("DCC_FIFO_EVENT", event, 1);
+    return pid;
+}
+
+/**
+ * @brief Prints the outcome of the commands of one type.
+ *
+ * @param name The name of the command type.
+ * @param stats The outcome, the latencies get sorted.
+ * @param type The type bits of the commands for the retry counters.
+ */
+static void print_statistics(const char *name, LoadStatistics *stats, unsigned short type)
+{
+    AckStatistics ack;
+    get_ack_statistics(type, &ack);
+
+    printf("%s\n", name);
+    printf("\t%-24s %ld\n", "sent", stats->sent);
+    printf("\t%-24s %ld\n", "acknowledged", stats->acknowledged);
+    printf("\t%-24s %ld\n", "rejected", stats->rejected);
+    printf("\t%-24s %ld\n", "dropped", stats->dropped);
+    printf("\t%-24s %lu\n", "retries", ack.retries);
+
+    long samples = stats->acknowledged < LOADGEN_MAX_SAMPLES ? stats->acknowledged : LOADGEN_MAX_SAMPLES;
+    if (samples > 0)
+    {
+        qsort(stats->latencies, samples, sizeof(long), compare_long);
+        printf("\t%-24s p50 %ld us, p90 %ld us, p99 %ld us, p99.9 %ld us, max %ld us\n", "ack latency",
+               stats->latencies[samples / 2], stats->latencies[samples * 90 / 100], stats->latencies[samples * 99 / 100],
+               stats->latencies[samples * 999 / 1000], stats->latencies[samples - 1]);
+    }
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [OPTION]...\n", name);
+    printf("\nDescription: Sends a synthetic mix of locomotive and accessory commands to the module at a target rate and reports how it kept up.\n");
+    printf("\nOptions:\n");
+    printf("  --accessories <count>    Spread the accessory commands over the addresses 1 to count. Defaults to 4.\n");
+    printf("  --duration <s>           Generate load for the given seconds. Defaults to 10.\n");
+    printf("  --locos <count>          Spread the locomotive commands over the addresses 1 to count. Defaults to 3.\n");
+    printf("  --mix <loco>:<mag>       Weights of locomotive and accessory commands. Defaults to 1:1.\n");
+    printf("  --rate <commands/s>      Target rate of commands. Defaults to 100.\n");
+    printf("  --seed <seed>            Seed of the command mix. Defaults to 1.\n");
+    printf("  --stand-in <directory>   Answer the commands by a stand-in module on named pipes in the directory instead of the module.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    double rate = 100;
+    double duration = 10;
+    int locos = 3;
+    int accessories = 4;
+    int loco_weight = 1, mag_weight = 1;
+    unsigned int seed = 1;
+    const char *directory = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        int valid = i + 1 < argc;
+        if (valid && strcmp(argv[i], "--rate") == 0)
+        {
+            valid = sscanf(argv[++i], "%lf", &rate) == 1 && rate > 0;
+        }
+        else if (valid && strcmp(argv[i], "--duration") == 0)
+        {
+            valid = sscanf(argv[++i], "%lf", &duration) == 1 && duration > 0;
+        }
+        else if (valid && strcmp(argv[i], "--locos") == 0)
+        {
+            valid = sscanf(argv[++i], "%d", &locos) == 1 && locos >= 1 && locos <= 127;
+        }
+        else if (valid && strcmp(argv[i], "--accessories") == 0)
+        {
+            valid = sscanf(argv[++i], "%d", &accessories) == 1 && accessories >= 1 && accessories <= 511;
+        }
+        else if (valid && strcmp(argv[i], "--mix") == 0)
+        {
+            valid = sscanf(argv[++i], "%d:%d", &loco_weight, &mag_weight) == 2 && loco_weight >= 0 && mag_weight >= 0 &&
+                    loco_weight + mag_weight > 0;
+        }
+        else if (valid && strcmp(argv[i], "--seed") == 0)
+        {
+            valid = sscanf(argv[++i], "%u", &seed) == 1;
+        }
+        else if (valid && strcmp(argv[i], "--stand-in") == 0)
+        {
+            directory = argv[++i];
+        }
+        else
+        {
+            valid = 0;
+        }
+
+        if (!valid)
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    pid_t stand_in_pid = -1;
+    if (directory != NULL && (stand_in_pid = start_stand_in(directory)) < 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    LoadStatistics stats[2] = {{0}};
+    for (int t = 0; t < 2; t++)
+    {
+        stats[t].latencies = malloc(LOADGEN_MAX_SAMPLES * sizeof(long));
+        if (stats[t].latencies == NULL)
+        {
+            perror("Allocation error");
+            return EXIT_FAILURE;
+        }
+    }
+
+    unsigned long long before[STATISTIC_COUNT] = {0}, after[STATISTIC_COUNT] = {0};
+    int module_statistics = request_statistics(before) == 0;
+
+    // Open loop: command n is due at n / rate, a command which can't keep up is sent as soon as possible
+    long long period = (long long)(1000000 / rate);
+    long long started = now_us();
+    long long end = started + (long long)(duration * 1000000);
+    long long behind_max = 0;
+    srand(seed);
+    for (long n = 0;; n++)
+    {
+        long long due = started + n * period;
+        if (due >= end)
+        {
+            break;
+        }
+        sleep_until_us(due);
+        long long sent = now_us();
+        behind_max = sent - due > behind_max ? sent - due : behind_max;
+
+        unsigned short data;
+        int t = rand() % (loco_weight + mag_weight) >= loco_weight;
+        if (t == 0)
+        {
+            LocomotiveDataConverter converter = {.ld = {
+                                                     .address = 1 + rand() % locos,
+                                                     .direction = rand() % 2,
+                                                     .light = rand() % 2,
+                                                     .speed = rand() % 16,
+                                                     .type = 0b01,
+                                                     .ack = 0,
+                                                 }};
+            // Speed 1 is the emergency stop, the load never stops a locomotive that way
+            if (converter.ld.speed == 1)
+            {
+                converter.ld.speed = 2;
+            }
+            data = converter.us;
+        }
+        else
+        {
+            MagneticDataConverter converter = {.md = {
+                                                   .address = 1 + rand() % accessories,
+                                                   .device = rand() % 4,
+                                                   .control = rand() % 2,
+                                                   .enable = 1,
+                                                   .type = 0b10,
+                                                   .ack = 0,
+                                               }};
+            data = converter.us;
+        }
+
+        int answer = send_with_ack(data, 3);
+        stats[t].sent++;
+        if (answer == 0)
+        {
+            if (stats[t].acknowledged < LOADGEN_MAX_SAMPLES)
+            {
+                stats[t].latencies[stats[t].acknowledged] = now_us() - sent;
+            }
+            stats[t].acknowledged++;
+        }
+        else if (answer == -2)
+        {
+            stats[t].rejected++;
+        }
+        else
+        {
+            stats[t].dropped++;
+        }
+    }
+    long long elapsed = now_us() - started;
+
+    if (module_statistics)
+    {
+        module_statistics = request_statistics(after) == 0;
+    }
+
+    long total = stats[0].sent + stats[1].sent;
+    long acknowledged = stats[0].acknowledged + stats[1].acknowledged;
+    printf("Target %.1f commands/s, sent %.1f commands/s, acknowledged %.1f commands/s over %.3f s\n", rate,
+           total * 1000000.0 / elapsed, acknowledged * 1000000.0 / elapsed, elapsed / 1000000.0);
+    // Falling behind for good, not a single late command, marks the saturation point
+    printf("Worst time behind the target rate: %lld us%s\n", behind_max,
+           total * 1000000.0 / elapsed < 0.95 * rate ? " (saturated)" : "");
+    print_statistics("locomotive", &stats[0], 0b01);
+    print_statistics("magnetic", &stats[1], 0b10);
+    if (module_statistics)
+    {
+        printf("module\n");
+        printf("\t%-24s %llu\n", "queue full", after[STATISTIC_QUEUE_FULL] - before[STATISTIC_QUEUE_FULL]);
+        printf("\t%-24s %llu\n", "accessories merged", after[STATISTIC_MAGNETIC_MERGED] - before[STATISTIC_MAGNETIC_MERGED]);
+    }
+
+    if (stand_in_pid > 0)
+    {
+        kill(stand_in_pid, SIGTERM);
+        waitpid(stand_in_pid, NULL, 0);
+    }
+    for (int t = 0; t < 2; t++)
+    {
+        free(stats[t].latencies);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "communication/linux_rtai_communication.h"
+#include "communication/session_log.h"
+#include "telegram/system.h"
+
+#define REPLAY_MAX_COMMANDS 1000000 /* Most commands of a replay whose latencies are kept for the percentiles */
+
+/**
+ * @struct ReplayStatistics
+ * @brief The outcome of a replay.
+ *
+ * This structure contains the following fields:
+ * - commands: Number of commands replayed.
+ * - acknowledged: Number of commands acknowledged by the module.
+ * - rejected: Number of commands rejected by the module.
+ * - dropped: Number of commands which were never acknowledged.
+ * - skipped: Number of commands not replayed (subscriptions of the event stream).
+ * - latencies: Time from writing each acknowledged command until its acknowledgement in microseconds.
+ * - lateness_max: Worst time a command was issued after its time in the log in microseconds.
+ * - lateness_sum: Sum of the times commands were issued after their time in the log in microseconds.
+ */
+typedef struct
+{
+    long commands;          // Number of commands replayed.
+    long acknowledged;      // Number of commands acknowledged by the module.
+    long rejected;          // Number of commands rejected by the module.
+    long dropped;           // Number of commands which were never acknowledged.
+    long skipped;           // Number of commands not replayed.
+    long *latencies;        // Time until the acknowledgement of each acknowledged command in microseconds.
+    long long lateness_max; // Worst time a command was issued after its time in the log in microseconds.
+    long long lateness_sum; // Sum of the times commands were issued after their time in the log in microseconds.
+} ReplayStatistics;
+
+/**
+ * @brief Returns the current monotonic time in microseconds.
+ */
+static long long now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Sleeps until a monotonic time in microseconds, returns at once if it passed.
+ */
+static void sleep_until_us(long long time)
+{
+    struct timespec ts = {.tv_sec = time / 1000000, .tv_nsec = (time % 1000000) * 1000};
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+static int compare_long(const void *a, const void *b)
+{
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Prints the statistics of a replay.
+ *
+ * @param stats The statistics, the latencies get sorted.
+ * @param elapsed The duration of the replay in microseconds.
+ */
+static void print_statistics(ReplayStatistics *stats, long long elapsed)
+{
+    printf("Replayed %ld command(s) in %.3f s (%.1f commands/s)\n", stats->commands, elapsed / 1000000.0,
+           elapsed > 0 ? stats->commands * 1000000.0 / elapsed : 0.0);
+    printf("\t%-24s %ld\n", "acknowledged", stats->acknowledged);
+    printf("\t%-24s %ld\n", "rejected", stats->rejected);
+    printf("\t%-24s %ld\n", "dropped", stats->dropped);
+    printf("\t%-24s %ld\n", "skipped", stats->skipped);
+
+    long samples = stats->acknowledged < REPLAY_MAX_COMMANDS ? stats->acknowledged : REPLAY_MAX_COMMANDS;
+    if (samples > 0)
+    {
+        long long sum = 0;
+        qsort(stats->latencies, samples, sizeof(long), compare_long);
+        for (long i = 0; i < samples; i++)
+        {
+            sum += stats->latencies[i];
+        }
+        printf("\t%-24s min %ld us, mean %lld us, p50 %ld us, p99 %ld us, max %ld us\n", "ack latency",
+               stats->latencies[0], sum / samples, stats->latencies[samples / 2], stats->latencies[samples * 99 / 100],
+               stats->latencies[samples - 1]);
+    }
+    if (stats->commands > 0)
+    {
+        printf("\t%-24s mean %lld us, max %lld us\n", "behind the log", stats->lateness_sum / stats->commands, stats->lateness_max);
+    }
+
+    // Retries are counted per command type by the acknowledgement layer
+    const char *names[] = {NULL, "locomotive", "magnetic", "system"};
+    for (unsigned short type = 1; type < 4; type++)
+    {
+        AckStatistics ack;
+        get_ack_statistics(type, &ack);
+        if (ack.commands > 0)
+        {
+            printf("\t%-24s %lu commands, %lu retries, srtt %ld us\n", names[type], ack.commands, ack.retries, ack.srtt);
+        }
+    }
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s <log> [--speed <factor> | --max]\n", name);
+    printf("\nDescription: Sends the commands of a session log recorded with 'record' to the module again, keeping their timing.\n");
+    printf("\nOptions:\n");
+    printf("  --max                Send every command as soon as the previous one was acknowledged.\n");
+    printf("  --speed <factor>     Replay the given times faster than recorded. Defaults to 1.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *path = NULL;
+    double speed = 1.0;
+    int max = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--max") == 0)
+        {
+            max = 1;
+        }
+        else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc)
+        {
+            if (sscanf(argv[++i], "%lf", &speed) != 1 || speed <= 0)
+            {
+                printf("Invalid argument '%s' for speed\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (path == NULL && argv[i][0] != '-')
+        {
+            path = argv[i];
+        }
+        else
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (path == NULL)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE *log = session_log_open(path);
+    if (log == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    ReplayStatistics stats = {0};
+    stats.latencies = malloc(REPLAY_MAX_COMMANDS * sizeof(long));
+    if (stats.latencies == NULL)
+    {
+        perror("Allocation error");
+        fclose(log);
+        return EXIT_FAILURE;
+    }
+
+    SessionLogRecord record;
+    unsigned short command[SESSION_LOG_MAX_WORDS];
+    long long started = now_us();
+    int result;
+    while ((result = session_log_read(log, &record, command)) == 1)
+    {
+        // A subscription would leave the event stream of the module running after the replay
+        SystemDataConverter header = {.us = command[0]};
+        if (header.sd.type == 0b11 && header.sd.opcode == SYSTEM_WATCH)
+        {
+            stats.skipped++;
+            continue;
+        }
+
+        long long due = started + (long long)(record.time / 1000 / speed);
+        if (!max)
+        {
+            sleep_until_us(due);
+        }
+        long long sent = now_us();
+        if (!max && sent > due)
+        {
+            stats.lateness_sum += sent - due;
+            stats.lateness_max = sent - due > stats.lateness_max ? sent - due : stats.lateness_max;
+        }
+
+        int answer = send_raw_with_ack(command, record.count, 3);
+        stats.commands++;
+        if (answer == 0)
+        {
+            if (stats.acknowledged < REPLAY_MAX_COMMANDS)
+            {
+                stats.latencies[stats.acknowledged] = now_us() - sent;
+            }
+            stats.acknowledged++;
+        }
+        else if (answer == -2)
+        {
+            stats.rejected++;
+        }
+        else
+        {
+            stats.dropped++;
+        }
+    }
+    if (result < 0)
+    {
+        printf("The session log is damaged after %ld command(s)\n", stats.commands + stats.skipped);
+    }
+
+    print_statistics(&stats, now_us() - started);
+    free(stats.latencies);
+    fclose(log);
+    return result < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,913 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+
+#include "communication/linux_rtai_communication.h"
+#include "telegram/locomotive.h"
+#include "telegram/idle.h"
+#include "telegram/system.h"
+#include "telegram/event.h"
+
+#define STRESS_MAX_PROFILES 16         /* Most profiles of one run */
+#define STRESS_MAX_WORKERS 256         /* Most workers per kind of stress */
+#define STRESS_MAX_SAMPLES 1000000     /* Most command latencies kept per profile for the percentiles */
+#define STRESS_SETTLE 1                /* Seconds the stress runs before the measurement starts */
+#define STRESS_IO_BLOCK (1 << 20)      /* Block an I/O worker writes and syncs */
+#define STRESS_IO_FILE_MAX (256 << 20) /* An I/O worker starts over its file after 256 MiB */
+
+// The stand-in plays the timing of the module
+#define STAND_IN_HALF_1 58000     /* BIT_1_TIME of the module */
+#define STAND_IN_HALF_0 100000    /* BIT_0_TIME of the module */
+#define STAND_IN_EDGE_SLACK 1500  /* BITSLICE_EDGE_SLACK of the module */
+#define STAND_IN_PERIOD 60000000  /* PERIOD_LOC_TASK of the module */
+#define STAND_IN_LOCOS 3          /* LOC_MSQ_SIZE of the module */
+#define STAND_IN_LENGTH 42        /* Bits of the telegrams built by the module */
+
+/**
+ * @enum stress_kind
+ * @brief The kinds of load a profile puts on the host, one worker process per CPU each.
+ *
+ * - STRESS_CPU: Busy loops keeping every CPU running.
+ * - STRESS_MEMORY: Writes striding through a large buffer, missing the caches and the TLB.
+ * - STRESS_IRQ: Datagrams over the loopback device and short sleeps, raising softirqs and timer interrupts.
+ * - STRESS_IO: Blocks written and synced to a file, raising block device interrupts and writeback.
+ */
+enum stress_kind
+{
+    STRESS_CPU = 0x1,
+    STRESS_MEMORY = 0x2,
+    STRESS_IRQ = 0x4,
+    STRESS_IO = 0x8,
+};
+
+/**
+ * @struct StressProfile
+ * @brief A named combination of stress kinds.
+ */
+typedef struct
+{
+    const char *name; // Name of the profile on the command line and in the report.
+    int kinds;        // The stress kinds (see enum stress_kind).
+} StressProfile;
+
+static const StressProfile stress_profiles[] = {
+    {"idle", 0},
+    {"cpu", STRESS_CPU},
+    {"memory", STRESS_MEMORY},
+    {"irq", STRESS_IRQ},
+    {"io", STRESS_IO},
+    {"all", STRESS_CPU | STRESS_MEMORY | STRESS_IRQ | STRESS_IO},
+};
+
+/**
+ * @struct ProfileResult
+ * @brief The outcome of one profile.
+ *
+ * This structure contains the following fields:
+ * - profile: The profile.
+ * - sent, acknowledged, lost: Counters of the locomotive commands.
+ * - latencies: Time from writing each acknowledged command until its acknowledgement in microseconds.
+ * - before, after: The statistics of the module when the measurement started and ended. The worst
+ *                  values of after only cover the profile.
+ */
+typedef struct
+{
+    const StressProfile *profile;               // The profile.
+    long sent;                                  // Number of commands sent.
+    long acknowledged;                          // Number of commands acknowledged.
+    long lost;                                  // Number of commands not acknowledged or rejected.
+    long *latencies;                            // Time until the acknowledgement of each command in microseconds.
+    unsigned long long before[STATISTIC_COUNT]; // Statistics at the start of the measurement.
+    unsigned long long after[STATISTIC_COUNT];  // Statistics at the end of the measurement.
+} ProfileResult;
+
+/**
+ * @struct StandInWaveform
+ * @brief A telegram encoded into the durations of its half bits in nanoseconds.
+ */
+typedef struct
+{
+    int count;           // Number of half bits.
+    long half_bits[128]; // Duration of each half bit in nanoseconds.
+} StandInWaveform;
+
+static LocomotiveData stand_in_slots[STAND_IN_LOCOS];                // States of the locomotives, guarded by stand_in_lock.
+static int stand_in_known[STAND_IN_LOCOS];                           // The slot received a state, guarded by stand_in_lock.
+static pthread_mutex_t stand_in_lock = PTHREAD_MUTEX_INITIALIZER;    // Guards the slots.
+static StandInWaveform stand_in_packet;                              // Packet handed to the track thread.
+static StandInWaveform *stand_in_pending;                            // The handed packet until the track thread takes it.
+static sem_t stand_in_done;                                          // Posted when the handed packet was played.
+static volatile unsigned long long stand_in_statistics[STATISTIC_COUNT]; // Statistics, indexed by statistic_id.
+
+/**
+ * @brief Returns the current monotonic time in nanoseconds.
+ */
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief Sleeps until a monotonic time in nanoseconds, returns at once if it passed.
+ */
+static void sleep_until_ns(long long time)
+{
+    struct timespec ts = {.tv_sec = time / 1000000000, .tv_nsec = time % 1000000000};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    {
+    }
+}
+
+static int compare_long(const void *a, const void *b)
+{
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Keeps a CPU busy.
+ */
+static void cpu_worker(void)
+{
+    volatile double x = 1;
+    while (1)
+    {
+        x = x * 1.0000001 + 1e-9;
+    }
+}
+
+/**
+ * @brief Writes through a buffer with a stride of a page and a cache line.
+ *
+ * Every write touches another line of another page, so it misses the caches and the TLB and
+ * competes with the other CPUs for the memory bus.
+ *
+ * @param size The size of the buffer in bytes.
+ */
+static void memory_worker(size_t size)
+{
+    unsigned char *buffer = malloc(size);
+    if (buffer == NULL)
+    {
+        _exit(EXIT_FAILURE);
+    }
+    memset(buffer, 0, size);
+    for (size_t offset = 0;; offset = (offset + 4096 + 64) % size)
+    {
+        buffer[offset]++;
+    }
+}
+
+/**
+ * @brief Sends datagrams to itself over the loopback device and sleeps briefly in between.
+ *
+ * A control PC rarely sees a comparable rate of device interrupts, the network softirqs and the
+ * timer interrupts of the short sleeps stand in for them.
+ */
+static void irq_worker(void)
+{
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_port = 0, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    socklen_t size = sizeof(address);
+    if (fd < 0 || bind(fd, (struct sockaddr *)&address, size) != 0 || getsockname(fd, (struct sockaddr *)&address, &size) != 0)
+    {
+        _exit(EXIT_FAILURE);
+    }
+
+    char packet[64] = {0};
+    struct timespec pause = {.tv_sec = 0, .tv_nsec = 20000};
+    while (1)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            sendto(fd, packet, sizeof(packet), MSG_DONTWAIT, (struct sockaddr *)&address, size);
+            recv(fd, packet, sizeof(packet), MSG_DONTWAIT);
+        }
+        nanosleep(&pause, NULL);
+    }
+}
+
+/**
+ * @brief Writes blocks to a file in a directory and syncs each one.
+ *
+ * The file is removed at once, so it vanishes when the worker is killed.
+ *
+ * @param directory The directory of the file.
+ */
+static void io_worker(const char *directory)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/dcc_stress_%d", directory, (int)getpid());
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0600);
+    unlink(path);
+    char *block = malloc(STRESS_IO_BLOCK);
+    if (fd < 0 || block == NULL)
+    {
+        _exit(EXIT_FAILURE);
+    }
+    memset(block, 0x55, STRESS_IO_BLOCK);
+
+    long written = 0;
+    while (1)
+    {
+        if (write(fd, block, STRESS_IO_BLOCK) != STRESS_IO_BLOCK)
+        {
+            _exit(EXIT_FAILURE);
+        }
+        fsync(fd);
+        written += STRESS_IO_BLOCK;
+        if (written >= STRESS_IO_FILE_MAX)
+        {
+            lseek(fd, 0, SEEK_SET);
+            written = 0;
+        }
+    }
+}
+
+/**
+ * @brief Starts the workers of the stress kinds of a profile.
+ *
+ * @param kinds The stress kinds (see enum stress_kind).
+ * @param workers The number of workers per kind.
+ * @param memory The buffer of each memory worker in bytes.
+ * @param directory The directory of the files of the I/O workers.
+ * @param pids Receives the processes of the workers.
+ * @return int The number of workers started.
+ */
+static int start_workers(int kinds, int workers, size_t memory, const char *directory, pid_t pids[])
+{
+    int count = 0;
+    for (int kind = STRESS_CPU; kind <= STRESS_IO; kind <<= 1)
+    {
+        if ((kinds & kind) == 0)
+        {
+            continue;
+        }
+        for (int i = 0; i < workers; i++)
+        {
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                switch (kind)
+                {
+                case STRESS_CPU:
+                    cpu_worker();
+                    break;
+                case STRESS_MEMORY:
+                    memory_worker(memory);
+                    break;
+                case STRESS_IRQ:
+                    irq_worker();
+                    break;
+                default:
+                    io_worker(directory);
+                    break;
+                }
+                _exit(EXIT_SUCCESS);
+            }
+            if (pid > 0)
+            {
+                pids[count++] = pid;
+            }
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Stops the workers of a profile.
+ */
+static void stop_workers(pid_t pids[], int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        kill(pids[i], SIGKILL);
+    }
+    for (int i = 0; i < count; i++)
+    {
+        waitpid(pids[i], NULL, 0);
+    }
+}
+
+/**
+ * @brief Encodes a telegram into the half bits of the stand-in.
+ */
+static void encode_stand_in(unsigned long long message, int length, StandInWaveform *waveform)
+{
+    waveform->count = 0;
+    for (int i = 0; i < length; i++)
+    {
+        long half = ((message >> (63 - i)) & 0x01) ? STAND_IN_HALF_1 : STAND_IN_HALF_0;
+        waveform->half_bits[waveform->count++] = half;
+        waveform->half_bits[waveform->count++] = half;
+    }
+}
+
+/**
+ * @brief Plays the half bits of the handed packets, idle packets in between, like a track task.
+ *
+ * Nothing is switched, the lateness of every wake-up is the jitter an edge on the rails would have.
+ */
+static void *stand_in_track(void *arg)
+{
+    StandInWaveform idle;
+    IdleConverter converter;
+    converter.it = buildIdleTelegram();
+    encode_stand_in(converter.ull, STAND_IN_LENGTH, &idle);
+
+    // Like the module, the edges keep their own timeline, a late edge doesn't delay the next one
+    long long edge = now_ns() + 1000000;
+    while (1)
+    {
+        StandInWaveform *packet = __atomic_exchange_n(&stand_in_pending, NULL, __ATOMIC_ACQUIRE);
+        const StandInWaveform *waveform = packet != NULL ? packet : &idle;
+        for (int i = 0; i < waveform->count; i++)
+        {
+            sleep_until_ns(edge);
+            unsigned long long late = now_ns() - edge;
+            if (late > stand_in_statistics[STATISTIC_EDGE_LATENESS_MAX])
+            {
+                stand_in_statistics[STATISTIC_EDGE_LATENESS_MAX] = late;
+            }
+            if (late > STAND_IN_EDGE_SLACK)
+            {
+                stand_in_statistics[STATISTIC_EDGES_LATE]++;
+            }
+            edge += waveform->half_bits[i];
+        }
+
+        if (packet != NULL)
+        {
+            stand_in_statistics[STATISTIC_TRACK_PACKETS]++;
+            sem_post(&stand_in_done);
+        }
+        else
+        {
+            stand_in_statistics[STATISTIC_IDLE_PACKETS]++;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Hands the packet of every known slot to the track thread once per period, like the
+ *        locomotive tasks of the module.
+ */
+static void *stand_in_refresh(void *arg)
+{
+    long long release = now_ns() + STAND_IN_PERIOD;
+    while (1)
+    {
+        sleep_until_ns(release);
+        long long start = now_ns();
+        if (start - release > (long long)stand_in_statistics[STATISTIC_LOCO_LATENESS_MAX])
+        {
+            stand_in_statistics[STATISTIC_LOCO_LATENESS_MAX] = start - release;
+        }
+
+        for (int slot = 0; slot < STAND_IN_LOCOS; slot++)
+        {
+            pthread_mutex_lock(&stand_in_lock);
+            LocomotiveData data = stand_in_slots[slot];
+            int known = stand_in_known[slot];
+            pthread_mutex_unlock(&stand_in_lock);
+            if (!known)
+            {
+                continue;
+            }
+
+            encode_stand_in(buildLocomotiveTelegram(data), STAND_IN_LENGTH, &stand_in_packet);
+            __atomic_store_n(&stand_in_pending, &stand_in_packet, __ATOMIC_RELEASE);
+            while (sem_wait(&stand_in_done) != 0 && errno == EINTR)
+            {
+            }
+        }
+
+        // An activation overruns when it ends after the release of the next one
+        long long end = now_ns();
+        if (end - start > (long long)stand_in_statistics[STATISTIC_LOCO_RUNTIME_MAX])
+        {
+            stand_in_statistics[STATISTIC_LOCO_RUNTIME_MAX] = end - start;
+        }
+        release += STAND_IN_PERIOD;
+        if (end > release)
+        {
+            stand_in_statistics[STATISTIC_DEADLINE_OVERRUNS]++;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Applies a command to the stand-in.
+ *
+ * Locomotive commands set the state of their slot, a statistics request is answered from the
+ * measurements of the threads. Everything else is only acknowledged.
+ *
+ * @param command The command with its payload.
+ * @param fd_event The event pipe.
+ */
+static void stand_in_command(const unsigned short *command, int fd_event)
+{
+    SystemDataConverter header = {.us = command[0]};
+    if (header.sd.type == 0b01)
+    {
+        LocomotiveDataConverter converter = {.us = command[0]};
+        int slot = converter.ld.address - 1;
+        if (slot >= 0 && slot < STAND_IN_LOCOS)
+        {
+            pthread_mutex_lock(&stand_in_lock);
+            stand_in_slots[slot] = converter.ld;
+            stand_in_known[slot] = 1;
+            pthread_mutex_unlock(&stand_in_lock);
+        }
+    }
+    else if (header.sd.type == 0b11 && header.sd.opcode == SYSTEM_STATISTICS)
+    {
+        long long now = now_ns();
+        for (unsigned short id = 1; id < STATISTIC_COUNT; id++)
+        {
+            EventData record = {.kind = EVENT_STATISTIC, .data = id, .count = STATISTIC_COUNT - 1, .time = now, .value = stand_in_statistics[id]};
+            write(fd_event, &record, sizeof(record));
+        }
+        if (header.sd.length >= 1 && command[1] == STATISTICS_RESET)
+        {
+            stand_in_statistics[STATISTIC_EDGE_LATENESS_MAX] = 0;
+            stand_in_statistics[STATISTIC_LOCO_LATENESS_MAX] = 0;
+            stand_in_statistics[STATISTIC_LOCO_RUNTIME_MAX] = 0;
+        }
+    }
+}
+
+/**
+ * @brief Gives a thread a real-time priority and optionally a CPU of its own.
+ *
+ * @return int Returns 0 on success, an error number if the priority was refused.
+ */
+static int make_realtime(pthread_t thread, int priority, int cpu)
+{
+    if (cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(thread, sizeof(set), &set);
+    }
+    struct sched_param param = {.sched_priority = priority};
+    return pthread_setschedparam(thread, SCHED_FIFO, &param);
+}
+
+/**
+ * @brief Acts as the module on named pipes with a track thread, a refresh thread and this thread
+ *        serving the commands, in the priority order of the tasks of the module.
+ *
+ * @param cmd The path of the command pipe.
+ * @param ack The path of the acknowledge pipe.
+ * @param event The path of the event pipe.
+ * @param cpu The CPU of the threads, -1 for any.
+ */
+static void stand_in(const char *cmd, const char *ack, const char *event, int cpu)
+{
+    // Opened for reading and writing, so the pipes stay usable while the harness reopens them
+    int fd_cmd = open(cmd, O_RDWR);
+    int fd_ack = open(ack, O_RDWR);
+    int fd_event = open(event, O_RDWR);
+    if (fd_cmd < 0 || fd_ack < 0 || fd_event < 0)
+    {
+        perror("Failed to open the stand-in pipes");
+        _exit(EXIT_FAILURE);
+    }
+
+    // Page faults and the timer slack of Linux would show up as jitter, the threads inherit the slack
+    mlockall(MCL_CURRENT | MCL_FUTURE);
+    prctl(PR_SET_TIMERSLACK, 1);
+    sem_init(&stand_in_done, 0, 0);
+    pthread_t track, refresh;
+    pthread_create(&track, NULL, stand_in_track, NULL);
+    pthread_create(&refresh, NULL, stand_in_refresh, NULL);
+    if (make_realtime(track, 80, cpu) != 0 || make_realtime(refresh, 70, cpu) != 0 ||
+        make_realtime(pthread_self(), 60, cpu) != 0)
+    {
+        printf("The stand-in runs without real-time priorities, they need root or CAP_SYS_NICE.\n");
+        fflush(stdout);
+    }
+
+    unsigned char buffer[4096];
+    size_t buffered = 0;
+    while (1)
+    {
+        ssize_t r = read(fd_cmd, buffer + buffered, sizeof(buffer) - buffered);
+        if (r <= 0)
+        {
+            _exit(EXIT_SUCCESS);
+        }
+        buffered += r;
+
+        size_t offset = 0;
+        while (buffered - offset >= sizeof(unsigned short))
+        {
+            unsigned short command[1 + SYSTEM_MAX_PAYLOAD];
+            memcpy(&command[0], buffer + offset, sizeof(command[0]));
+            SystemDataConverter header = {.us = command[0]};
+            size_t size = sizeof(command[0]) + (header.sd.type == 0b11 ? header.sd.length * sizeof(command[0]) : 0);
+            if (buffered - offset < size)
+            {
+                break;
+            }
+            memcpy(command, buffer + offset, size);
+            offset += size;
+
+            stand_in_command(command, fd_event);
+            command[0] |= 0x8000;
+            write(fd_ack, &command[0], sizeof(command[0]));
+        }
+        memmove(buffer, buffer + offset, buffered - offset);
+        buffered -= offset;
+    }
+}
+
+/**
+ * @brief Creates the named pipes of a stand-in module in a directory and starts it.
+ *
+ * The fifo paths of this process are pointed to the pipes.
+ *
+ * @param directory The directory of the pipes, created if missing.
+ * @param cpu The CPU of the threads of the stand-in, -1 for any.
+ * @return pid_t The process of the stand-in, -1 on failure.
+ */
+static pid_t start_stand_in(const char *directory, int cpu)
+{
+    static char cmd[512], ack[512], event[512];
+    snprintf(cmd, sizeof(cmd), "%s/cmd", directory);
+    snprintf(ack, sizeof(ack), "%s/ack", directory);
+    snprintf(event, sizeof(event), "%s/event", directory);
+
+    mkdir(directory, 0755);
+    unlink(cmd);
+    unlink(ack);
+    unlink(event);
+    if (mkfifo(cmd, 0600) != 0 || mkfifo(ack, 0600) != 0 || mkfifo(event, 0600) != 0)
+    {
+        perror("Failed to create the stand-in pipes");
+        return -1;
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        stand_in(cmd, ack, event, cpu);
+    }
+    setenv("DCC_FIFO_CMD", cmd, 1);
+    setenv("DCC_FIFO_ACK", ack, 1);
+    setenv("DCC_FIFO_EVENT", event, 1);
+    return pid;
+}
+
+/**
+ * @brief Runs one profile: starts its stress, sends locomotive commands at the rate and collects
+ *        the statistics of the module over the measurement.
+ *
+ * @return int Returns 0 on success, -1 if the module did not answer.
+ */
+static int run_profile(ProfileResult *result, double rate, double duration, int workers, size_t memory,
+                       const char *directory)
+{
+    pid_t pids[4 * STRESS_MAX_WORKERS];
+    int count = start_workers(result->profile->kinds, workers, memory, directory, pids);
+    sleep(STRESS_SETTLE);
+
+    // The worst values of the module start over, so they cover this profile alone
+    if (request_statistics_reset(result->before) != 0)
+    {
+        stop_workers(pids, count);
+        return -1;
+    }
+
+    // Open loop: command n is due at n / rate
+    long long period = (long long)(1000000000 / rate);
+    long long started = now_ns();
+    long long end = started + (long long)(duration * 1000000000);
+    for (long n = 0;; n++)
+    {
+        long long due = started + n * period;
+        if (due >= end)
+        {
+            break;
+        }
+        sleep_until_ns(due);
+        long long sent = now_ns();
+
+        LocomotiveDataConverter converter = {.ld = {
+                                                 .address = 1 + rand() % STAND_IN_LOCOS,
+                                                 .direction = rand() % 2,
+                                                 .light = rand() % 2,
+                                                 .speed = rand() % 16,
+                                                 .type = 0b01,
+                                                 .ack = 0,
+                                             }};
+        // Speed 1 is the emergency stop, the harness never stops a locomotive that way
+        if (converter.ld.speed == 1)
+        {
+            converter.ld.speed = 2;
+        }
+
+        result->sent++;
+        if (send_with_ack(converter.us, 3) == 0)
+        {
+            if (result->acknowledged < STRESS_MAX_SAMPLES)
+            {
+                result->latencies[result->acknowledged] = (now_ns() - sent) / 1000;
+            }
+            result->acknowledged++;
+        }
+        else
+        {
+            result->lost++;
+        }
+    }
+
+    int answered = request_statistics(result->after) == 0;
+    stop_workers(pids, count);
+    return answered ? 0 : -1;
+}
+
+/**
+ * @brief Returns whether the module kept the DCC timing during a profile.
+ */
+static int timing_kept(const ProfileResult *result)
+{
+    return result->after[STATISTIC_EDGES_LATE] == result->before[STATISTIC_EDGES_LATE] &&
+           result->after[STATISTIC_DEADLINE_OVERRUNS] == result->before[STATISTIC_DEADLINE_OVERRUNS];
+}
+
+/**
+ * @brief Returns a percentile of the sorted command latencies of a profile in microseconds, 0 without any.
+ */
+static long latency_percentile(const ProfileResult *result, int permille)
+{
+    long samples = result->acknowledged < STRESS_MAX_SAMPLES ? result->acknowledged : STRESS_MAX_SAMPLES;
+    if (samples == 0)
+    {
+        return 0;
+    }
+    long index = samples * permille / 1000;
+    return result->latencies[index < samples ? index : samples - 1];
+}
+
+/**
+ * @brief Prints the profiles side by side.
+ */
+static void print_report(ProfileResult results[], int count)
+{
+    printf("%-8s %14s %10s %14s %9s %10s %10s %10s %6s  %s\n", "profile", "edge late max", "late edges",
+           "task late max", "overruns", "cmd p50", "cmd p99", "cmd max", "lost", "timing");
+    for (int i = 0; i < count; i++)
+    {
+        const ProfileResult *r = &results[i];
+        printf("%-8s %11.1f us %10llu %11.1f us %9llu %7ld us %7ld us %7ld us %6ld  %s\n", r->profile->name,
+               r->after[STATISTIC_EDGE_LATENESS_MAX] / 1000.0,
+               r->after[STATISTIC_EDGES_LATE] - r->before[STATISTIC_EDGES_LATE],
+               r->after[STATISTIC_LOCO_LATENESS_MAX] / 1000.0,
+               r->after[STATISTIC_DEADLINE_OVERRUNS] - r->before[STATISTIC_DEADLINE_OVERRUNS],
+               latency_percentile(r, 500), latency_percentile(r, 990), latency_percentile(r, 1000), r->lost,
+               timing_kept(r) ? "kept" : "violated");
+    }
+}
+
+/**
+ * @brief Appends the profiles to a CSV file, one line each, writing the header into an empty file.
+ *
+ * @return int Returns 0 on success, -1 if the file can't be written.
+ */
+static int append_csv(const char *path, const char *backend, int workers, double duration, ProfileResult results[],
+                      int count)
+{
+    FILE *file = fopen(path, "a");
+    if (file == NULL)
+    {
+        perror("Failed to open the CSV file");
+        return -1;
+    }
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+
+    fseek(file, 0, SEEK_END);
+    if (ftell(file) == 0)
+    {
+        fprintf(file, "host,backend,profile,workers,duration_s,edge_lateness_max_ns,edges_late,task_lateness_max_ns,"
+                      "task_runtime_max_ns,overruns,packets,command_p50_us,command_p99_us,command_max_us,commands_lost,timing\n");
+    }
+    for (int i = 0; i < count; i++)
+    {
+        const ProfileResult *r = &results[i];
+        fprintf(file, "%s,%s,%s,%d,%.3f,%llu,%llu,%llu,%llu,%llu,%llu,%ld,%ld,%ld,%ld,%s\n", host, backend,
+                r->profile->name, workers, duration, r->after[STATISTIC_EDGE_LATENESS_MAX],
+                r->after[STATISTIC_EDGES_LATE] - r->before[STATISTIC_EDGES_LATE],
+                r->after[STATISTIC_LOCO_LATENESS_MAX], r->after[STATISTIC_LOCO_RUNTIME_MAX],
+                r->after[STATISTIC_DEADLINE_OVERRUNS] - r->before[STATISTIC_DEADLINE_OVERRUNS],
+                r->after[STATISTIC_TRACK_PACKETS] - r->before[STATISTIC_TRACK_PACKETS], latency_percentile(r, 500),
+                latency_percentile(r, 990), latency_percentile(r, 1000), r->lost, timing_kept(r) ? "kept" : "violated");
+    }
+    fclose(file);
+    return 0;
+}
+
+/**
+ * @brief Parses a comma separated list of profile names.
+ *
+ * @return int The number of profiles, -1 on an unknown name.
+ */
+static int parse_profiles(char *list, const StressProfile *profiles[])
+{
+    int count = 0;
+    for (char *name = strtok(list, ","); name != NULL; name = strtok(NULL, ","))
+    {
+        int found = 0;
+        for (int p = 0; p < sizeof(stress_profiles) / sizeof(stress_profiles[0]); p++)
+        {
+            if (strcmp(name, stress_profiles[p].name) == 0 && count < STRESS_MAX_PROFILES)
+            {
+                profiles[count++] = &stress_profiles[p];
+                found = 1;
+            }
+        }
+        if (!found)
+        {
+            return -1;
+        }
+    }
+    return count;
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [OPTION]...\n", name);
+    printf("\nDescription: Runs the module under a series of stress profiles and reports the jitter of its edges, the deadline misses of its tasks and the latency of commands of each profile side by side. Exits with 1 if a profile broke the DCC timing.\n");
+    printf("\nOptions:\n");
+    printf("  --cpu <n>                CPU of the threads of the stand-in. Defaults to any.\n");
+    printf("  --csv <file>             Append the report to a CSV file, one line per profile, to compare hosts.\n");
+    printf("  --duration <s>           Length of the measurement of each profile in seconds. Defaults to 10.\n");
+    printf("  --io-directory <path>    Directory of the files written by the io profile. Defaults to /tmp.\n");
+    printf("  --memory <MiB>           Buffer of each memory worker. Defaults to 64.\n");
+    printf("  --profiles <p>[,<p>]...  Profiles to run out of idle, cpu, memory, irq, io and all. Defaults to all of them.\n");
+    printf("  --rate <commands/s>      Rate of locomotive commands during each profile. Defaults to 50.\n");
+    printf("  --stand-in <directory>   Play the packets by a userspace stand-in of the module on named pipes in the directory instead of the module.\n");
+    printf("  --workers <n>            Workers per kind of stress. Defaults to the number of online CPUs.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const StressProfile *profiles[STRESS_MAX_PROFILES];
+    int profile_count = 0;
+    double duration = 10;
+    double rate = 50;
+    int workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int memory = 64;
+    int cpu = -1;
+    const char *io_directory = "/tmp";
+    const char *directory = NULL;
+    const char *csv = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        int valid = i + 1 < argc;
+        if (valid && strcmp(argv[i], "--profiles") == 0)
+        {
+            valid = (profile_count = parse_profiles(argv[++i], profiles)) > 0;
+        }
+        else if (valid && strcmp(argv[i], "--duration") == 0)
+        {
+            valid = sscanf(argv[++i], "%lf", &duration) == 1 && duration > 0;
+        }
+        else if (valid && strcmp(argv[i], "--rate") == 0)
+        {
+            valid = sscanf(argv[++i], "%lf", &rate) == 1 && rate > 0;
+        }
+        else if (valid && strcmp(argv[i], "--workers") == 0)
+        {
+            valid = sscanf(argv[++i], "%d", &workers) == 1 && workers >= 1 && workers <= STRESS_MAX_WORKERS;
+        }
+        else if (valid && strcmp(argv[i], "--memory") == 0)
+        {
+            valid = sscanf(argv[++i], "%d", &memory) == 1 && memory >= 1;
+        }
+        else if (valid && strcmp(argv[i], "--cpu") == 0)
+        {
+            valid = sscanf(argv[++i], "%d", &cpu) == 1 && cpu >= 0;
+        }
+        else if (valid && strcmp(argv[i], "--io-directory") == 0)
+        {
+            io_directory = argv[++i];
+        }
+        else if (valid && strcmp(argv[i], "--stand-in") == 0)
+        {
+            directory = argv[++i];
+        }
+        else if (valid && strcmp(argv[i], "--csv") == 0)
+        {
+            csv = argv[++i];
+        }
+        else
+        {
+            valid = 0;
+        }
+
+        if (!valid)
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (profile_count == 0)
+    {
+        for (int p = 0; p < sizeof(stress_profiles) / sizeof(stress_profiles[0]); p++)
+        {
+            profiles[profile_count++] = &stress_profiles[p];
+        }
+    }
+    workers = workers > STRESS_MAX_WORKERS ? STRESS_MAX_WORKERS : workers;
+
+    pid_t stand_in_pid = -1;
+    if (directory != NULL && (stand_in_pid = start_stand_in(directory, cpu)) < 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    const char *backend = directory != NULL ? "stand-in" : "module";
+    printf("Backend %s, %ld CPUs, %d workers per kind of stress, %.1f s per profile, %.1f commands/s\n", backend,
+           sysconf(_SC_NPROCESSORS_ONLN), workers, duration, rate);
+
+    ProfileResult results[STRESS_MAX_PROFILES];
+    int failed = 0;
+    int completed = 0;
+    srand(1);
+    for (int p = 0; p < profile_count; p++)
+    {
+        ProfileResult *result = &results[completed];
+        memset(result, 0, sizeof(*result));
+        result->profile = profiles[p];
+        result->latencies = malloc(STRESS_MAX_SAMPLES * sizeof(long));
+        if (result->latencies == NULL)
+        {
+            perror("Allocation error");
+            failed = 1;
+            break;
+        }
+
+        printf("Running profile %s...\n", result->profile->name);
+        fflush(stdout);
+        if (run_profile(result, rate, duration, workers, (size_t)memory << 20, io_directory) != 0)
+        {
+            printf("Module did not answer, profile %s aborted!\n", result->profile->name);
+            free(result->latencies);
+            failed = 1;
+            break;
+        }
+        long samples = result->acknowledged < STRESS_MAX_SAMPLES ? result->acknowledged : STRESS_MAX_SAMPLES;
+        qsort(result->latencies, samples, sizeof(long), compare_long);
+        completed++;
+    }
+
+    printf("\n");
+    print_report(results, completed);
+    if (csv != NULL && append_csv(csv, backend, workers, duration, results, completed) != 0)
+    {
+        failed = 1;
+    }
+
+    int violated = 0;
+    for (int i = 0; i < completed; i++)
+    {
+        violated |= !timing_kept(&results[i]);
+        free(results[i].latencies);
+    }
+
+    if (stand_in_pid > 0)
+    {
+        kill(stand_in_pid, SIGTERM);
+        waitpid(stand_in_pid, NULL, 0);
+    }
+    if (failed)
+    {
+        return EXIT_FAILURE;
+    }
+    return violated ? 1 : EXIT_SUCCESS;
+}
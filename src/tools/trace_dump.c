@@ -0,0 +1,462 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/select.h>
+
+#include "communication/linux_rtai_communication.h"
+#include "telegram/locomotive.h"
+#include "telegram/magnetic.h"
+#include "telegram/system.h"
+#include "telegram/event.h"
+#include "telegram/trace.h"
+
+#define TRACE_MAX_DISTRICTS 256 /* Districts whose packets are paired, the module has fewer */
+#define TRACE_MAX_CPUS 256      /* CPUs named in the output */
+
+/**
+ * @struct TraceLog
+ * @brief The records read from the module or a raw file.
+ *
+ * This structure contains the following fields:
+ * - records: The records in the order they were read.
+ * - count: Number of records.
+ * - capacity: Number of records which fit without growing.
+ */
+typedef struct
+{
+    TraceData *records; // The records in the order they were read.
+    size_t count;       // Number of records.
+    size_t capacity;    // Number of records which fit without growing.
+} TraceLog;
+
+static FILE *raw_file = NULL;
+
+/**
+ * @brief Returns the current monotonic time in microseconds.
+ */
+static long long now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Appends a record to the log and to the raw file.
+ *
+ * @param log The log.
+ * @param record The record.
+ * @return int 0 on success, -1 if the log can't grow.
+ */
+static int append_record(TraceLog *log, const TraceData *record)
+{
+    if (log->count == log->capacity)
+    {
+        size_t capacity = log->capacity ? log->capacity * 2 : 65536;
+        TraceData *records = realloc(log->records, capacity * sizeof(TraceData));
+        if (records == NULL)
+        {
+            perror("Allocation error");
+            return -1;
+        }
+        log->records = records;
+        log->capacity = capacity;
+    }
+    log->records[log->count++] = *record;
+    if (raw_file != NULL)
+    {
+        fwrite(record, sizeof(*record), 1, raw_file);
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads all records waiting in the trace fifo.
+ *
+ * @param fd_trace The trace fifo.
+ * @param timeout Longest time to wait for the first record in microseconds.
+ * @param log Receives the records.
+ * @return int 0 on success, -1 if the log can't grow.
+ */
+static int read_trace(int fd_trace, long long timeout, TraceLog *log)
+{
+    static unsigned char buffer[256 * sizeof(TraceData)];
+    static size_t buffered = 0;
+
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(fd_trace, &fds);
+    struct timeval tv = {.tv_sec = timeout / 1000000, .tv_usec = timeout % 1000000};
+    if (select(fd_trace + 1, &fds, NULL, NULL, &tv) <= 0)
+    {
+        return 0;
+    }
+
+    ssize_t r;
+    while ((r = read(fd_trace, buffer + buffered, sizeof(buffer) - buffered)) > 0)
+    {
+        buffered += r;
+        size_t offset = 0;
+        while (buffered - offset >= sizeof(TraceData))
+        {
+            TraceData record;
+            memcpy(&record, buffer + offset, sizeof(record));
+            if (append_record(log, &record) != 0)
+            {
+                return -1;
+            }
+            offset += sizeof(record);
+        }
+        memmove(buffer, buffer + offset, buffered - offset);
+        buffered -= offset;
+    }
+    return 0;
+}
+
+/**
+ * @brief Reads the records of a raw file written with --raw.
+ *
+ * @param path The path of the file.
+ * @param log Receives the records.
+ * @return int 0 on success, -1 on failure.
+ */
+static int read_raw_file(const char *path, TraceLog *log)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        perror("Failed to open the raw trace");
+        return -1;
+    }
+    TraceData record;
+    while (fread(&record, sizeof(record), 1, file) == 1)
+    {
+        if (append_record(log, &record) != 0)
+        {
+            fclose(file);
+            return -1;
+        }
+    }
+    fclose(file);
+    return 0;
+}
+
+static int compare_time(const void *a, const void *b)
+{
+    const TraceData *x = a;
+    const TraceData *y = b;
+    if (x->time != y->time)
+    {
+        return x->time < y->time ? -1 : 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns a readable name of a command header word.
+ *
+ * @param word The header word.
+ * @param name Receives the name.
+ * @param size The size of name.
+ */
+static void command_name(unsigned short word, char *name, size_t size)
+{
+    unsigned short type = (word >> 13) & 0x3;
+    if (type == 0x1)
+    {
+        snprintf(name, size, "locomotive %d", ((LocomotiveData *)&word)->address);
+    }
+    else if (type == 0x2)
+    {
+        snprintf(name, size, "accessory %d", ((MagneticData *)&word)->address);
+    }
+    else if (type == 0x3)
+    {
+        snprintf(name, size, "system %d", ((SystemData *)&word)->opcode);
+    }
+    else
+    {
+        snprintf(name, size, "command 0x%04x", word);
+    }
+}
+
+/**
+ * @brief Returns the name of a traced semaphore.
+ */
+static const char *semaphore_name(unsigned short semaphore)
+{
+    switch (semaphore)
+    {
+    case TRACE_SEM_COMMAND:
+        return "wait command";
+    case TRACE_SEM_RAILS:
+        return "wait rails";
+    case TRACE_SEM_DONE:
+        return "wait packet sent";
+    default:
+        return "wait";
+    }
+}
+
+/**
+ * @brief Writes the records as Chrome trace event JSON, readable by chrome://tracing and Perfetto.
+ *
+ * Events of the tasks are shown per CPU, the packets per district. The time axis starts at the
+ * first record.
+ *
+ * @param log The records, sorted by time.
+ * @param path The path of the JSON file.
+ * @return int 0 on success, -1 on failure.
+ */
+static int write_chrome_trace(const TraceLog *log, const char *path)
+{
+    FILE *out = fopen(path, "w");
+    if (out == NULL)
+    {
+        perror("Failed to create the JSON trace");
+        return -1;
+    }
+
+    static unsigned long long packet_start[TRACE_MAX_DISTRICTS];
+    static unsigned char district_seen[TRACE_MAX_DISTRICTS];
+    static unsigned char cpu_seen[TRACE_MAX_CPUS];
+    unsigned long long base = log->count > 0 ? log->records[0].time : 0;
+    const char *separator = "";
+    char name[32];
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (size_t i = 0; i < log->count; i++)
+    {
+        const TraceData *r = &log->records[i];
+        double ts = (r->time - base) / 1000.0;
+        cpu_seen[r->cpu] = 1;
+
+        switch (r->kind)
+        {
+        case TRACE_COMMAND:
+            command_name(r->data, name, sizeof(name));
+            fprintf(out, "%s{\"name\":\"%s\",\"cat\":\"command\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,"
+                         "\"args\":{\"word\":\"0x%04x\",\"words\":%u}}",
+                    separator, name, ts, r->cpu, r->data, r->arg);
+            break;
+        case TRACE_ACK:
+            fprintf(out, "%s{\"name\":\"%s\",\"cat\":\"ack\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,"
+                         "\"args\":{\"word\":\"0x%04x\"}}",
+                    separator, r->arg ? "nack" : "ack", ts, r->cpu, r->data);
+            break;
+        case TRACE_PACKET_HANDED:
+            fprintf(out, "%s{\"name\":\"handed\",\"cat\":\"packet\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":2,\"tid\":%u,"
+                         "\"args\":{\"address\":\"0x%02x\",\"instruction\":\"0x%02x\",\"cpu\":%d}}",
+                    separator, ts, r->arg, r->data >> 8, r->data & 0xFF, r->cpu);
+            break;
+        case TRACE_PACKET_START:
+            if (r->arg < TRACE_MAX_DISTRICTS)
+            {
+                packet_start[r->arg] = r->time;
+            }
+            continue;
+        case TRACE_PACKET_END:
+            // Packets of a district never overlap, so each end belongs to the last start
+            if (r->arg >= TRACE_MAX_DISTRICTS || packet_start[r->arg] == 0 || packet_start[r->arg] > r->time)
+            {
+                continue;
+            }
+            district_seen[r->arg] = 1;
+            fprintf(out, "%s{\"name\":\"packet 0x%02x 0x%02x\",\"cat\":\"packet\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":2,\"tid\":%u,"
+                         "\"args\":{\"address\":\"0x%02x\",\"instruction\":\"0x%02x\"}}",
+                    separator, r->data >> 8, r->data & 0xFF, (packet_start[r->arg] - base) / 1000.0,
+                    (r->time - packet_start[r->arg]) / 1000.0, r->arg, r->data >> 8, r->data & 0xFF);
+            packet_start[r->arg] = 0;
+            break;
+        case TRACE_SEM_WAIT:
+            fprintf(out, "%s{\"name\":\"%s\",\"cat\":\"semaphore\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                    separator, semaphore_name(r->data), ts, r->arg / 1000.0, r->cpu);
+            break;
+        default:
+            continue;
+        }
+        separator = ",\n";
+    }
+
+    fprintf(out, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"RT tasks\"}}", separator);
+    fprintf(out, ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"Districts\"}}");
+    for (int cpu = 0; cpu < TRACE_MAX_CPUS; cpu++)
+    {
+        if (cpu_seen[cpu])
+        {
+            fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"CPU %d\"}}", cpu, cpu);
+        }
+    }
+    for (int district = 0; district < TRACE_MAX_DISTRICTS; district++)
+    {
+        if (district_seen[district])
+        {
+            fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":2,\"tid\":%d,\"args\":{\"name\":\"District %d\"}}",
+                    district, district);
+        }
+    }
+    fprintf(out, "\n]}\n");
+
+    if (fclose(out) != 0)
+    {
+        perror("Failed to write the JSON trace");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Prints the number of records of each kind and the span they cover.
+ *
+ * @param log The records, sorted by time.
+ */
+static void print_summary(const TraceLog *log)
+{
+    static const char *names[] = {
+        [TRACE_COMMAND] = "commands",
+        [TRACE_ACK] = "acknowledgements",
+        [TRACE_PACKET_HANDED] = "packets handed",
+        [TRACE_PACKET_START] = "packets sent",
+        [TRACE_SEM_WAIT] = "semaphore waits",
+    };
+    unsigned long counts[TRACE_SEM_WAIT + 1] = {0};
+
+    for (size_t i = 0; i < log->count; i++)
+    {
+        if (log->records[i].kind <= TRACE_SEM_WAIT)
+        {
+            counts[log->records[i].kind]++;
+        }
+    }
+    double span = log->count > 1 ? (log->records[log->count - 1].time - log->records[0].time) / 1e9 : 0;
+    printf("%zu records over %.3f s\n", log->count, span);
+    for (int kind = TRACE_COMMAND; kind <= TRACE_SEM_WAIT; kind++)
+    {
+        if (names[kind] != NULL)
+        {
+            printf("  %-18s %lu\n", names[kind], counts[kind]);
+        }
+    }
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [OPTION]...\n", name);
+    printf("\nDescription: Records the events traced by the module and converts them to Chrome trace event JSON, which chrome://tracing and Perfetto open.\n");
+    printf("\nOptions:\n");
+    printf("  --duration <s>           Length of the recording in seconds. Defaults to 10.\n");
+    printf("  --input <file>           Convert records saved with --raw instead of recording.\n");
+    printf("  --output <file>          Path of the JSON trace. Defaults to trace.json.\n");
+    printf("  --raw <file>             Save the records for a later conversion.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    double duration = 10;
+    const char *input = NULL;
+    const char *output = "trace.json";
+    const char *raw = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        int valid = i + 1 < argc;
+        if (valid && strcmp(argv[i], "--duration") == 0)
+        {
+            valid = sscanf(argv[++i], "%lf", &duration) == 1 && duration > 0;
+        }
+        else if (valid && strcmp(argv[i], "--input") == 0)
+        {
+            input = argv[++i];
+        }
+        else if (valid && strcmp(argv[i], "--output") == 0)
+        {
+            output = argv[++i];
+        }
+        else if (valid && strcmp(argv[i], "--raw") == 0)
+        {
+            raw = argv[++i];
+        }
+        else
+        {
+            valid = 0;
+        }
+
+        if (!valid)
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    TraceLog log = {0};
+    if (input != NULL)
+    {
+        if (read_raw_file(input, &log) != 0)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        if (raw != NULL && (raw_file = fopen(raw, "wb")) == NULL)
+        {
+            perror("Failed to create the raw trace");
+            return EXIT_FAILURE;
+        }
+        int fd_trace = open_trace_fifo();
+        if (fd_trace < 0)
+        {
+            return EXIT_FAILURE;
+        }
+
+        unsigned long long before[STATISTIC_COUNT] = {0}, after[STATISTIC_COUNT] = {0};
+        int module_statistics = request_statistics(before) == 0;
+        unsigned short enable = 1;
+        if (send_system_with_ack(SYSTEM_TRACE, &enable, 1, 3) != 0)
+        {
+            printf("The module did not enable the trace stream\n");
+            close(fd_trace);
+            return EXIT_FAILURE;
+        }
+
+        int result = 0;
+        long long end = now_us() + (long long)(duration * 1000000);
+        long long now;
+        while (result == 0 && (now = now_us()) < end)
+        {
+            result = read_trace(fd_trace, end - now, &log);
+        }
+
+        unsigned short disable = 0;
+        send_system_with_ack(SYSTEM_TRACE, &disable, 1, 3);
+        // Records already in the fifo are still read, the module stops filling it with the acknowledgement
+        if (result == 0)
+        {
+            result = read_trace(fd_trace, 0, &log);
+        }
+        close(fd_trace);
+        if (raw_file != NULL)
+        {
+            fclose(raw_file);
+        }
+        if (result != 0)
+        {
+            return EXIT_FAILURE;
+        }
+        if (module_statistics && request_statistics(after) == 0)
+        {
+            printf("%llu records were overwritten before they were read\n",
+                   after[STATISTIC_TRACE_LOST] - before[STATISTIC_TRACE_LOST]);
+        }
+    }
+
+    // The rings of the CPUs are drained one after the other, the records interleave only by their time
+    qsort(log.records, log.count, sizeof(TraceData), compare_time);
+    print_summary(&log);
+    int result = write_chrome_trace(&log, output);
+    free(log.records);
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
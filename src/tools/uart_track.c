@@ -0,0 +1,631 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/ioctl.h>
+#include <asm/termbits.h>
+
+#include "communication/linux_rtai_communication.h"
+#include "telegram/locomotive.h"
+#include "telegram/magnetic.h"
+#include "telegram/idle.h"
+#include "telegram/uart.h"
+
+#define TELEGRAM_LENGTH 42     /* Bits of the telegrams built by the module */
+#define PREAMBLE_MIN 14        /* One bits a command station sends before the start bit */
+#define LINE_BUFFER 4096       /* Bytes collected for one write to the serial line */
+#define LOOPBACK_BATCH 16      /* Packets written to the pty with one write */
+#define LOOPBACK_TIMEOUT 1000000 /* Time to wait for the bytes of a batch in microseconds */
+#define BYTE_TIME_US (UART_FRAME_BITS * UART_BIT_TIME / 1000) /* Time of one byte on the serial line */
+
+/**
+ * @struct LineStatistics
+ * @brief What the backend wrote to the serial line.
+ *
+ * This structure contains the following fields:
+ * - packets: Number of packets of the district written.
+ * - idle_packets: Number of idle packets written to keep the line busy.
+ * - bytes: Number of bytes written.
+ * - writes: Number of write calls.
+ * - foreign: Number of packets of other districts skipped.
+ */
+typedef struct
+{
+    unsigned long packets;      // Number of packets of the district written.
+    unsigned long idle_packets; // Number of idle packets written to keep the line busy.
+    unsigned long long bytes;   // Number of bytes written.
+    unsigned long writes;       // Number of write calls.
+    unsigned long foreign;      // Number of packets of other districts skipped.
+} LineStatistics;
+
+/**
+ * @struct LineDecoder
+ * @brief Recovers the packets from the levels of a serial line, the way a decoder sees the rails.
+ *
+ * This structure contains the following fields:
+ * - level, run: Level of the current run and its length in UART bits.
+ * - first: Length of the low half of the current bit, 0 before it ended.
+ * - ones: One bits since the last zero bit outside of a packet.
+ * - in_packet: The start bit of a packet was received.
+ * - bits, count: Bits of the packet from its start bit on.
+ * - packets: Number of complete packets.
+ * - errors: Number of half bits or preambles out of the timing.
+ */
+typedef struct
+{
+    int level;               // Level of the current run.
+    int run;                 // Length of the current run in UART bits.
+    int first;               // Length of the low half of the current bit, 0 before it ended.
+    int ones;                // One bits since the last zero bit outside of a packet.
+    int in_packet;           // The start bit of a packet was received.
+    unsigned long long bits; // Bits of the packet from its start bit on, the last one lowest.
+    int count;               // Number of bits of the packet.
+    unsigned long packets;   // Number of complete packets.
+    unsigned long errors;    // Number of half bits or preambles out of the timing.
+} LineDecoder;
+
+static volatile sig_atomic_t running = 1;
+
+static void stop_backend(int signal)
+{
+    running = 0;
+}
+
+/**
+ * @brief Returns the current monotonic time in microseconds.
+ */
+static long long now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/**
+ * @brief Sets a serial line to raw 8N1 at UART_BAUD.
+ *
+ * The rate is no standard one, so it is set with termios2. A pseudo terminal ignores it.
+ *
+ * @param fd The serial line.
+ * @return int 0 on success, -1 on failure.
+ */
+static int configure_line(int fd)
+{
+    struct termios2 tio;
+    if (ioctl(fd, TCGETS2, &tio) != 0)
+    {
+        perror("Failed to read the settings of the serial line");
+        return -1;
+    }
+    tio.c_iflag = 0;
+    tio.c_oflag = 0;
+    tio.c_lflag = 0;
+    tio.c_cflag = CS8 | CREAD | CLOCAL | BOTHER;
+    tio.c_ispeed = UART_BAUD;
+    tio.c_ospeed = UART_BAUD;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if (ioctl(fd, TCSETS2, &tio) != 0)
+    {
+        perror("Failed to set the serial line to 8N1");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Writes bytes to the serial line with as few writes as the driver allows.
+ *
+ * @param fd The serial line.
+ * @param bytes The bytes.
+ * @param count The number of bytes.
+ * @param stats Counts the bytes and writes.
+ * @return int 0 on success, -1 on failure.
+ */
+static int write_line(int fd, const unsigned char *bytes, size_t count, LineStatistics *stats)
+{
+    while (count > 0)
+    {
+        ssize_t w = write(fd, bytes, count);
+        if (w < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("Failed to write to the serial line");
+            return -1;
+        }
+        stats->writes++;
+        stats->bytes += w;
+        bytes += w;
+        count -= w;
+    }
+    return 0;
+}
+
+/**
+ * @brief Returns the bytes waiting to be sent on the serial line.
+ *
+ * A pseudo terminal or a USB adapter reports its buffer as empty while the bytes are still
+ * ahead of the line, so the time of the bytes written so far is the lower bound.
+ *
+ * @param fd The serial line.
+ * @param line_end The time the last written byte ends on the line in microseconds.
+ * @return long The number of bytes.
+ */
+static long queued_bytes(int fd, long long line_end)
+{
+    int queued = 0;
+    ioctl(fd, TIOCOUTQ, &queued);
+    long long ahead = line_end - now_us();
+    long estimate = ahead > 0 ? (long)(ahead / BYTE_TIME_US) : 0;
+    return queued > estimate ? queued : estimate;
+}
+
+/**
+ * @brief Appends the bytes of the packets of a district waiting in the UART fifo.
+ *
+ * Records which don't fit into the buffer stay in the fifo for the next call.
+ *
+ * @param fd_uart The UART fifo.
+ * @param timeout Longest time to wait for the first record in microseconds.
+ * @param district The district of the serial line.
+ * @param buffer Receives the bytes.
+ * @param used The number of bytes in the buffer, updated.
+ * @param stats Counts the packets.
+ */
+static void read_packets(int fd_uart, long long timeout, int district, unsigned char *buffer, size_t *used, LineStatistics *stats)
+{
+    static unsigned char records[64 * sizeof(UartData)];
+    static size_t buffered = 0;
+
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(fd_uart, &fds);
+    struct timeval tv = {.tv_sec = timeout / 1000000, .tv_usec = timeout % 1000000};
+    if (select(fd_uart + 1, &fds, NULL, NULL, &tv) <= 0)
+    {
+        return;
+    }
+
+    while (*used + sizeof(records) <= LINE_BUFFER)
+    {
+        ssize_t r = read(fd_uart, records + buffered, sizeof(records) - buffered);
+        if (r <= 0)
+        {
+            break;
+        }
+        buffered += r;
+        size_t offset = 0;
+        while (buffered - offset >= sizeof(UartData))
+        {
+            UartData record;
+            memcpy(&record, records + offset, sizeof(record));
+            offset += sizeof(record);
+            if (record.district != district || record.length > UART_MAX_BYTES)
+            {
+                stats->foreign++;
+                continue;
+            }
+            memcpy(buffer + *used, record.bytes, record.length);
+            *used += record.length;
+            stats->packets++;
+        }
+        memmove(records, records + offset, buffered - offset);
+        buffered -= offset;
+    }
+}
+
+/**
+ * @brief Drives the booster of a UART district from the packets the module publishes.
+ *
+ * The packets are written as soon as they arrive. Idle packets keep at least queue packets in
+ * the transmit buffer of the line, an empty buffer would leave the rails at one level.
+ *
+ * @param device The serial line of the booster.
+ * @param district The district of the booster.
+ * @param queue The idle packets kept in the transmit buffer.
+ * @return int EXIT_SUCCESS or EXIT_FAILURE.
+ */
+static int run_backend(const char *device, int district, int queue)
+{
+    unsigned char idle[UART_MAX_BYTES];
+    IdleConverter converter;
+    converter.it = buildIdleTelegram();
+    int idle_length = encodeUartTelegram(converter.ull, TELEGRAM_LENGTH, idle, sizeof(idle));
+    long low_water = idle_length;
+    long high_water = (long)queue * idle_length;
+
+    int fd_line = open(device, O_RDWR | O_NOCTTY);
+    if (fd_line < 0)
+    {
+        perror("Failed to open the serial line");
+        return EXIT_FAILURE;
+    }
+    if (configure_line(fd_line) != 0)
+    {
+        close(fd_line);
+        return EXIT_FAILURE;
+    }
+    int fd_uart = open_uart_fifo();
+    if (fd_uart < 0)
+    {
+        close(fd_line);
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGINT, stop_backend);
+    signal(SIGTERM, stop_backend);
+    printf("Driving district %d on %s at %d baud, stop with Ctrl-C\n", district, device, UART_BAUD);
+
+    LineStatistics stats = {0};
+    static unsigned char buffer[LINE_BUFFER];
+    long long started = now_us();
+    long long line_end = started;
+    while (running)
+    {
+        // Wait for packets until the line is about to run out of bytes
+        long queued = queued_bytes(fd_line, line_end);
+        long long timeout = queued > low_water ? (queued - low_water) * BYTE_TIME_US : 0;
+        size_t used = 0;
+        read_packets(fd_uart, timeout, district, buffer, &used, &stats);
+
+        queued = queued_bytes(fd_line, line_end);
+        while (queued + (long)used < high_water && used + idle_length <= LINE_BUFFER)
+        {
+            memcpy(buffer + used, idle, idle_length);
+            used += idle_length;
+            stats.idle_packets++;
+        }
+        if (used > 0)
+        {
+            if (write_line(fd_line, buffer, used, &stats) != 0)
+            {
+                break;
+            }
+            long long now = now_us();
+            line_end = (line_end > now ? line_end : now) + (long long)used * BYTE_TIME_US;
+        }
+    }
+
+    double seconds = (now_us() - started) / 1e6;
+    printf("\n%lu packets and %lu idle packets in %.1f s, %llu bytes in %lu writes\n",
+           stats.packets, stats.idle_packets, seconds, stats.bytes, stats.writes);
+    if (stats.foreign > 0)
+    {
+        printf("%lu packets of other districts skipped\n", stats.foreign);
+    }
+    close(fd_uart);
+    close(fd_line);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Takes a received bit, completing a packet at its packet end bit.
+ *
+ * @param decoder The decoder.
+ * @param bit The bit.
+ * @param expected The bits of the expected packet from its start bit on, the last one lowest.
+ * @param expected_count The number of bits of the expected packet.
+ * @return int 1 if a packet was completed and matches, -1 if it does not match, 0 otherwise.
+ */
+static int decode_bit(LineDecoder *decoder, int bit, unsigned long long expected, int expected_count)
+{
+    if (!decoder->in_packet)
+    {
+        if (bit)
+        {
+            decoder->ones++;
+            return 0;
+        }
+        if (decoder->ones < PREAMBLE_MIN)
+        {
+            decoder->errors++;
+            decoder->ones = 0;
+            return 0;
+        }
+        decoder->in_packet = 1;
+        decoder->bits = 0;
+        decoder->count = 0;
+    }
+
+    decoder->bits = decoder->bits << 1 | bit;
+    decoder->count++;
+    // Every ninth bit separates the bytes, a one ends the packet
+    if (decoder->count > 1 && (decoder->count - 1) % 9 == 0 && bit)
+    {
+        decoder->in_packet = 0;
+        decoder->ones = 0;
+        decoder->packets++;
+        return decoder->count == expected_count && decoder->bits == expected ? 1 : -1;
+    }
+    if (decoder->count >= 64)
+    {
+        decoder->in_packet = 0;
+        decoder->ones = 0;
+        decoder->errors++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Takes the level of the next UART bit of the line.
+ *
+ * A half 1-bit lasts one UART bit and a half 0-bit two to UART_ZERO_MAX, both halves of a bit are equal.
+ *
+ * @param decoder The decoder.
+ * @param level The level, -1 to end the last run.
+ * @param expected The bits of the expected packet, see decode_bit.
+ * @param expected_count The number of bits of the expected packet.
+ * @return int The result of decode_bit for a completed bit, 0 otherwise.
+ */
+static int decode_level(LineDecoder *decoder, int level, unsigned long long expected, int expected_count)
+{
+    if (level == decoder->level)
+    {
+        decoder->run++;
+        return 0;
+    }
+
+    int result = 0;
+    int half = decoder->run;
+    if (decoder->level == 0)
+    {
+        decoder->first = half;
+    }
+    else if (decoder->level == 1 && decoder->first > 0)
+    {
+        if (half == 1 && decoder->first == 1)
+        {
+            result = decode_bit(decoder, 1, expected, expected_count);
+        }
+        else if (half >= 2 && half <= UART_ZERO_MAX && half == decoder->first)
+        {
+            result = decode_bit(decoder, 0, expected, expected_count);
+        }
+        else
+        {
+            decoder->errors++;
+        }
+        decoder->first = 0;
+    }
+    decoder->level = level;
+    decoder->run = 1;
+    return result;
+}
+
+/**
+ * @brief Returns a random telegram of the module with its length.
+ */
+static unsigned long long random_telegram(void)
+{
+    switch (rand() % 3)
+    {
+    case 0:
+    {
+        LocomotiveData loco = {.speed = rand() % 16, .light = rand() % 2, .direction = rand() % 2, .address = 1 + rand() % 127, .type = 1};
+        return buildLocomotiveTelegram(loco);
+    }
+    case 1:
+    {
+        MagneticData mag = {.enable = rand() % 2, .device = rand() % 4, .control = rand() % 2, .address = 1 + rand() % 511, .type = 2};
+        return buildMagneticTelegram(mag);
+    }
+    default:
+    {
+        IdleConverter converter;
+        converter.it = buildIdleTelegram();
+        return converter.ull;
+    }
+    }
+}
+
+/**
+ * @brief Sends random packets through a pseudo terminal and checks the packets recovered from its other end.
+ *
+ * The pseudo terminal stands in for the serial line, its other end for the booster and a decoder.
+ *
+ * @param count The number of packets.
+ * @return int EXIT_SUCCESS if every packet arrived unchanged, EXIT_FAILURE otherwise.
+ */
+static int run_loopback(long count)
+{
+    int fd_master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd_master < 0 || grantpt(fd_master) != 0 || unlockpt(fd_master) != 0)
+    {
+        perror("Failed to open a pseudo terminal");
+        return EXIT_FAILURE;
+    }
+    int fd_line = open(ptsname(fd_master), O_RDWR | O_NOCTTY);
+    if (fd_line < 0)
+    {
+        perror("Failed to open the pseudo terminal");
+        close(fd_master);
+        return EXIT_FAILURE;
+    }
+    if (configure_line(fd_line) != 0 || configure_line(fd_master) != 0)
+    {
+        close(fd_line);
+        close(fd_master);
+        return EXIT_FAILURE;
+    }
+
+    static unsigned long long expected[LOOPBACK_BATCH];
+    static int expected_count[LOOPBACK_BATCH];
+    LineDecoder decoder = {.level = 1};
+    LineStatistics stats = {0};
+    unsigned long long dcc_time = 0;
+    unsigned long matched = 0, mismatched = 0;
+    srand(1);
+
+    for (long sent = 0; sent < count;)
+    {
+        // One write per batch, as the backend writes everything which arrived since the last one
+        unsigned char buffer[LOOPBACK_BATCH * UART_MAX_BYTES];
+        size_t used = 0;
+        int batch = 0;
+        for (; batch < LOOPBACK_BATCH && sent < count; batch++, sent++)
+        {
+            unsigned long long message = random_telegram();
+            int written = encodeUartTelegram(message, TELEGRAM_LENGTH, buffer + used, UART_MAX_BYTES);
+            if (written < 0)
+            {
+                printf("Packet 0x%016llx can't be encoded\n", message);
+                return EXIT_FAILURE;
+            }
+            used += written;
+
+            int preamble = __builtin_clzll(~message);
+            expected_count[batch] = TELEGRAM_LENGTH - preamble;
+            expected[batch] = (message << preamble) >> (64 - expected_count[batch]);
+            for (int i = 0; i < TELEGRAM_LENGTH; i++)
+            {
+                dcc_time += (message >> (63 - i)) & 0x1 ? 2 * 58 : 2 * 100;
+            }
+            stats.packets++;
+        }
+        if (write_line(fd_line, buffer, used, &stats) != 0)
+        {
+            return EXIT_FAILURE;
+        }
+
+        // The start and stop bits frame the eight data bits, least significant first
+        size_t received = 0;
+        int next = 0;
+        long long deadline = now_us() + LOOPBACK_TIMEOUT;
+        while (received < used && now_us() < deadline)
+        {
+            fd_set fds;
+            FD_ZERO(&fds);
+            FD_SET(fd_master, &fds);
+            struct timeval tv = {.tv_sec = 0, .tv_usec = 100000};
+            if (select(fd_master + 1, &fds, NULL, NULL, &tv) <= 0)
+            {
+                continue;
+            }
+            unsigned char bytes[LOOPBACK_BATCH * UART_MAX_BYTES];
+            ssize_t r = read(fd_master, bytes, sizeof(bytes));
+            for (ssize_t i = 0; i < r; i++)
+            {
+                int levels[UART_FRAME_BITS];
+                levels[0] = 0;
+                for (int k = 0; k < 8; k++)
+                {
+                    levels[1 + k] = (bytes[i] >> k) & 0x1;
+                }
+                levels[9] = 1;
+                for (int k = 0; k < UART_FRAME_BITS; k++)
+                {
+                    int result = decode_level(&decoder, levels[k], next < batch ? expected[next] : 0,
+                                              next < batch ? expected_count[next] : 0);
+                    if (result > 0)
+                    {
+                        matched++;
+                    }
+                    else if (result < 0)
+                    {
+                        mismatched++;
+                    }
+                    next += result != 0;
+                }
+            }
+            received += r > 0 ? r : 0;
+        }
+        // The end bit of the last packet is complete once the line idles
+        int result = decode_level(&decoder, -1, next < batch ? expected[next] : 0, next < batch ? expected_count[next] : 0);
+        if (result > 0)
+        {
+            matched++;
+        }
+        else if (result < 0)
+        {
+            mismatched++;
+        }
+        next += result != 0;
+        decoder.level = 1;
+        decoder.run = 0;
+        if (received < used || next < batch)
+        {
+            printf("%zu of %zu bytes and %d of %d packets of a batch arrived\n", received, used, next, batch);
+            mismatched += batch - next;
+        }
+    }
+    close(fd_line);
+    close(fd_master);
+
+    double line_time = stats.bytes * UART_FRAME_BITS * UART_BIT_TIME / 1e9;
+    printf("%lu packets, %llu bytes in %lu writes\n", stats.packets, stats.bytes, stats.writes);
+    printf("%lu packets recovered unchanged, %lu differ, %lu half bits or preambles out of timing\n",
+           matched, mismatched, decoder.errors);
+    printf("%.3f s on the serial line, %.3f s with the half bits of the track task\n", line_time, dcc_time / 1e6);
+    return mismatched == 0 && decoder.errors == 0 && matched == (unsigned long)count ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void usage(const char *name)
+{
+    printf("Usage: %s [OPTION]... --device <path>\n", name);
+    printf("       %s --loopback <count>\n", name);
+    printf("\nDescription: Drives the booster of a UART district from the packets of the module, the serial line times the bits instead of the track task.\n");
+    printf("\nOptions:\n");
+    printf("  --device <path>          Serial line of the booster, set to 8N1 at %d baud.\n", UART_BAUD);
+    printf("  --district <n>           District of the booster. Defaults to 0.\n");
+    printf("  --loopback <count>       Send count random packets through a pseudo terminal and check them, needs no module.\n");
+    printf("  --queue <packets>        Idle packets kept in the transmit buffer. Defaults to 2.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    const char *device = NULL;
+    int district = 0;
+    int queue = 2;
+    long loopback = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        int valid = i + 1 < argc;
+        if (valid && strcmp(argv[i], "--device") == 0)
+        {
+            device = argv[++i];
+        }
+        else if (valid && strcmp(argv[i], "--district") == 0)
+        {
+            valid = sscanf(argv[++i], "%d", &district) == 1 && district >= 0;
+        }
+        else if (valid && strcmp(argv[i], "--loopback") == 0)
+        {
+            valid = sscanf(argv[++i], "%ld", &loopback) == 1 && loopback > 0;
+        }
+        else if (valid && strcmp(argv[i], "--queue") == 0)
+        {
+            valid = sscanf(argv[++i], "%d", &queue) == 1 && queue >= 1;
+        }
+        else
+        {
+            valid = 0;
+        }
+
+        if (!valid)
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (loopback > 0)
+    {
+        return run_loopback(loopback);
+    }
+    if (device == NULL)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    return run_backend(device, district, queue);
+}